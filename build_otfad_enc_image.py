@@ -29,7 +29,6 @@ class boot_image_part():
 		self.end_addr = self.srt_addr + size
 		self.end_addr_kb = self.srt_addr + size
 		self.keyblob = res_path + "keyblob" + str(part_num)
-		self.enc_image = res_path + "enc_image" + str(part_num)
 		self.scrambled_kek = res_path + "otfad_scrambled_key" + str(part_num)
 
 #
@@ -107,23 +106,10 @@ def print_usage():
 	pass
 
 #
-# Concatenate required files into an output file (Only linux shell cmds supported)
+# Insert the key blobs into the encrypted image (Only linux shell cmds supported)
 #
 def construct_final_image(part1, part2, part3, part4, file_name):
-	''' Concatenate required files into an output file (Only linux shell cmds supported) '''
-
-	shutil.move('header', res_path + 'header')
-	try:
-		subprocess.check_call('cat ' + res_path + 'header ' + part1.enc_image + ' ' \
-								    + part2.enc_image + ' ' \
-								    + part3.enc_image + ' ' \
-								    + part4.enc_image + ' > ' + file_name, shell=True)
-	except subprocess.CalledProcessError as e:
-		print (RED + "Error: Encrypted Image concatenation failed : " + str(e.returncode) + RESET)
-		sys.exit(1)
-	except Exception as e:
-		raise e
-		sys.exit(1)
+	''' Insert the key blobs into the encrypted image (Only linux shell cmds supported) '''
 
 	# Concatenate key blobs
 	try:
@@ -223,36 +209,28 @@ def generate_keyblob(otfad_key, part1, part):
 	pass
 
 #
-# Encrypt the Input image with Image encryption key
+# Encrypt all enabled boot image partitions of the Input image, each with its
+# own Image encryption key, in a single pass producing the final image layout
 #
-def generate_encrypted_image(image, part):
-	''' Encrypt the Input image with Image encryption key '''
-	if (part.en == 1):
-		print (BLUE + "Generating Encrypted Image..." + RESET)
-		try:
-			subprocess.check_call([ENCRYPT_IMAGE_EXEC, \
-					"-i", image, \
-					"-k", part.enc_key, \
-					"-c", part.ctr, \
-					"-s", hex(part.srt_addr), \
-					"-e", hex(part.end_addr), \
-					"-o", part.enc_image])
-		except OSError:
-			print (RED + "Error: Please re-build the Encrypt Image executable" + RESET)
-			sys.exit(1)
-		except Exception as e:
-			raise e
-			sys.exit(1)
-	else:
-		print (YELLOW + "Generating Dummy Encrypted Image..." + RESET)
-		try:
-			file = open(part.enc_image, FILE_WRITE)
-		except Exception as e:
-			raise e
-			sys.exit(1)
-		else:
-			print ("Encrypted Image generated: " + part.enc_image)
-			file.close()
+def generate_encrypted_image(image, part1, part2, part3, part4, file_name):
+	'''
+	Encrypt all enabled boot image partitions of the Input image, each with its
+	own Image encryption key, in a single pass producing the final image layout
+	'''
+	print (BLUE + "Generating Encrypted Image..." + RESET)
+	cmd = [ENCRYPT_IMAGE_EXEC, "-i", image, "-o", file_name]
+	for part in [part1, part2, part3, part4]:
+		if (part.en == 1):
+			cmd += ["-r", part.enc_key + "," + part.ctr + "," + \
+				      hex(part.srt_addr) + "," + hex(part.end_addr)]
+	try:
+		subprocess.check_call(cmd)
+	except OSError:
+		print (RED + "Error: Please re-build the Encrypt Image executable" + RESET)
+		sys.exit(1)
+	except Exception as e:
+		raise e
+		sys.exit(1)
 	pass
 
 #
@@ -525,10 +503,9 @@ def process_config_file(config_file):
 
 		generate_keyblob(otfad_scrambled_key, part1, part)
 		print ("Done!")
-		generate_encrypted_image(input_image, part)
-		print ("Done!")
 
-# TODO: inbetween images
+	generate_encrypted_image(input_image, part1, part2, part3, part4, output_file)
+	print ("Done!")
 
 	print (BLUE + "Assembling keyblobs and encrypted image..." + RESET)
 	construct_final_image(part1, part2, part3, part4, output_file)
@@ -0,0 +1,818 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "decrypt_image.h"
+
+/*
+ * Description : This function reads the input file and returns size
+ *
+ * @Inputs  : fp         - Input file pointer
+ *            input_file - Input file name
+ *
+ * @Outputs : return File size
+ *
+ */
+static long get_file_size(FILE **fp, const char *input_file)
+{
+	long ret = 0;
+
+	/* Open file */
+	*fp = fopen(input_file, "r");
+	if (*fp == NULL) {
+		fprintf(stderr, "Error: Couldn't open file %s; %s\n", input_file, strerror(errno));
+		return -1;
+	}
+
+	/* Seek to the end of file to calculate size */
+	if (fseek(*fp , 0 , SEEK_END)) {
+		fprintf(stderr, "Error: Couldn't seek to end of file %s; %s\n", input_file, strerror(errno));
+		return -1;
+	}
+
+	/* Get size and go back to start of the file */
+	ret = ftell(*fp);
+	rewind(*fp);
+
+	return ret;
+}
+
+/*
+ * Description : This function allocates buffer with size from input file
+ *
+ * @Inputs  : input_file - Input file name
+ *            check_size - Expected file size
+ *
+ * @Outputs : return buffer pointer, NULL on failure
+ *
+ */
+static uint8_t *alloc_buffer(const char *input_file, long check_size)
+{
+	FILE *fp = NULL;
+	uint8_t *buff = NULL;
+	long file_size;
+
+	file_size = get_file_size(&fp, input_file);
+	if (file_size < 0) {
+		goto err;
+	} else if (file_size != check_size) {
+		printf("Error: Incorrect Size of %s\n", input_file);
+		goto err;
+	}
+
+	/* Allocate memory to the buffer, cleared when freed */
+	if (otfad_buf_alloc(file_size, OTFAD_BUF_SECRET, (void **)&buff)) {
+		fprintf(stderr, "Error allocating memory; %s\n", strerror(ENOMEM));
+		buff = NULL;
+		goto err;
+	}
+
+	/* Copy the file into the buffer */
+	if (fread(buff, 1, file_size, fp) != file_size) {
+		fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
+		goto err;
+	}
+	FCLOSE(fp);
+
+	return buff;
+err:
+	BUF_FREE(buff);
+	FCLOSE(fp);
+
+	return NULL;
+}
+
+/*
+ * Description : Maps the input image copy-on-write: it is decrypted in
+ *               place without changing the file, and only the pages read
+ *               are loaded
+ *
+ * @Inputs  : input_file - Input file name
+ *            size       - File size output
+ *
+ * @Outputs : return the mapping, NULL on failure
+ *
+ */
+static uint8_t *map_image(const char *input_file, size_t *size)
+{
+	struct stat st;
+	void *image;
+	int fd;
+
+	fd = open(input_file, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Error: Couldn't open file %s; %s\n", input_file, strerror(errno));
+		return NULL;
+	}
+	if (fstat(fd, &st)) {
+		fprintf(stderr, "Error: Couldn't stat file %s; %s\n", input_file, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	if (st.st_size < KEYBLOB_AREA_SIZE) {
+		printf("Error: Input image is smaller than the key blobs\n");
+		close(fd);
+		return NULL;
+	}
+
+	image = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED) {
+		fprintf(stderr, "Error: Couldn't map file %s; %s\n", input_file, strerror(errno));
+		return NULL;
+	}
+	*size = st.st_size;
+
+	return image;
+}
+
+/*
+ * Description : Prints the usage information for running decrypt_image
+ *
+ * @Outputs : The usage info will be printed out on console window.
+ */
+void print_usage(void) {
+	int i = 0;
+	printf("OTFAD: Image Decryption tool\n"
+		"Usage: ./decrypt_image ");
+	do {
+		printf("-%c <%s> ", long_opt[i].val, long_opt[i].name);
+		i++;
+	} while (long_opt[i + 1].name != NULL);
+	printf("\n");
+
+	i = 0;
+	printf("Options:\n");
+	do {
+		printf("\t-%c|--%s  -->  %s\n", long_opt[i].val, long_opt[i].name, opt_desc[i]);
+		i++;
+	} while (long_opt[i].name != NULL && opt_desc[i] != NULL);
+}
+
+/*
+ * Description : Handle each command line option
+ *
+ * @Inputs     : Command line arguments
+ */
+void handle_cl_opt(int argc, char **argv)
+{
+	int next_opt = 0;
+	int n_long_opt = 1; // Includes the command itself
+	int mandatory_opt = 0;
+	int scramble_opt = 0;
+	int read_opt = 0;
+	int i = 0;
+
+	do {
+		n_long_opt++;
+		if (long_opt[i].has_arg == required_argument) {
+			n_long_opt++;
+		}
+		i++;
+	} while (long_opt[i + 1].name != NULL);
+
+	/* -R can be given once per read */
+	n_long_opt += 2 * (MAX_READS - 1);
+
+	/* Start from the first command-line option */
+	optind = 0;
+	/* Handle command line options*/
+	do {
+		next_opt = getopt_long(argc, argv, short_opt, long_opt, NULL);
+		switch (next_opt)
+		{
+		case 'i':
+		case 'k':
+			mandatory_opt += 1;
+			break;
+		case 's':
+		case 'a':
+			scramble_opt += 1;
+			break;
+		case 'R':
+			read_opt += 1;
+			if (read_opt > MAX_READS) {
+				printf("Error: At most %d reads can be given\n", MAX_READS);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		/* Display usage */
+		case 'h':
+			print_usage();
+			exit(EXIT_SUCCESS);
+			break;
+		case '?':
+			/* Unknown character or option with no parameter */
+			print_usage();
+			exit(EXIT_FAILURE);
+			break;
+		/* At the end reach here and check if mandatory options are present */
+		default:
+			if (next_opt == -1 && mandatory_opt != 2) {
+				printf("Error: -i and -k options are required\n");
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+			if (next_opt == -1 && scramble_opt != 0 && scramble_opt != 2) {
+				printf("Error: -s and -a options must be given together\n");
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
+	} while (next_opt != -1);
+
+	/* Check for valid arguments */
+	if (argc < 2 || argc > n_long_opt) {
+		printf("Error: Incorrect number of options\n");
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Description : Unwraps the key blob of a context, checks its CRC and
+ *               creates the CTR context of a valid region
+ *
+ * @Inputs  : blob         - Key blob (OTFAD_KEYBLOB_SIZE bytes)
+ *            otfad_key    - OTFAD key
+ *            key_scramble - Key scramble, or NULL if the key isn't scrambled
+ *            align        - Key scramble align
+ *            ctx_num      - Context number
+ *            dc           - Decoded context output
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int load_context(const uint8_t *blob, const uint8_t *otfad_key,
+			const uint8_t *key_scramble, uint8_t align, int ctx_num,
+			struct dec_context *dc)
+{
+	uint8_t kek[OTFAD_KEY_SIZE];
+	uint8_t pt[OTFAD_KEYBLOB_PT_SIZE];
+	uint8_t key[OTFAD_KEY_SIZE];
+	uint8_t ctr[OTFAD_CTR_SIZE];
+	int ret = -1;
+	int err;
+#if DEBUG
+	int i;
+#endif
+
+	/* Each context has its own scrambled key */
+	if (key_scramble != NULL) {
+		err = otfad_key_scramble(otfad_key, key_scramble, align, ctx_num, kek);
+		if (err) {
+			printf("Error: Context %d: Key scramble failed; %s\n", ctx_num, otfad_strerror(err));
+			goto out;
+		}
+	} else {
+		memcpy(kek, otfad_key, OTFAD_KEY_SIZE);
+	}
+
+	err = otfad_keyblob_unwrap(blob, kek, pt);
+	if (err) {
+		printf("Error: Context %d: Key Blob unwrap failed; %s\n", ctx_num, otfad_strerror(err));
+		if (err == -OTFAD_ERR_CRYPTO) {
+			ERR_print_errors_fp(stderr);
+		}
+		goto out;
+	}
+
+	err = otfad_keyblob_parse(pt, key, ctr, &dc->start_address, &dc->end_address, &dc->valid);
+	if (err) {
+		printf("Error: Context %d: Key Blob CRC mismatch; %s\n", ctx_num, otfad_strerror(err));
+		goto out;
+	}
+
+#if DEBUG
+	printf("Context %d Image Encryption Key: ", ctx_num);
+	for (i = 0; i < OTFAD_KEY_SIZE; i++)
+		printf("%02X", key[i]);
+	printf("\nContext %d Counter: ", ctx_num);
+	for (i = 0; i < OTFAD_CTR_SIZE; i++)
+		printf("%02X", ctr[i]);
+	printf("\n");
+#endif
+
+	if (dc->valid) {
+		err = otfad_ctr_new(key, ctr, &dc->ctx);
+		if (err) {
+			printf("Error: Context %d: %s\n", ctx_num, otfad_strerror(err));
+			goto out;
+		}
+	}
+
+	ret = 0;
+out:
+	OPENSSL_cleanse(kek, sizeof(kek));
+	OPENSSL_cleanse(pt, sizeof(pt));
+	OPENSSL_cleanse(key, sizeof(key));
+	OPENSSL_cleanse(ctr, sizeof(ctr));
+
+	return ret;
+}
+
+/*
+ * Description : qsort comparator of image offsets
+ */
+static int cmp_offset(const void *a, const void *b)
+{
+	size_t oa = *(const size_t *)a;
+	size_t ob = *(const size_t *)b;
+
+	return (oa > ob) - (oa < ob);
+}
+
+/*
+ * Description : Cuts the valid regions into segments each decrypted by one
+ *               context. Where regions overlap, the OTFAD engine uses the
+ *               lowest numbered context, so does the segment.
+ *
+ * @Inputs  : dc      - Decoded contexts, regions clamped to the image
+ *            segment - Segments output (MAX_SEGMENTS entries)
+ *
+ * @Outputs : return the number of segments
+ *
+ */
+static int build_segments(const struct dec_context *dc, struct dec_segment *segment)
+{
+	size_t bound[MAX_SEGMENTS];
+	int n_bounds = 0;
+	int n_segments = 0;
+	int i, j;
+
+	for (i = 0; i < OTFAD_NUM_CONTEXT; i++) {
+		if (dc[i].valid && dc[i].start_offset < dc[i].end_offset) {
+			bound[n_bounds++] = dc[i].start_offset;
+			bound[n_bounds++] = dc[i].end_offset;
+		}
+	}
+	qsort(bound, n_bounds, sizeof(bound[0]), cmp_offset);
+
+	for (j = 0; j + 1 < n_bounds; j++) {
+		if (bound[j] == bound[j + 1]) {
+			continue;
+		}
+		for (i = 0; i < OTFAD_NUM_CONTEXT; i++) {
+			if (dc[i].valid && dc[i].start_offset <= bound[j] && bound[j] < dc[i].end_offset) {
+				break;
+			}
+		}
+		/* Gap between regions */
+		if (i == OTFAD_NUM_CONTEXT) {
+			continue;
+		}
+		if (n_segments && segment[n_segments - 1].ctx_num == i &&
+		    segment[n_segments - 1].end_offset == bound[j]) {
+			segment[n_segments - 1].end_offset = bound[j + 1];
+			continue;
+		}
+		segment[n_segments].ctx_num = i;
+		segment[n_segments].start_offset = bound[j];
+		segment[n_segments].end_offset = bound[j + 1];
+		n_segments++;
+	}
+
+	return n_segments;
+}
+
+/*
+ * Description : Worker of the decryption pool. Takes the next slice of any
+ *               segment until all slices are done.
+ *
+ * @Inputs  : arg - Shared dec_pool
+ */
+static void *dec_worker(void *arg)
+{
+	struct dec_pool *pool = arg;
+	const struct dec_segment *seg;
+	size_t n_slices = pool->first_slice[pool->n_segments];
+	size_t s, off, len;
+	int err;
+	int k;
+
+	while ((s = __atomic_fetch_add(&pool->next_slice, 1, __ATOMIC_RELAXED)) < n_slices) {
+		for (k = 0; s >= pool->first_slice[k + 1]; k++) {
+			;
+		}
+		seg = &pool->segment[k];
+		off = seg->start_offset + (s - pool->first_slice[k]) * OTFAD_THREAD_SLICE_SIZE;
+		len = seg->end_offset - off;
+		if (len > OTFAD_THREAD_SLICE_SIZE) {
+			len = OTFAD_THREAD_SLICE_SIZE;
+		}
+
+		err = otfad_ctr_crypt(pool->context[seg->ctx_num].ctx, pool->image + off,
+				      pool->image + off, len, MX7ULP_QSPI_BASE_ADDR + off);
+		if (err) {
+			__atomic_store_n(&pool->err, err, __ATOMIC_RELAXED);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Decrypts the segments in place on a pool of threads. The
+ *               slices of all segments share the pool, so small regions
+ *               don't leave threads idle. Segments fitting in one slice
+ *               together are decrypted in a single multi-context CTR call
+ *               instead.
+ *
+ * @Inputs  : image     - Image buffer
+ *            dc        - Decoded contexts
+ *            segment   - Segments
+ *            n_seg     - Number of segments
+ *            n_threads - Number of threads
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int decrypt_segments(uint8_t *image, const struct dec_context *dc,
+			    const struct dec_segment *segment, int n_seg, int n_threads)
+{
+	struct otfad_ctr_op op[MAX_SEGMENTS];
+	struct dec_pool pool;
+	pthread_t *threads = NULL;
+	size_t total = 0;
+	size_t len;
+	int started = 0;
+	int err;
+	int i;
+
+	for (i = 0; i < n_seg; i++) {
+		op[i].ctx = dc[segment[i].ctx_num].ctx;
+		op[i].in = image + segment[i].start_offset;
+		op[i].out = image + segment[i].start_offset;
+		op[i].size = segment[i].end_offset - segment[i].start_offset;
+		op[i].sys_addr = MX7ULP_QSPI_BASE_ADDR + segment[i].start_offset;
+		total += op[i].size;
+	}
+	if (total <= OTFAD_THREAD_SLICE_SIZE) {
+		err = otfad_ctr_crypt_multi(op, n_seg);
+		if (err) {
+			printf("Error: Decryption failed; %s\n", otfad_strerror(err));
+			return -1;
+		}
+		return 0;
+	}
+
+	memset(&pool, 0, sizeof(pool));
+	pool.image = image;
+	pool.context = dc;
+	pool.segment = segment;
+	pool.n_segments = n_seg;
+	for (i = 0; i < n_seg; i++) {
+		len = segment[i].end_offset - segment[i].start_offset;
+		pool.first_slice[i + 1] = pool.first_slice[i] +
+					  (len + OTFAD_THREAD_SLICE_SIZE - 1) / OTFAD_THREAD_SLICE_SIZE;
+	}
+
+	if (n_threads > pool.first_slice[n_seg]) {
+		n_threads = pool.first_slice[n_seg];
+	}
+	if (n_threads > 1) {
+		threads = malloc((n_threads - 1) * sizeof(pthread_t));
+	}
+	for (i = 0; threads != NULL && i < n_threads - 1; i++) {
+		if (pthread_create(&threads[i], NULL, dec_worker, &pool)) {
+			fprintf(stderr, "Warning: Couldn't create thread %d, continuing with %d\n", i, started + 1);
+			break;
+		}
+		started++;
+	}
+
+	/* Slices of threads that couldn't be started are picked up here */
+	dec_worker(&pool);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	FREE(threads);
+
+	if (pool.err) {
+		printf("Error: Decryption failed; %s\n", otfad_strerror(pool.err));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Parses a read given as <address>,<length>
+ *
+ * @Inputs  : arg - Option argument
+ *            rq  - Read output, its buffer allocated
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int parse_read(const char *arg, struct otfad_read *rq)
+{
+	char *end;
+
+	rq->addr = strtoul(arg, &end, BASE_HEX);
+	if (*end != ',') {
+		printf("Error: Read %s is not <address>,<length>\n", arg);
+		return -1;
+	}
+	rq->size = strtoul(end + 1, &end, BASE_HEX);
+	if (*end != '\0' || rq->size == 0) {
+		printf("Error: Read %s is not <address>,<length>\n", arg);
+		return -1;
+	}
+
+	if (otfad_buf_alloc(rq->size, OTFAD_BUF_HUGE, (void **)&rq->buf)) {
+		fprintf(stderr, "Error allocating memory; %s\n", strerror(ENOMEM));
+		rq->buf = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Reads address ranges through the OTFAD read emulator, as
+ *               fetched by the target, without decrypting the whole image
+ *
+ * @Inputs  : image      - Image
+ *            image_size - Image size
+ *            dc         - Decoded contexts
+ *            rq         - Reads
+ *            n_reads    - Number of reads
+ *            fp_out     - Output file of the raw plaintext, or NULL for a
+ *                         hex dump on stdout
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int read_ranges(const uint8_t *image, size_t image_size, const struct dec_context *dc,
+		       const struct otfad_read *rq, int n_reads, FILE *fp_out)
+{
+	struct otfad_reader *rd = NULL;
+	uint64_t hits, misses;
+	uint64_t size;
+	uint32_t i, j;
+	int ret = -1;
+	int err;
+
+	err = otfad_reader_new(image, image_size, MX7ULP_QSPI_BASE_ADDR, 0, &rd);
+	for (i = 0; !err && i < OTFAD_NUM_CONTEXT; i++) {
+		if (!dc[i].valid || dc[i].start_offset == dc[i].end_offset) {
+			continue;
+		}
+		/* Whole lines of the 1 KB granular region */
+		size = dc[i].end_offset - dc[i].start_offset + OTFAD_READER_LINE_SIZE - 1;
+		size -= size % OTFAD_READER_LINE_SIZE;
+		if (size > (uint64_t)dc[i].end_address - dc[i].start_address + 1) {
+			size = (uint64_t)dc[i].end_address - dc[i].start_address + 1;
+		}
+		err = otfad_reader_add_region(rd, dc[i].ctx, dc[i].start_address, size);
+	}
+	if (!err) {
+		err = otfad_reader_read_batch(rd, rq, n_reads);
+	}
+	if (err) {
+		printf("Error: Read failed; %s\n", otfad_strerror(err));
+		goto out;
+	}
+
+	for (i = 0; i < n_reads; i++) {
+		if (fp_out != NULL) {
+			if (fwrite(rq[i].buf, 1, rq[i].size, fp_out) != rq[i].size) {
+				printf("Error: File write failed\n");
+				goto out;
+			}
+			continue;
+		}
+		for (j = 0; j < rq[i].size; j++) {
+			if (j % DUMP_BYTES_PER_LINE == 0) {
+				printf("%s0x%08X:", j ? "\n" : "", rq[i].addr + j);
+			}
+			printf(" %02X", rq[i].buf[j]);
+		}
+		printf("\n");
+	}
+
+	otfad_reader_stats(rd, &hits, &misses);
+	printf("Keystream cache: %llu hits, %llu misses\n",
+	       (unsigned long long)hits, (unsigned long long)misses);
+
+	ret = 0;
+out:
+	otfad_reader_free(rd);
+
+	return ret;
+}
+
+int main (int argc, char **argv)
+{
+	FILE *fp_out = NULL;
+
+	uint8_t *image = NULL;
+	uint8_t *otfad_key = NULL;
+	uint8_t *key_scramble = NULL;
+	uint8_t key_scramble_align = 0;
+	char *input_fname = NULL;
+	char *output_fname = NULL;
+	size_t image_size = 0;
+	int n_threads = 0;
+
+	struct dec_context dc[OTFAD_NUM_CONTEXT];
+	struct dec_segment segment[MAX_SEGMENTS];
+	struct otfad_read rq[MAX_READS];
+	int n_reads = 0;
+	uint64_t image_end;
+	uint64_t rgn_end;
+	int n_segments;
+	int failed = 0;
+
+	int next_opt = 0;
+	int i, j;
+
+	memset(dc, 0, sizeof(dc));
+	memset(rq, 0, sizeof(rq));
+
+	/* Handle command line options */
+	handle_cl_opt(argc, argv);
+
+	/* Start from the first command-line option */
+	optind = 0;
+	/* Perform actions according to command-line option */
+	do {
+		next_opt = getopt_long(argc, argv, short_opt, long_opt, NULL);
+		switch (next_opt)
+		{
+		/* Input image */
+		case 'i':
+			input_fname = optarg;
+			break;
+		/* OTFAD key */
+		case 'k':
+			otfad_key = alloc_buffer(optarg, OTFAD_KEY_SIZE);
+			if (otfad_key == NULL) {
+				printf("Error: Error allocating memory for OTFAD key\n");
+				goto err;
+			}
+			break;
+		/* Key scramble */
+		case 's':
+			key_scramble = alloc_buffer(optarg, OTFAD_KEY_SCRAMBLE_SIZE);
+			if (key_scramble == NULL) {
+				printf("Error: Error allocating memory for Key Scramble\n");
+				goto err;
+			}
+			break;
+		/* Key scramble align */
+		case 'a':
+			key_scramble_align = strtol(optarg, NULL, BASE_HEX) & KEY_SCRAMBLE_ALIGN_MASK;
+			break;
+		/* Ouput file */
+		case 'o':
+			output_fname = optarg;
+			break;
+		/* Number of decryption threads */
+		case 't':
+			n_threads = strtol(optarg, NULL, 10);
+			if (n_threads < 0) {
+				printf("Error: Number of threads should be positive\n");
+				goto err;
+			}
+			break;
+		/* Read through the emulator */
+		case 'R':
+			if (parse_read(optarg, &rq[n_reads])) {
+				goto err;
+			}
+			n_reads++;
+			break;
+		default:
+			break;
+		}
+	} while (next_opt != -1);
+
+	if (n_threads == 0) {
+		n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (n_threads < 1) {
+			n_threads = 1;
+		}
+	}
+
+	image = map_image(input_fname, &image_size);
+	if (image == NULL) {
+		goto err;
+	}
+	image_end = (uint64_t)MX7ULP_QSPI_BASE_ADDR + image_size;
+
+	/* Key blob of context i at offset i * OTFAD_KEYBLOB_SIZE */
+	for (i = 0; i < OTFAD_NUM_CONTEXT; i++) {
+		if (load_context(image + i * OTFAD_KEYBLOB_SIZE, otfad_key, key_scramble,
+				 key_scramble_align, i, &dc[i])) {
+			failed++;
+			continue;
+		}
+		if (!dc[i].valid) {
+			printf("Context %d: disabled\n", i);
+			continue;
+		}
+		printf("Context %d: region 0x%08X-0x%08X\n", i, dc[i].start_address, dc[i].end_address);
+
+		/* Clamp the region to the image */
+		rgn_end = (uint64_t)dc[i].end_address + 1;
+		if (dc[i].start_address < MX7ULP_QSPI_BASE_ADDR || dc[i].start_address >= image_end) {
+			printf("Warning: Context %d: region is outside of the image\n", i);
+			continue;
+		}
+		if (rgn_end > image_end) {
+			rgn_end = image_end;
+			printf("Warning: Context %d: region ends after the image, decrypted up to 0x%08llX\n",
+			       i, (unsigned long long)rgn_end - 1);
+		}
+		dc[i].start_offset = dc[i].start_address - MX7ULP_QSPI_BASE_ADDR;
+		dc[i].end_offset = rgn_end - MX7ULP_QSPI_BASE_ADDR;
+		for (j = 0; j < i; j++) {
+			if (dc[j].valid && dc[j].start_address <= dc[i].end_address &&
+			    dc[i].start_address <= dc[j].end_address) {
+				printf("Warning: Context %d: region overlaps context %d, which takes precedence\n",
+				       i, j);
+			}
+		}
+	}
+	if (failed) {
+		printf("Error: %d Key Blob(s) failed, check the OTFAD key and key scramble\n", failed);
+		goto err;
+	}
+
+	if (output_fname != NULL) {
+		fp_out = fopen(output_fname, "wb");
+		if (fp_out == NULL) {
+			fprintf(stderr, "Error: Couldn't open file %s; %s\n", output_fname, strerror(errno));
+			goto err;
+		}
+	}
+
+	/* Ranges read as the target fetches them */
+	if (n_reads) {
+		if (read_ranges(image, image_size, dc, rq, n_reads, fp_out)) {
+			goto err;
+		}
+		if (fp_out != NULL && fclose(fp_out)) {
+			fp_out = NULL;
+			printf("Error: File write failed\n");
+			goto err;
+		}
+		fp_out = NULL;
+		goto out;
+	}
+
+	/* Key blobs only checked */
+	if (output_fname == NULL) {
+		goto out;
+	}
+
+	n_segments = build_segments(dc, segment);
+	if (decrypt_segments(image, dc, segment, n_segments, n_threads)) {
+		goto err;
+	}
+
+	if (fwrite(image, 1, image_size, fp_out) != image_size || fclose(fp_out)) {
+		fp_out = NULL;
+		printf("Error: File write failed\n");
+		goto err;
+	}
+	fp_out = NULL;
+
+	printf("Decrypted Image generated: %s\n", output_fname);
+
+out:
+	for (i = 0; i < OTFAD_NUM_CONTEXT; i++) {
+		otfad_ctr_free(dc[i].ctx);
+	}
+	for (i = 0; i < MAX_READS; i++) {
+		BUF_FREE(rq[i].buf);
+	}
+	if (image != NULL) {
+		munmap(image, image_size);
+	}
+	BUF_FREE(otfad_key);
+	BUF_FREE(key_scramble);
+
+	return EXIT_SUCCESS;
+err:
+	for (i = 0; i < OTFAD_NUM_CONTEXT; i++) {
+		otfad_ctr_free(dc[i].ctx);
+	}
+	for (i = 0; i < MAX_READS; i++) {
+		BUF_FREE(rq[i].buf);
+	}
+	if (image != NULL) {
+		munmap(image, image_size);
+	}
+	BUF_FREE(otfad_key);
+	BUF_FREE(key_scramble);
+	FCLOSE(fp_out);
+
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef DECRYPT_IMAGE_H
+#define DECRYPT_IMAGE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* OpenSSL includes*/
+#include <openssl/err.h>
+
+#include "otfad.h"
+
+#define BASE_HEX                16
+#define MX7ULP_QSPI_BASE_ADDR   0xC0000000
+#define KEYBLOB_AREA_SIZE       (OTFAD_NUM_CONTEXT * OTFAD_KEYBLOB_SIZE)
+#define KEY_SCRAMBLE_ALIGN_MASK 0xFF
+#define MAX_READS               16
+#define DUMP_BYTES_PER_LINE     16
+/* Region bounds are cut into at most 2 * OTFAD_NUM_CONTEXT - 1 segments */
+#define MAX_SEGMENTS            (2 * OTFAD_NUM_CONTEXT)
+
+#define FREE(x)         do { \
+				if(x != NULL) { \
+					free(x); \
+					x = NULL; \
+				} \
+			} while(0)
+
+/* Frees a buffer of the libotfad buffer pool */
+#define BUF_FREE(x)     do { \
+				otfad_buf_free(x); \
+				x = NULL; \
+			} while(0)
+
+#define FCLOSE(x)         do { \
+				if(x != NULL) { \
+					fclose(x); \
+					x = NULL; \
+				} \
+			} while(0)
+
+/* Context decoded from a key blob */
+struct dec_context {
+	struct otfad_ctr *ctx;
+	uint32_t start_address;
+	/* Last address of the region (inclusive) */
+	uint32_t end_address;
+	int valid;
+	/* Region clamped to the image, as offsets [start, end) */
+	size_t start_offset;
+	size_t end_offset;
+};
+
+/* Part of the image decrypted by a single context */
+struct dec_segment {
+	int ctx_num;
+	size_t start_offset;
+	size_t end_offset;
+};
+
+/* Slices of all segments shared by the decryption threads */
+struct dec_pool {
+	uint8_t *image;
+	const struct dec_context *context;
+	const struct dec_segment *segment;
+	int n_segments;
+	/* Index of the first slice of each segment, then the number of slices */
+	size_t first_slice[MAX_SEGMENTS + 1];
+	size_t next_slice;
+	int err;
+};
+
+/************************
+	Command line arguments
+************************/
+/* Valid short command line option letters. */
+const char* const short_opt = "i:k:s:a:o:t:R:h";
+
+/* Valid long command line options. */
+const struct option long_opt[] =
+{
+	{"input-image", required_argument, 0, 'i'},
+	{"otfad-key", required_argument, 0, 'k'},
+	{"key-scramble", required_argument, 0, 's'},
+	{"key-scramble-align", required_argument, 0, 'a'},
+	{"output", required_argument,  0, 'o'},
+	{"threads", required_argument,  0, 't'},
+	{"read", required_argument,  0, 'R'},
+	{"help", no_argument, 0, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+/* Option descriptions */
+const char* opt_desc[] =
+{
+	"Final OTFAD image, key blobs at offset 0",
+	"Input OTFAD key (128-bit)",
+	"Input key scramble (32-bit), with -a",
+	"Key scramble align (8-bit hex), with -s",
+	"Output File of the decrypted image (default: key blobs are only checked)",
+	"Number of decryption threads (default 0: one per online CPU)",
+	"Read <address>,<length> (hex) through the OTFAD read emulator: hex dump, or raw to -o; up to 16 reads",
+	"This text",
+	NULL
+};
+
+#endif /* DECRYPT_IMAGE_H */
@@ -7,124 +7,486 @@
 #include "encrypt_image.h"
 
 /*
- * Description : Handles error generated from EVP CIPHER operations.
- *               Aborts execution upon error detection.
+ * Description : Performs the AES CTR operation of a region on the job's
+ *               thread pool, or XORs the input with the cached keystream of
+ *               the region when there is one
+ *
+ * @Inputs  : job      - Encryption job
+ *            rgn      - Region being encrypted
+ *            in       - Plaintext to encrypt
+ *            out      - Ciphertext output buffer of size bytes (may be equal to in)
+ *            size     - Plaintext size
+ *            sys_addr - System Address of the first plaintext byte
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
  */
-void handle_cipher_err(void)
+static int ctr_crypt_range(const struct enc_job *job, const struct enc_region *rgn,
+			   const uint8_t *in, uint8_t *out, size_t size, uint32_t sys_addr)
 {
-	ERR_print_errors_fp(stderr);
-	exit(EXIT_FAILURE);
+	int err;
+
+	if (rgn->ks != NULL) {
+		otfad_xor(in, rgn->ks + (sys_addr - rgn->start_address), out, size);
+		return 0;
+	}
+
+	err = otfad_ctr_crypt_mt(rgn->ctx, in, out, size, sys_addr, job->n_threads);
+	if (err) {
+		printf("Error: Encryption failed; %s\n", otfad_strerror(err));
+		ERR_print_errors_fp(stderr);
+		return -1;
+	}
+
+	return 0;
 }
 
 /*
- * Description : Performs AES CTR operation on plaintext to produce ciphertext
+ * Description : Adds bytes to the plaintext or ciphertext digests of a region
  *
- * @Inputs  : plaintext - Plaintext to encrypt
- *            size      - Plaintext size
- *            key       - Key used to encrypt plaintext
- *            ctr       - Counter used to encrypt plaintext
- *            sys_addr  - System Address used to change counter per encryption block
+ * @Inputs  : d     - Region digests
+ *            which - 0 for plaintext, 1 for ciphertext
+ *            buf   - Data
+ *            size  - Number of bytes
  *
- * @Outputs : return Ciphertext
+ * @Outputs : return 0 on success, -1 on failure
  *
  */
-unsigned char *do_aes_ctr_enc(uint8_t *plaintext, int size, unsigned char *key, unsigned char *ctr, uint32_t sys_addr)
+static int digest_update(struct region_digest *d, int which, const uint8_t *buf, size_t size)
 {
-	EVP_CIPHER_CTX *ctx;
-	int outlen;
-	static unsigned char cipher[MAX_SIZE];
-	static unsigned char enc_ctr[16];
-	static unsigned char swap_enc_ctr[16];
-	uint32_t temp[4];
-	int encrypted_bytes = 0;
-	int i = 0;
-	int j = 0;
+	if (d->sha[which] == NULL) {
+		return 0;
+	}
 
-	/* Create and initialise the context */
-	if(!(ctx = EVP_CIPHER_CTX_new())) handle_cipher_err();
+	if (!EVP_DigestUpdate(d->sha[which], buf, size)) {
+		printf("Error: Digest failed\n");
+		ERR_print_errors_fp(stderr);
+		return -1;
+	}
+	d->crc[which] = otfad_crc32_ieee(d->crc[which], buf, size);
 
-	/* Set cipher type and mode */
-	if(! EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), NULL, key, NULL)) handle_cipher_err();
+	return 0;
+}
 
-#if DEBUG
-	int iter;
-	/* Number of iterations = total size to encrypt/16 bytes of each encryption block */
-	iter = size/16;
-	printf("Total Iterations : %d\n", iter);
-#endif
-	for (i = 0; i < size; i += 16) {
-		/* Calculate CTR value in each iteration */
-		sys_addr += encrypted_bytes;
-#if DEBUG
-		printf("\nIteration : %d\n", i/16);
-		printf("System address in Iteration %d = 0x%08X\n", i/16, sys_addr);
-#endif
-		ctr[SYS_ADDR_OFFSET] = (uint8_t)((sys_addr >> 24) & 0xFF);
-		ctr[SYS_ADDR_OFFSET + 1] = (uint8_t)((sys_addr >> 16) & 0xFF);
-		ctr[SYS_ADDR_OFFSET + 2] = (uint8_t)((sys_addr >> 8) & 0xFF);
-		ctr[SYS_ADDR_OFFSET + 3] = (uint8_t)(sys_addr & 0xFF);
+/*
+ * Description : Performs the AES CTR operation of a region. With digests,
+ *               the data is processed in pieces of one slice per thread:
+ *               the plaintext of a piece is hashed, encrypted and the
+ *               ciphertext hashed while the piece is still in cache, so no
+ *               other pass over the image is needed. Pieces must come in
+ *               address order.
+ *
+ * @Inputs  : job      - Encryption job
+ *            rgn      - Region being encrypted
+ *            in       - Plaintext to encrypt
+ *            out      - Ciphertext output buffer of size bytes (may be equal to in)
+ *            size     - Plaintext size
+ *            sys_addr - System Address of the first plaintext byte
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int ctr_crypt(const struct enc_job *job, const struct enc_region *rgn,
+		     const uint8_t *in, uint8_t *out, size_t size, uint32_t sys_addr)
+{
+	size_t piece = (size_t)job->n_threads * OTFAD_THREAD_SLICE_SIZE;
+	size_t pos;
+	size_t n;
 
-#if DEBUG
-		printf("\nInput Counter:\t\t\t");
-		for (j = 0; j < 16; ++j) {
-			 printf("%02X", ctr[j]);
+	if (rgn->digest == NULL) {
+		return ctr_crypt_range(job, rgn, in, out, size, sys_addr);
+	}
+
+	for (pos = 0; pos < size; pos += n) {
+		n = (size - pos > piece) ? piece : size - pos;
+		if (digest_update(rgn->digest, 0, in + pos, n) ||
+		    ctr_crypt_range(job, rgn, in + pos, out + pos, n, sys_addr + pos) ||
+		    digest_update(rgn->digest, 1, out + pos, n)) {
+			return -1;
 		}
-#endif
-		/*setting padding option*/
-		if(! EVP_CIPHER_CTX_set_padding(ctx, 0)) handle_cipher_err();
-		/* Encrypt plaintext */
-		if(! EVP_EncryptUpdate(ctx, enc_ctr, &outlen, ctr, 16)) handle_cipher_err();
+	}
 
-		/* Increment encrypted bytes */
-		encrypted_bytes = outlen;
+	return 0;
+}
 
-#if DEBUG
-		printf("\nEncrypted Counter:\t\t");
-		for (j = 0; j < 16; ++j) {
-			printf("%02X", enc_ctr[j]);
+/*
+ * Description : Encrypts all the regions of a job held in one buffer. When
+ *               the regions are small enough for a single thread and use
+ *               neither the keystream cache nor digests, their blocks are
+ *               interleaved in a single multi-context CTR call.
+ *
+ * @Inputs  : job      - Encryption job
+ *            buf      - Buffer holding the regions, encrypted in place
+ *            buf_addr - System Address of the first byte of buf
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int ctr_crypt_regions(const struct enc_job *job, uint8_t *buf, uint32_t buf_addr)
+{
+	struct otfad_ctr_op op[NUM_CONTEXT];
+	const struct enc_region *rgn;
+	size_t total = 0;
+	int multi = 1;
+	int err;
+	int i;
+
+	for (i = 0; i < job->n_regions; i++) {
+		rgn = &job->region[i];
+		op[i].ctx = rgn->ctx;
+		op[i].in = buf + (rgn->start_address - buf_addr);
+		op[i].out = buf + (rgn->start_address - buf_addr);
+		op[i].size = rgn->end_address - rgn->start_address;
+		op[i].sys_addr = rgn->start_address;
+		total += op[i].size;
+		if (rgn->ks != NULL || rgn->digest != NULL) {
+			multi = 0;
 		}
-#endif
-		/* Finalise the encryption */
-		if(! EVP_EncryptFinal_ex(ctx, enc_ctr + outlen, &outlen)) handle_cipher_err();
+	}
 
-		/* Swap Encrypted Counter as per OTFAD */
-		memcpy(temp, enc_ctr, 16);
-		temp[0] = __builtin_bswap32(temp[0]);
-		temp[1] = __builtin_bswap32(temp[1]);
-		temp[2] = __builtin_bswap32(temp[2]);
-		temp[3] = __builtin_bswap32(temp[3]);
-		SWAP32(temp[0], temp[1]);
-		SWAP32(temp[2], temp[3]);
-		memcpy(swap_enc_ctr, temp, 16);
+	if (multi && total <= OTFAD_THREAD_SLICE_SIZE) {
+		err = otfad_ctr_crypt_multi(op, job->n_regions);
+		if (err) {
+			printf("Error: Encryption failed; %s\n", otfad_strerror(err));
+			ERR_print_errors_fp(stderr);
+			return -1;
+		}
+		return 0;
+	}
 
-		/* XOR Plaintext with Swapped Encripted Counter */
-		for (j = 0; j < 16; ++j) {
-			cipher[i + j] = plaintext[i + j] ^ swap_enc_ctr[j];
+	for (i = 0; i < job->n_regions; i++) {
+		if (ctr_crypt(job, &job->region[i], op[i].in, op[i].out, op[i].size, op[i].sys_addr)) {
+			return -1;
 		}
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Releases the digests of a region
+ *
+ * @Inputs  : rgn - Region
+ */
+static void digest_free(struct enc_region *rgn)
+{
+	if (rgn->digest == NULL) {
+		return;
+	}
+
+	EVP_MD_CTX_free(rgn->digest->sha[0]);
+	EVP_MD_CTX_free(rgn->digest->sha[1]);
+	FREE(rgn->digest);
+}
+
+/*
+ * Description : Starts the digests selected by job->digest for every
+ *               region of a job
+ *
+ * @Inputs  : job - Encryption job
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int digest_begin(struct enc_job *job)
+{
+	struct region_digest *d;
+	int i, j;
 
-#if DEBUG       
-		printf("\nSwapped Encrypted Counter:\t");
-		for (j = 0; j < 16; ++j) {
-			 printf("%02X", swap_enc_ctr[j]);
+	for (i = 0; job->digest && i < job->n_regions; i++) {
+		d = calloc(1, sizeof(*d));
+		job->region[i].digest = d;
+		if (d == NULL) {
+			fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(errno));
+			return -1;
+		}
+		for (j = 0; j < 2; j++) {
+			if (!(job->digest & (DIGEST_PLAIN << j))) {
+				continue;
+			}
+			d->sha[j] = EVP_MD_CTX_new();
+			if (d->sha[j] == NULL || !EVP_DigestInit_ex(d->sha[j], EVP_sha256(), NULL)) {
+				printf("Error: Digest failed\n");
+				ERR_print_errors_fp(stderr);
+				return -1;
+			}
 		}
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Writes the digests of every region of a job to the sidecar
+ *               file <output>.digest (stderr with -o -) and releases them:
+ *
+ *               region 0xC0001000-0xC0031000
+ *               plaintext sha256 <hex>
+ *               plaintext crc32 <hex>
+ *               ciphertext sha256 <hex>
+ *               ciphertext crc32 <hex>
+ *
+ * @Inputs  : job - Encryption job
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int digest_end(struct enc_job *job)
+{
+	static const char *text[2] = { "plaintext", "ciphertext" };
+	struct enc_region *rgn;
+	uint8_t md[EVP_MAX_MD_SIZE];
+	unsigned int md_size;
+	char *fname = NULL;
+	FILE *fp = NULL;
+	unsigned int k;
+	int ret = -1;
+	int i, j;
+
+	if (!job->digest) {
+		return 0;
+	}
 
-		printf("\nPlaintext Data:\t\t\t");
-		for (j = 0; j < 16; ++j) {
-			 printf("%02X", plaintext[i + j]);
+	if (IS_STDIO(job->output_fname)) {
+		fp = stderr;
+	} else {
+		fname = malloc(strlen(job->output_fname) + sizeof(DIGEST_SUFFIX));
+		if (fname == NULL) {
+			fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(errno));
+			goto out;
+		}
+		sprintf(fname, "%s%s", job->output_fname, DIGEST_SUFFIX);
+		fp = fopen(fname, "w");
+		if (fp == NULL) {
+			fprintf(stderr, "Error: Couldn't open file %s; %s\n", fname, strerror(errno));
+			goto out;
 		}
+	}
 
-		printf("\nCipher Output:\t\t\t");
-		for (j = 0; j < 16; ++j) {
-			 printf("%02X", cipher[i + j]);
+	for (i = 0; i < job->n_regions; i++) {
+		rgn = &job->region[i];
+		fprintf(fp, "region 0x%08X-0x%08X\n", rgn->start_address, rgn->end_address);
+		for (j = 0; j < 2; j++) {
+			if (rgn->digest->sha[j] == NULL) {
+				continue;
+			}
+			if (!EVP_DigestFinal_ex(rgn->digest->sha[j], md, &md_size)) {
+				printf("Error: Digest failed\n");
+				ERR_print_errors_fp(stderr);
+				goto out;
+			}
+			fprintf(fp, "%s sha256 ", text[j]);
+			for (k = 0; k < md_size; k++) {
+				fprintf(fp, "%02x", md[k]);
+			}
+			fprintf(fp, "\n%s crc32 %08x\n", text[j], rgn->digest->crc[j]);
 		}
-		printf("\n");
-#endif
 	}
 
-	/* Clean up */
-	EVP_CIPHER_CTX_free(ctx);
+	if (fflush(fp)) {
+		fprintf(stderr, "Error: Couldn't write file %s; %s\n", fname, strerror(errno));
+		goto out;
+	}
+	if (fname != NULL) {
+		printf("Digest file generated: %s\n", fname);
+	}
+
+	ret = 0;
+out:
+	if (fp != stderr) {
+		FCLOSE(fp);
+	}
+	FREE(fname);
+	for (i = 0; i < job->n_regions; i++) {
+		digest_free(&job->region[i]);
+	}
+
+	return ret;
+}
+
+/*
+ * Description : Builds the path of the keystream cache file of an id:
+ *               <dir>/<hex id>.ks
+ *
+ * @Inputs  : dir  - Cache directory
+ *            id   - Keystream id
+ *            path - Path output buffer
+ *            len  - Size of path
+ *
+ * @Outputs : return 0 on success, -1 if the path is too long
+ *
+ */
+static int ks_cache_path(const char *dir, const uint8_t *id, char *path, size_t len)
+{
+	char hex[2 * OTFAD_KEYSTREAM_ID_SIZE + 1];
+	int i;
+
+	for (i = 0; i < OTFAD_KEYSTREAM_ID_SIZE; i++) {
+		sprintf(&hex[2 * i], "%02x", id[i]);
+	}
+	if (snprintf(path, len, "%s/%s.ks", dir, hex) >= len) {
+		printf("Error: Keystream cache path too long\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Generates the keystream cache file of a region: the
+ *               keystream is the CTR output of the zero filled file,
+ *               computed in a mapping of a temporary file which is renamed
+ *               into place once complete, so that a partial file is never
+ *               seen by another run
+ *
+ * @Inputs  : job  - Encryption job
+ *            rgn  - Region, its keystream mapping is set on success
+ *            id   - Keystream id of the region
+ *            path - Cache file path
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int ks_cache_create(const struct enc_job *job, struct enc_region *rgn,
+			   const uint8_t *id, const char *path)
+{
+	struct ks_cache_hdr hdr;
+	char tmp_path[PATH_MAX];
+	uint32_t size = rgn->end_address - rgn->start_address;
+	size_t map_size = KS_CACHE_HDR_SIZE + size;
+	uint8_t *map = MAP_FAILED;
+	int fd = -1;
+	int err;
+	int ret = -1;
+
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >= sizeof(tmp_path)) {
+		printf("Error: Keystream cache path too long\n");
+		return -1;
+	}
+
+	/* Created with mode 0600: the keystream is as sensitive as the key */
+	fd = mkstemp(tmp_path);
+	if (fd < 0) {
+		fprintf(stderr, "Error: Couldn't create file %s; %s\n", tmp_path, strerror(errno));
+		return -1;
+	}
+
+	/* The file reads as zeros up to its size */
+	if (ftruncate(fd, map_size)) {
+		fprintf(stderr, "Error: Couldn't resize file %s; %s\n", tmp_path, strerror(errno));
+		goto out;
+	}
+
+	map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Error: Couldn't map file %s; %s\n", tmp_path, strerror(errno));
+		goto out;
+	}
+
+	err = otfad_ctr_crypt_mt(rgn->ctx, map + KS_CACHE_HDR_SIZE, map + KS_CACHE_HDR_SIZE,
+				 size, rgn->start_address, job->n_threads);
+	if (err) {
+		printf("Error: Keystream generation failed; %s\n", otfad_strerror(err));
+		ERR_print_errors_fp(stderr);
+		goto out;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, KS_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.start_address = rgn->start_address;
+	hdr.size = size;
+	memcpy(hdr.id, id, OTFAD_KEYSTREAM_ID_SIZE);
+	memcpy(map, &hdr, sizeof(hdr));
+
+	if (rename(tmp_path, path)) {
+		fprintf(stderr, "Error: Couldn't rename file %s; %s\n", tmp_path, strerror(errno));
+		goto out;
+	}
+
+	printf("Keystream cache generated: %s\n", path);
+	rgn->ks = map + KS_CACHE_HDR_SIZE;
+	ret = 0;
+out:
+	if (ret) {
+		if (map != MAP_FAILED) {
+			munmap(map, map_size);
+		}
+		unlink(tmp_path);
+	}
+	close(fd);
+
+	return ret;
+}
+
+/*
+ * Description : Maps the cached keystream of a region. The cache file is
+ *               named after the keystream id, a digest of the key, counter
+ *               and address range, so any change of these inputs selects
+ *               another file. A missing file, or one whose header doesn't
+ *               match, is (re)generated.
+ *
+ * @Inputs  : job - Encryption job
+ *            rgn - Region, its keystream mapping is set on success
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int ks_cache_map(const struct enc_job *job, struct enc_region *rgn)
+{
+	uint8_t id[OTFAD_KEYSTREAM_ID_SIZE];
+	char path[PATH_MAX];
+	const struct ks_cache_hdr *hdr;
+	uint32_t size = rgn->end_address - rgn->start_address;
+	size_t map_size = KS_CACHE_HDR_SIZE + size;
+	uint8_t *map = MAP_FAILED;
+	struct stat st;
+	int fd;
+	int err;
+
+	err = otfad_ctr_keystream_id(rgn->ctx, rgn->start_address, size, id);
+	if (err) {
+		printf("Error: Keystream id; %s\n", otfad_strerror(err));
+		return -1;
+	}
+	if (ks_cache_path(job->ks_cache_dir, id, path, sizeof(path))) {
+		return -1;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		if (!fstat(fd, &st) && st.st_size == map_size) {
+			map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+		}
+		close(fd);
+	}
+
+	if (map != MAP_FAILED) {
+		hdr = (const struct ks_cache_hdr *)map;
+		if (!memcmp(hdr->magic, KS_CACHE_MAGIC, sizeof(hdr->magic)) &&
+		    hdr->start_address == rgn->start_address && hdr->size == size &&
+		    !memcmp(hdr->id, id, OTFAD_KEYSTREAM_ID_SIZE)) {
+			madvise(map, map_size, MADV_SEQUENTIAL);
+			rgn->ks = map + KS_CACHE_HDR_SIZE;
+			return 0;
+		}
+		munmap(map, map_size);
+	}
+
+	return ks_cache_create(job, rgn, id, path);
+}
 
-	return &cipher[0];
+/*
+ * Description : Unmaps the cached keystream of a region, if any
+ *
+ * @Inputs  : rgn - Region
+ */
+static void ks_cache_unmap(struct enc_region *rgn)
+{
+	if (rgn->ks != NULL) {
+		munmap((void *)(rgn->ks - KS_CACHE_HDR_SIZE),
+		       KS_CACHE_HDR_SIZE + rgn->end_address - rgn->start_address);
+		rgn->ks = NULL;
+	}
 }
 
 /*
@@ -136,7 +498,7 @@ unsigned char *do_aes_ctr_enc(uint8_t *plaintext, int size, unsigned char *key,
  * @Outputs : return File size
  *
  */
-static int get_file_size(FILE **fp, char *input_file)
+static int get_file_size(FILE **fp, const char *input_file)
 {
 	int ret = 0;
 
@@ -170,7 +532,7 @@ static int get_file_size(FILE **fp, char *input_file)
  * @output : return buffer pointer
  *
  */
-static unsigned char *alloc_buffer(FILE *fp, char *input_file, int check_size)
+static unsigned char *alloc_buffer(FILE *fp, const char *input_file, int check_size)
 {
 	int file_size = 0;
 	unsigned char *buff = NULL;
@@ -185,10 +547,9 @@ static unsigned char *alloc_buffer(FILE *fp, char *input_file, int check_size)
 		return NULL;
 	}
 
-	/* Allocate memory to the buffer */
-	buff = malloc(file_size);
-	if (buff == NULL || buff == 0) {
-		fprintf(stderr, "Error allocating memory; %s\n", strerror(errno));
+	/* Allocate memory to the buffer, cleared when freed */
+	if (otfad_buf_alloc(file_size, OTFAD_BUF_SECRET, (void **)&buff)) {
+		fprintf(stderr, "Error allocating memory; %s\n", strerror(ENOMEM));
 		return NULL;
 	}
 
@@ -196,6 +557,7 @@ static unsigned char *alloc_buffer(FILE *fp, char *input_file, int check_size)
 	result = fread(buff,1,file_size,fp);
 	if (result != file_size) {
 		fprintf(stderr, "File read error; %s\n", strerror(errno));
+		BUF_FREE(buff);
 		return NULL;
 	}
 	FCLOSE(fp);
@@ -203,6 +565,52 @@ static unsigned char *alloc_buffer(FILE *fp, char *input_file, int check_size)
 	return buff;
 }
 
+/*
+ * Description : Makes stdout the image output of -o -: the image goes to a
+ *               duplicate of stdout and stdout is redirected to stderr, so
+ *               messages don't end up in the image
+ */
+static void redirect_stdout(void)
+{
+	fflush(stdout);
+	data_out_fd = dup(STDOUT_FILENO);
+	if (data_out_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+		fprintf(stderr, "Error: Couldn't redirect stdout; %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Description : Opens an image file, or stdin/stdout for STDIO_FNAME
+ *
+ * @Inputs  : fname - File name
+ *            mode  - fopen mode, "r..." or "w..."
+ *
+ * @Outputs : return the file pointer, NULL on failure
+ *
+ */
+static FILE *open_image(const char *fname, const char *mode)
+{
+	FILE *fp;
+	int fd;
+
+	if (!IS_STDIO(fname)) {
+		fp = fopen(fname, mode);
+	} else {
+		/* A duplicate, so the file pointer can be closed like any other */
+		fd = dup((mode[0] == 'r') ? STDIN_FILENO : data_out_fd);
+		fp = (fd < 0) ? NULL : fdopen(fd, mode);
+		if (fp == NULL && fd >= 0) {
+			close(fd);
+		}
+	}
+	if (fp == NULL) {
+		fprintf(stderr, "Error: Couldn't open file %s; %s\n", fname, strerror(errno));
+	}
+
+	return fp;
+}
+
 /*
  * Description : Prints the usage information for running encrypt_image
  *
@@ -226,6 +634,26 @@ void print_usage(void) {
 	} while (long_opt[i].name != NULL && opt_desc[i] != NULL);
 }
 
+/*
+ * Description : Runs the libotfad self-test: each AES implementation usable
+ *               on this host (bitsliced, AES-NI, VAES) against OpenSSL
+ *
+ * @Outputs : return EXIT_SUCCESS if all match, EXIT_FAILURE otherwise
+ */
+static int self_test(void)
+{
+	int err = otfad_selftest();
+
+	if (err) {
+		printf("Error: %s\n", otfad_strerror(err));
+		ERR_print_errors_fp(stderr);
+		return EXIT_FAILURE;
+	}
+	printf("Self-test passed, AES backend: %s\n", otfad_backend_name());
+
+	return EXIT_SUCCESS;
+}
+
 /*
  * Description : Handle each command line option
  *
@@ -236,6 +664,11 @@ void handle_cl_opt(int argc, char **argv)
 	int next_opt = 0;
 	int n_long_opt = 1; // Includes the command itself
 	int mandatory_opt = 0;
+	int address_opt = 0;
+	int region_opt = 0;
+	int batch_opt = 0;
+	int erased_opt = 0;
+	int patch_opt = 0;
 	int i = 0;
 
 	do {
@@ -246,6 +679,9 @@ void handle_cl_opt(int argc, char **argv)
 		i++;
 	} while (long_opt[i + 1].name != NULL);
 
+	/* -r can be given once per context, -E once per erased range */
+	n_long_opt += 2 * (NUM_CONTEXT - 1) + 2 * (MAX_ERASED_RANGES - 1);
+
 	/* Start from the first command-line option */
 	optind = 0;
 	/* Handle command line options*/
@@ -254,16 +690,54 @@ void handle_cl_opt(int argc, char **argv)
 		switch (next_opt)
 		{
 		case 'i':
+			mandatory_opt += 1;
+			break;
 		case 'o':
+			mandatory_opt += 1;
+			if (IS_STDIO(optarg)) {
+				redirect_stdout();
+			}
+			break;
 		case 's':
 		case 'e':
-			mandatory_opt += 1;
+			address_opt += 1;
+			break;
+		case 'r':
+			region_opt += 1;
+			if (region_opt > NUM_CONTEXT) {
+				printf("Error: At most %d regions can be given\n", NUM_CONTEXT);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'b':
+			batch_opt += 1;
+			break;
+		case 'P':
+			patch_opt += 1;
+			break;
+		case 'E':
+			erased_opt += 1;
+			if (erased_opt > MAX_ERASED_RANGES) {
+				printf("Error: At most %d erased ranges can be given\n", MAX_ERASED_RANGES);
+				exit(EXIT_FAILURE);
+			}
 			break;
 		/* Display usage */
 		case 'h':
 			print_usage();
 			exit(EXIT_SUCCESS);
 			break;
+		/* AES backend, selected before any context is created */
+		case 'B':
+			if (otfad_backend_select(optarg)) {
+				printf("Error: Unknown or unsupported AES backend %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		/* Check the AES implementations */
+		case 'T':
+			exit(self_test());
+			break;
 		case '?':
 			/* Input option with no parameter */
 			if ((optopt == 'i' || \
@@ -279,8 +753,13 @@ void handle_cl_opt(int argc, char **argv)
 			break;
 		/* At the end reach here and check if mandatory options are present */
 		default:
-			if (mandatory_opt != 4 && next_opt == -1) {
-				printf("Error: -i, -o, -s and -e options are required\n");
+			if (next_opt == -1 && patch_opt && (mandatory_opt != 1 || address_opt != 2)) {
+				printf("Error: -P requires -i, -s and -e options and no -o option\n");
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+			if (batch_opt == 0 && patch_opt == 0 && (mandatory_opt != 2 || (address_opt != 2 && region_opt == 0)) && next_opt == -1) {
+				printf("Error: -i, -o and either -s and -e or -r options, or -b option, are required\n");
 				print_usage();
 				exit(EXIT_FAILURE);
 			}
@@ -297,43 +776,1939 @@ void handle_cl_opt(int argc, char **argv)
 
 }
 
-int main (int argc, char **argv)
+/*
+ * Description : Copies the image header (first IMG_HDR_SIZE bytes of the
+ *               input image) into the header file
+ *
+ * @Inputs  : fp_in       - Input image file pointer, left at an unspecified offset
+ *            hdr_fname   - Header file name
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int write_image_header(FILE *fp_in, const char *hdr_fname)
 {
-	FILE *fp_in = NULL;
-	FILE *fp_out = NULL;
 	FILE *fp_hdr = NULL;
-
-	uint8_t *image_buf = NULL;
-	uint8_t *image_hdr_buf = NULL;
-	uint8_t *key_buf = NULL;
-	uint8_t *ctr_buf = NULL;
+	uint8_t image_hdr_buf[IMG_HDR_SIZE];
 	size_t result;
-	const unsigned char *enc_image = NULL;
 
-	int image_size = 0;
-	int enc_image_size = 0;
-	unsigned char *image_enc_key = NULL;
-	unsigned char *counter = NULL;
-	uint8_t ctr_xor[4];
-	uint32_t system_address = 0;
-	uint32_t start_address = 0;
-	uint32_t end_address = 0;
-	uint32_t image_start_offset = 0;
+	rewind(fp_in);
 
-	int next_opt = 0;
-	char *output_fname = NULL;
+	/* Copy the file into the buffer - Image header */
+	result = fread(image_hdr_buf, 1, IMG_HDR_SIZE, fp_in);
+	if (result != IMG_HDR_SIZE) {
+		fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
+		return -1;
+	}
+
+	/* Write the image header to the header file */
+	fp_hdr = fopen(hdr_fname, "wb");
+	if (fp_hdr == NULL) {
+		fprintf(stderr, "Error: Couldn't open file %s; %s\n", hdr_fname, strerror(errno));
+		return -1;
+	}
+
+	if(IMG_HDR_SIZE != fwrite((const char *)image_hdr_buf, 1, IMG_HDR_SIZE, fp_hdr)) {
+		printf("Error: Image header - File write failed\n");
+		FCLOSE(fp_hdr);
+		return -1;
+	}
+	FCLOSE(fp_hdr);
+
+	return 0;
+}
+
+/*
+ * Description : Tells whether a system address is in an erased range and
+ *               how far the answer holds
+ *
+ * @Inputs  : job  - Encryption job
+ *            addr - System address
+ *            len  - Length from addr, reduced to the end of the erased
+ *                   range or to the start of the next one
+ *
+ * @Outputs : return 1 if addr is erased, 0 otherwise
+ *
+ */
+static int erased_run(const struct enc_job *job, uint32_t addr, uint32_t *len)
+{
+	const struct addr_range *e;
 	int i;
 
-	/* Handle command line options */
-	handle_cl_opt(argc, argv);
+	for (i = 0; i < job->n_erased; i++) {
+		e = &job->erased[i];
+		if (addr >= e->start && addr < e->end) {
+			if (e->end - addr < *len) {
+				*len = e->end - addr;
+			}
+			return 1;
+		}
+		if (e->start > addr && e->start - addr < *len) {
+			*len = e->start - addr;
+		}
+	}
 
-	/* Start from the first command-line option */
-	optind = 0;
+	return 0;
+}
+
+/*
+ * Description : Sets the erased parts of a plaintext buffer to ERASED_BYTE
+ *
+ * @Inputs  : job      - Encryption job
+ *            buf      - Plaintext
+ *            len      - Number of bytes
+ *            sys_addr - System address of buf
+ */
+static void apply_erased(const struct enc_job *job, uint8_t *buf, uint32_t len, uint32_t sys_addr)
+{
+	uint32_t pos = 0;
+	uint32_t n;
+
+	while (job->n_erased && pos < len) {
+		n = len - pos;
+		if (erased_run(job, sys_addr + pos, &n)) {
+			memset(buf + pos, ERASED_BYTE, n);
+		}
+		pos += n;
+	}
+}
+
+/*
+ * Description : Reads a range of a file without reading its holes: data
+ *               extents found with SEEK_DATA/SEEK_HOLE are read, holes are
+ *               zero filled. File systems without SEEK_DATA are read as
+ *               one extent.
+ *
+ * @Inputs  : fd  - File descriptor
+ *            buf - Output buffer
+ *            len - Number of bytes
+ *            off - File offset
+ *
+ * @Outputs : return 0 on success, -1 on failure (e.g. past end of file)
+ *
+ */
+static int pread_sparse(int fd, uint8_t *buf, size_t len, off_t off)
+{
+	off_t end = off + len;
+	off_t data;
+	off_t hole;
+	ssize_t n;
+	struct stat st;
+
+	if (fstat(fd, &st)) {
+		fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
+		return -1;
+	}
+	if (st.st_size < end) {
+		fprintf(stderr, "Error: File read error; end of file\n");
+		return -1;
+	}
+
+	while (off < end) {
+		data = lseek(fd, off, SEEK_DATA);
+		if (data < 0) {
+			/* ENXIO: hole up to end of file */
+			data = (errno == ENXIO) ? end : off;
+		}
+		if (data > off) {
+			n = ((data < end) ? data : end) - off;
+			memset(buf, 0, n);
+			buf += n;
+			off += n;
+			continue;
+		}
+
+		hole = lseek(fd, off, SEEK_HOLE);
+		if (hole < 0 || hole > end) {
+			hole = end;
+		}
+		while (off < hole) {
+			n = pread(fd, buf, hole - off, off);
+			if (n <= 0) {
+				fprintf(stderr, "Error: File read error; %s\n", n ? strerror(errno) : "end of file");
+				return -1;
+			}
+			buf += n;
+			off += n;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Reads the plaintext of a part of a region from the current
+ *               position of fp_in, which is moved past it. Erased ranges
+ *               are set to ERASED_BYTE and file holes to zero without being
+ *               read. Pipes are read through.
+ *
+ * @Inputs  : job      - Encryption job
+ *            fp_in    - Input image
+ *            buf      - Plaintext output
+ *            len      - Number of bytes
+ *            sys_addr - System address of the first byte
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int read_plaintext(const struct enc_job *job, FILE *fp_in, uint8_t *buf,
+			  uint32_t len, uint32_t sys_addr)
+{
+	off_t off = ftell(fp_in);
+	uint32_t pos = 0;
+	uint32_t n;
+
+	if (off < 0 || lseek(fileno(fp_in), 0, SEEK_CUR) < 0) {
+		/* Not seekable: read everything */
+		if (len != fread(buf, 1, len, fp_in)) {
+			fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
+			return -1;
+		}
+		apply_erased(job, buf, len, sys_addr);
+		return 0;
+	}
+
+	while (pos < len) {
+		n = len - pos;
+		if (erased_run(job, sys_addr + pos, &n)) {
+			memset(buf + pos, ERASED_BYTE, n);
+		} else if (pread_sparse(fileno(fp_in), buf + pos, n, off + pos)) {
+			return -1;
+		}
+		pos += n;
+	}
+
+	if (fseek(fp_in, off + len, SEEK_SET)) {
+		fprintf(stderr, "Error: Couldn't seek; %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Encrypts the region with the whole region held in memory:
+ *               one read, one (possibly multi-threaded) encryption pass and
+ *               one write. CTR allows the encryption to be done in place, so
+ *               a single region-sized buffer is used.
+ *
+ * @Inputs  : job    - Encryption job
+ *            rgn    - Region to encrypt
+ *            fp_in  - Input image, positioned at the start of the region
+ *            fp_out - Output file
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int encrypt_buffered(const struct enc_job *job, const struct enc_region *rgn,
+			    FILE *fp_in, FILE *fp_out)
+{
+	uint8_t *image_buf = NULL;
+	int enc_image_size = rgn->end_address - rgn->start_address;
+	int ret = -1;
+
+	/* Allocate memory to the buffer - Image to be encrypted in place */
+	if (otfad_buf_alloc(enc_image_size, OTFAD_BUF_HUGE, (void **)&image_buf)) {
+		fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(ENOMEM));
+		goto out;
+	}
+
+	/* Copy the file into the buffer - Image to be encrypted */
+	if (read_plaintext(job, fp_in, image_buf, enc_image_size, rgn->start_address)) {
+		goto out;
+	}
+
+	/* Perform AES-128-CTR encryption */
+	if (ctr_crypt(job, rgn, image_buf, image_buf, enc_image_size, rgn->start_address)) {
+		goto out;
+	}
+
+	/* Write Encrypted image to the output file */
+	if(enc_image_size != fwrite((const char *)image_buf, 1, enc_image_size, fp_out)) {
+		printf("Error: Encrypted Image - File write failed\n");
+		goto out;
+	}
+
+	ret = 0;
+out:
+	BUF_FREE(image_buf);
+
+	return ret;
+}
+
+/*
+ * Description : Encrypts the region in fixed-size chunks: each chunk is read,
+ *               encrypted and written before the next one is read, so peak
+ *               memory does not depend on the region size. The system
+ *               address is carried across chunk boundaries.
+ *
+ * @Inputs  : job    - Encryption job
+ *            rgn    - Region to encrypt
+ *            fp_in  - Input image, positioned at the start of the region
+ *            fp_out - Output file
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int encrypt_stream(const struct enc_job *job, const struct enc_region *rgn,
+			  FILE *fp_in, FILE *fp_out)
+{
+	uint8_t *chunk_buf = NULL;
+	uint32_t sys_addr = rgn->start_address;
+	uint32_t remaining = rgn->end_address - rgn->start_address;
+	int chunk_size = STREAM_CHUNK_SIZE;
+	int len;
+	int ret = -1;
+
+	/* Give every thread at least one slice per chunk */
+	if (job->n_threads * OTFAD_THREAD_SLICE_SIZE > chunk_size) {
+		chunk_size = job->n_threads * OTFAD_THREAD_SLICE_SIZE;
+	}
+
+	if (otfad_buf_alloc(chunk_size, OTFAD_BUF_HUGE, (void **)&chunk_buf)) {
+		fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(ENOMEM));
+		goto out;
+	}
+
+	while (remaining) {
+		len = (remaining > chunk_size) ? chunk_size : remaining;
+
+		if (read_plaintext(job, fp_in, chunk_buf, len, sys_addr)) {
+			goto out;
+		}
+
+		/* CTR encryption in place: the keystream only depends on the address */
+		if (ctr_crypt(job, rgn, chunk_buf, chunk_buf, len, sys_addr)) {
+			goto out;
+		}
+
+		if(len != fwrite((const char *)chunk_buf, 1, len, fp_out)) {
+			printf("Error: Encrypted Image - File write failed\n");
+			goto out;
+		}
+
+		sys_addr += len;
+		remaining -= len;
+	}
+
+	ret = 0;
+out:
+	BUF_FREE(chunk_buf);
+
+	return ret;
+}
+
+/*
+ * Description : Opens a file for the io_uring backend, with O_DIRECT when
+ *               the I/O starts at an aligned offset and the file system
+ *               supports it
+ *
+ * @Inputs  : fname  - File name
+ *            flags  - open flags
+ *            off    - File offset of the first I/O
+ *            direct - Set to 1 if the file was opened with O_DIRECT
+ *
+ * @Outputs : return the file descriptor, -1 on failure
+ *
+ */
+static int open_direct(const char *fname, int flags, off_t off, int *direct)
+{
+	int fd;
+
+	*direct = 0;
+	if (off % DIO_ALIGN == 0) {
+		fd = open(fname, flags | O_DIRECT);
+		if (fd >= 0) {
+			*direct = 1;
+			return fd;
+		}
+	}
+
+	return open(fname, flags);
+}
+
+/*
+ * Description : Encrypts the region with asynchronous I/O through io_uring:
+ *               URING_QUEUE_DEPTH aligned chunk buffers, registered with
+ *               the kernel, are kept in flight. Chunks are encrypted in
+ *               order as their reads complete and written back at their
+ *               offset while the other chunks are read, so the disk and the CPU work at
+ *               the same time. Files are opened with O_DIRECT when offsets
+ *               allow it; the unaligned tail of the region, if any, is
+ *               written through fp_out. Falls back to encrypt_stream when
+ *               io_uring is not available.
+ *
+ * @Inputs  : job    - Encryption job
+ *            rgn    - Region to encrypt
+ *            fp_in  - Input image, positioned at the start of the region
+ *            fp_out - Output file, positioned where the region goes
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int encrypt_uring(const struct enc_job *job, const struct enc_region *rgn,
+			 FILE *fp_in, FILE *fp_out)
+{
+	struct uring ring;
+	struct uring_chunk chunk[URING_QUEUE_DEPTH];
+	struct uring_chunk *c;
+	struct iovec iov[URING_QUEUE_DEPTH];
+	uint8_t *bufs = NULL;
+	uint32_t size = rgn->end_address - rgn->start_address;
+	uint32_t chunk_size = STREAM_CHUNK_SIZE;
+	uint32_t n_chunks;
+	uint32_t next = 0;
+	uint32_t done = 0;
+	uint32_t enc_pos = 0;
+	uint32_t rlen;
+	const uint8_t *tail_buf = NULL;
+	uint32_t tail_len = 0;
+	off_t tail_off = 0;
+	off_t in_off;
+	off_t out_off;
+	uint64_t user_data;
+	int in_direct;
+	int out_direct;
+	int fd_in = -1;
+	int fd_out = -1;
+	int inflight = 0;
+	int res;
+	int err;
+	int ret = -1;
+	int i;
+
+	err = uring_init(&ring, URING_QUEUE_DEPTH);
+	if (err) {
+		fprintf(stderr, "Warning: io_uring not available (%s), using stream I/O\n", strerror(-err));
+		return encrypt_stream(job, rgn, fp_in, fp_out);
+	}
+
+	/* Give every thread at least one slice per chunk */
+	if (job->n_threads * OTFAD_THREAD_SLICE_SIZE > chunk_size) {
+		chunk_size = job->n_threads * OTFAD_THREAD_SLICE_SIZE;
+	}
+	n_chunks = (size + chunk_size - 1) / chunk_size;
+
+	/* The ring writes behind stdio: flush what fp_out holds first */
+	in_off = ftell(fp_in);
+	if (in_off < 0 || fflush(fp_out) || (out_off = ftell(fp_out)) < 0) {
+		fprintf(stderr, "Error: Couldn't get file offset; %s\n", strerror(errno));
+		goto out;
+	}
+
+	fd_in = open_direct(job->input_fname, O_RDONLY, in_off, &in_direct);
+	if (fd_in < 0) {
+		fprintf(stderr, "Error: Couldn't open file %s; %s\n", job->input_fname, strerror(errno));
+		goto out;
+	}
+	fd_out = open_direct(job->output_fname, O_WRONLY, out_off, &out_direct);
+	if (fd_out < 0) {
+		fprintf(stderr, "Error: Couldn't open file %s; %s\n", job->output_fname, strerror(errno));
+		goto out;
+	}
+
+	/* Mapped, hence page aligned for O_DIRECT: chunks are a megabyte or more */
+	if (otfad_buf_alloc((size_t)URING_QUEUE_DEPTH * chunk_size, OTFAD_BUF_HUGE, (void **)&bufs)) {
+		fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(ENOMEM));
+		bufs = NULL;
+		goto out;
+	}
+	for (i = 0; i < URING_QUEUE_DEPTH; i++) {
+		chunk[i].buf = bufs + (size_t)i * chunk_size;
+		chunk[i].state = CHUNK_FREE;
+		iov[i].iov_base = chunk[i].buf;
+		iov[i].iov_len = chunk_size;
+	}
+	/* Not fatal: requests then pin the buffers one by one */
+	uring_register_buffers(&ring, iov, URING_QUEUE_DEPTH);
+
+#if DEBUG
+	printf("io_uring: %u chunks of %u bytes, input %s, output %s, %s buffers\n",
+	       n_chunks, chunk_size, in_direct ? "O_DIRECT" : "buffered",
+	       out_direct ? "O_DIRECT" : "buffered", ring.fixed_buffers ? "registered" : "plain");
+#endif
+
+	while (done < n_chunks) {
+		/* Keep every free buffer reading */
+		for (i = 0; i < URING_QUEUE_DEPTH && next < n_chunks; i++) {
+			c = &chunk[i];
+			if (c->state != CHUNK_FREE) {
+				continue;
+			}
+			c->pos = next * chunk_size;
+			c->len = (size - c->pos > chunk_size) ? chunk_size : size - c->pos;
+			/* O_DIRECT reads whole blocks, the extra bytes are ignored */
+			rlen = in_direct ? (c->len + DIO_ALIGN - 1) & ~(DIO_ALIGN - 1) : c->len;
+			if (uring_queue_rw(&ring, 0, fd_in, c->buf, rlen, in_off + c->pos, i, i * 2)) {
+				break;
+			}
+			c->state = CHUNK_READING;
+			inflight++;
+			next++;
+		}
+
+		err = uring_submit(&ring, 1);
+		if (err) {
+			fprintf(stderr, "Error: io_uring submission failed; %s\n", strerror(-err));
+			goto drain;
+		}
+
+		while (uring_peek_cqe(&ring, &user_data, &res)) {
+			inflight--;
+			c = &chunk[user_data / 2];
+
+			if (user_data & 1) {
+				if (res != c->wlen) {
+					printf("Error: Encrypted Image - File write failed; %s\n",
+					       res < 0 ? strerror(-res) : "short write");
+					goto drain;
+				}
+				c->state = CHUNK_FREE;
+				done++;
+				continue;
+			}
+
+			if (res < (int)c->len) {
+				fprintf(stderr, "Error: File read error; %s\n",
+					res < 0 ? strerror(-res) : "end of file");
+				goto drain;
+			}
+
+			c->state = CHUNK_READ;
+		}
+
+		/* Encrypt in address order, the digests depend on it */
+		for (i = 0; i < URING_QUEUE_DEPTH; i++) {
+			c = &chunk[i];
+			if (c->state != CHUNK_READ || c->pos != enc_pos) {
+				continue;
+			}
+
+			apply_erased(job, c->buf, c->len, rgn->start_address + c->pos);
+
+			/* CTR encryption in place: the keystream only depends on the address */
+			if (ctr_crypt(job, rgn, c->buf, c->buf, c->len, rgn->start_address + c->pos)) {
+				goto drain;
+			}
+			enc_pos += c->len;
+			/* The next chunk can be in any buffer */
+			i = -1;
+
+			/* Only the last chunk can end off a block boundary */
+			c->wlen = c->len;
+			if (out_direct && (c->len % DIO_ALIGN)) {
+				c->wlen = c->len & ~(DIO_ALIGN - 1);
+				tail_buf = c->buf + c->wlen;
+				tail_len = c->len - c->wlen;
+				tail_off = out_off + c->pos + c->wlen;
+			}
+			if (c->wlen == 0) {
+				c->state = CHUNK_FREE;
+				done++;
+				continue;
+			}
+
+			if (uring_queue_rw(&ring, 1, fd_out, c->buf, c->wlen, out_off + c->pos, c - chunk,
+					   (c - chunk) * 2 + 1)) {
+				printf("Error: io_uring submission queue full\n");
+				goto drain;
+			}
+			c->state = CHUNK_WRITING;
+			inflight++;
+
+			/* Start the write before encrypting the next chunk */
+			err = uring_submit(&ring, 0);
+			if (err) {
+				fprintf(stderr, "Error: io_uring submission failed; %s\n", strerror(-err));
+				goto drain;
+			}
+		}
+	}
+
+	if (tail_len && pwrite(fileno(fp_out), tail_buf, tail_len, tail_off) != tail_len) {
+		printf("Error: Encrypted Image - File write failed\n");
+		goto out;
+	}
+
+	/* Leave both files positioned after the region, like the other modes */
+	if (fseek(fp_in, in_off + size, SEEK_SET) || fseek(fp_out, out_off + size, SEEK_SET)) {
+		fprintf(stderr, "Error: Couldn't seek; %s\n", strerror(errno));
+		goto out;
+	}
+
+	ret = 0;
+	goto out;
+drain:
+	/* The buffers can only be released once the kernel is done with them */
+	while (inflight > 0 && uring_submit(&ring, 1) == 0) {
+		while (uring_peek_cqe(&ring, &user_data, &res)) {
+			inflight--;
+		}
+	}
+out:
+	uring_exit(&ring);
+	if (fd_in >= 0) {
+		close(fd_in);
+	}
+	if (fd_out >= 0) {
+		close(fd_out);
+	}
+	BUF_FREE(bufs);
+
+	return ret;
+}
+
+/*
+ * Description : Pushes a chunk to a SPSC ring, called by the producer only
+ *
+ * @Inputs  : ring - Ring
+ *            c    - Chunk
+ */
+static void ring_push(struct spsc_ring *ring, struct pipe_chunk *c)
+{
+	unsigned int tail = ring->tail;
+
+	ring->slot[tail % PIPELINE_DEPTH] = c;
+	/* Publish the slot before the new tail */
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Description : Pops a chunk from a SPSC ring, called by the consumer only.
+ *               Waits for the producer, yielding the CPU, unless the
+ *               pipeline is aborted.
+ *
+ * @Inputs  : ring  - Ring
+ *            abort - Abort flag of the pipeline
+ *
+ * @Outputs : return the chunk, NULL if the pipeline was aborted
+ *
+ */
+static struct pipe_chunk *ring_pop(struct spsc_ring *ring, int *abort)
+{
+	unsigned int head = ring->head;
+	struct pipe_chunk *c;
+
+	while (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+		if (__atomic_load_n(abort, __ATOMIC_RELAXED)) {
+			return NULL;
+		}
+		sched_yield();
+	}
+
+	c = ring->slot[head % PIPELINE_DEPTH];
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	return c;
+}
+
+/*
+ * Description : Reader stage: fills empty chunks from the input image, in
+ *               order, and tags them with their system address
+ *
+ * @Inputs  : arg - Pipeline
+ */
+static void *pipeline_reader(void *arg)
+{
+	struct pipeline *pl = arg;
+	uint32_t size = pl->rgn->end_address - pl->rgn->start_address;
+	uint32_t pos;
+	struct pipe_chunk *c;
+	uint32_t k;
+
+	for (k = 0; k < pl->n_chunks; k++) {
+		c = ring_pop(&pl->free_ring, &pl->abort);
+		if (c == NULL) {
+			break;
+		}
+
+		pos = k * pl->chunk_size;
+		c->sys_addr = pl->rgn->start_address + pos;
+		c->len = (size - pos > pl->chunk_size) ? pl->chunk_size : size - pos;
+		if (read_plaintext(pl->job, pl->fp_in, c->buf, c->len, c->sys_addr)) {
+			__atomic_store_n(&pl->abort, 1, __ATOMIC_RELAXED);
+			break;
+		}
+
+		ring_push(&pl->read_ring, c);
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Writer stage: writes encrypted chunks to the output file,
+ *               in order, and hands them back to the reader
+ *
+ * @Inputs  : arg - Pipeline
+ */
+static void *pipeline_writer(void *arg)
+{
+	struct pipeline *pl = arg;
+	struct pipe_chunk *c;
+	uint32_t k;
+
+	for (k = 0; k < pl->n_chunks; k++) {
+		c = ring_pop(&pl->enc_ring, &pl->abort);
+		if (c == NULL) {
+			break;
+		}
+
+		if (c->len != fwrite(c->buf, 1, c->len, pl->fp_out)) {
+			printf("Error: Encrypted Image - File write failed\n");
+			__atomic_store_n(&pl->abort, 1, __ATOMIC_RELAXED);
+			break;
+		}
+
+		ring_push(&pl->free_ring, c);
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Encrypts the region with a three-stage pipeline: a reader
+ *               thread, the calling thread encrypting (on -t threads) and a
+ *               writer thread pass PIPELINE_DEPTH chunks around through
+ *               lock-free SPSC rings. While a chunk is encrypted the next
+ *               one is read and the previous one written, so the region
+ *               takes about the longest of I/O and encryption time instead
+ *               of their sum.
+ *
+ * @Inputs  : job    - Encryption job
+ *            rgn    - Region to encrypt
+ *            fp_in  - Input image, positioned at the start of the region
+ *            fp_out - Output file
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int encrypt_pipeline(const struct enc_job *job, const struct enc_region *rgn,
+			    FILE *fp_in, FILE *fp_out)
+{
+	struct pipeline *pl = NULL;
+	struct pipe_chunk chunk[PIPELINE_DEPTH];
+	struct pipe_chunk *c;
+	uint8_t *bufs = NULL;
+	uint32_t size = rgn->end_address - rgn->start_address;
+	pthread_t reader;
+	pthread_t writer;
+	int reader_started = 0;
+	int writer_started = 0;
+	uint32_t k;
+	int ret = -1;
+	int i;
+
+	/* Heads and tails on their own cache lines */
+	if (posix_memalign((void **)&pl, CACHE_LINE_SIZE, sizeof(*pl))) {
+		fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(ENOMEM));
+		return -1;
+	}
+	memset(pl, 0, sizeof(*pl));
+	pl->job = job;
+	pl->rgn = rgn;
+	pl->fp_in = fp_in;
+	pl->fp_out = fp_out;
+
+	/* Give every thread at least one slice per chunk */
+	pl->chunk_size = STREAM_CHUNK_SIZE;
+	if (job->n_threads * OTFAD_THREAD_SLICE_SIZE > pl->chunk_size) {
+		pl->chunk_size = job->n_threads * OTFAD_THREAD_SLICE_SIZE;
+	}
+	pl->n_chunks = (size + pl->chunk_size - 1) / pl->chunk_size;
+
+	if (otfad_buf_alloc((size_t)PIPELINE_DEPTH * pl->chunk_size, OTFAD_BUF_HUGE, (void **)&bufs)) {
+		fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(ENOMEM));
+		bufs = NULL;
+		goto out;
+	}
+	for (i = 0; i < PIPELINE_DEPTH; i++) {
+		chunk[i].buf = bufs + (size_t)i * pl->chunk_size;
+		ring_push(&pl->free_ring, &chunk[i]);
+	}
+
+	if (pthread_create(&reader, NULL, pipeline_reader, pl)) {
+		printf("Error: Couldn't create reader thread\n");
+		goto out;
+	}
+	reader_started = 1;
+	if (pthread_create(&writer, NULL, pipeline_writer, pl)) {
+		printf("Error: Couldn't create writer thread\n");
+		pl->abort = 1;
+		goto out;
+	}
+	writer_started = 1;
+
+	/* Encryptor stage */
+	for (k = 0; k < pl->n_chunks; k++) {
+		c = ring_pop(&pl->read_ring, &pl->abort);
+		if (c == NULL) {
+			break;
+		}
+
+		/* CTR encryption in place: the keystream only depends on the address */
+		if (ctr_crypt(job, rgn, c->buf, c->buf, c->len, c->sys_addr)) {
+			__atomic_store_n(&pl->abort, 1, __ATOMIC_RELAXED);
+			break;
+		}
+
+		ring_push(&pl->enc_ring, c);
+	}
+
+out:
+	if (reader_started) {
+		pthread_join(reader, NULL);
+	}
+	if (writer_started) {
+		pthread_join(writer, NULL);
+	}
+	if (reader_started && writer_started && !pl->abort) {
+		ret = 0;
+	}
+	BUF_FREE(bufs);
+	free(pl);
+
+	return ret;
+}
+
+/*
+ * Description : Encrypts a region read and written sequentially from the
+ *               current file positions, with the I/O mode of the job.
+ *               Modes working on whole files fall back to stream.
+ *
+ * @Inputs  : job    - Encryption job
+ *            rgn    - Region to encrypt
+ *            fp_in  - Input image, positioned at the start of the region
+ *            fp_out - Output file, positioned where the region goes
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int encrypt_sequential(const struct enc_job *job, const struct enc_region *rgn,
+			      FILE *fp_in, FILE *fp_out)
+{
+	switch (job->io_mode) {
+	case IO_MODE_URING:
+		return encrypt_uring(job, rgn, fp_in, fp_out);
+	case IO_MODE_PIPELINE:
+		return encrypt_pipeline(job, rgn, fp_in, fp_out);
+	default:
+		return encrypt_stream(job, rgn, fp_in, fp_out);
+	}
+}
+
+/*
+ * Description : Copies len bytes from the current position of fp_in to fp_out
+ *
+ * @Inputs  : fp_in  - Input file pointer
+ *            fp_out - Output file pointer
+ *            len    - Number of bytes to copy
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int copy_through(FILE *fp_in, FILE *fp_out, size_t len)
+{
+	uint8_t *buf = NULL;
+	size_t n;
+	int ret = -1;
+
+	if (len == 0) {
+		return 0;
+	}
+
+	if (otfad_buf_alloc(STREAM_CHUNK_SIZE, OTFAD_BUF_HUGE, (void **)&buf)) {
+		fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(ENOMEM));
+		return -1;
+	}
+
+	while (len) {
+		n = (len > STREAM_CHUNK_SIZE) ? STREAM_CHUNK_SIZE : len;
+		if (n != fread(buf, 1, n, fp_in)) {
+			fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
+			goto out;
+		}
+		if (n != fwrite(buf, 1, n, fp_out)) {
+			printf("Error: Image - File write failed\n");
+			goto out;
+		}
+		len -= n;
+	}
+
+	ret = 0;
+out:
+	BUF_FREE(buf);
+
+	return ret;
+}
+
+/*
+ * Description : Copies the rest of fp_in, up to end of file, to fp_out
+ *
+ * @Inputs  : fp_in  - Input file pointer
+ *            fp_out - Output file pointer
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int copy_to_eof(FILE *fp_in, FILE *fp_out)
+{
+	uint8_t *buf = NULL;
+	size_t n;
+	int ret = -1;
+
+	if (otfad_buf_alloc(STREAM_CHUNK_SIZE, OTFAD_BUF_HUGE, (void **)&buf)) {
+		fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(ENOMEM));
+		return -1;
+	}
+
+	while ((n = fread(buf, 1, STREAM_CHUNK_SIZE, fp_in)) > 0) {
+		if (n != fwrite(buf, 1, n, fp_out)) {
+			printf("Error: Image - File write failed\n");
+			goto out;
+		}
+	}
+	if (ferror(fp_in)) {
+		fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
+		goto out;
+	}
+
+	ret = 0;
+out:
+	BUF_FREE(buf);
+
+	return ret;
+}
+
+/*
+ * Description : Moves fp_in len bytes forward: copies them to fp_out if
+ *               given, skips them otherwise, reading through them when
+ *               fp_in is a pipe
+ *
+ * @Inputs  : fp_in  - Input file pointer
+ *            fp_out - Output file pointer or NULL
+ *            len    - Number of bytes
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int skip_through(FILE *fp_in, FILE *fp_out, size_t len)
+{
+	uint8_t buf[IMG_HDR_SIZE];
+	size_t n;
+
+	if (fp_out != NULL) {
+		return copy_through(fp_in, fp_out, len);
+	}
+	if (len == 0 || fseek(fp_in, len, SEEK_CUR) == 0) {
+		return 0;
+	}
+	/* Not seekable */
+	errno = 0;
+
+	while (len) {
+		n = (len > sizeof(buf)) ? sizeof(buf) : len;
+		if (n != fread(buf, 1, n, fp_in)) {
+			fprintf(stderr, "Error: File read error; region starts beyond the input image\n");
+			return -1;
+		}
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Returns the job to run when the input or output is a pipe:
+ *               pipes are read and written once, in order, so the modes
+ *               working on whole files are replaced by stream
+ *
+ * @Inputs  : job  - Encryption job
+ *            copy - Storage for the adjusted job
+ *
+ * @Outputs : return job or copy
+ *
+ */
+static const struct enc_job *pipe_job(const struct enc_job *job, struct enc_job *copy)
+{
+	if (job->io_mode != IO_MODE_MMAP && job->io_mode != IO_MODE_URING) {
+		return job;
+	}
+
+	fprintf(stderr, "Warning: -m %s needs regular files, using stream I/O\n",
+		io_mode_names[job->io_mode]);
+	*copy = *job;
+	copy->io_mode = IO_MODE_STREAM;
+
+	return copy;
+}
+
+/*
+ * Description : Runs one encryption job with stdin as input or stdout as
+ *               output: everything up to the region, image header
+ *               included, is passed through in in-place mode and skipped
+ *               otherwise, then the ciphertext is written as it is
+ *               produced and, in in-place mode, the rest of the input
+ *               follows. No header file is written.
+ *
+ * @Inputs  : job - Encryption job
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int encrypt_region_pipe(const struct enc_job *job)
+{
+	const struct enc_region *rgn = &job->region[0];
+	struct enc_job seq_job;
+	FILE *fp_in = NULL;
+	FILE *fp_out = NULL;
+	int ret = -1;
+
+	job = pipe_job(job, &seq_job);
+
+	fp_in = open_image(job->input_fname, "rb");
+	if (fp_in == NULL) {
+		goto out;
+	}
+	fp_out = open_image(job->output_fname, "wb");
+	if (fp_out == NULL) {
+		goto out;
+	}
+
+	if (skip_through(fp_in, job->in_place ? fp_out : NULL,
+			 rgn->start_address - MX7ULP_QSPI_BASE_ADDR)) {
+		goto out;
+	}
+
+	if (job->io_mode == IO_MODE_BUFFER) {
+		ret = encrypt_buffered(job, rgn, fp_in, fp_out);
+	} else {
+		ret = encrypt_sequential(job, rgn, fp_in, fp_out);
+	}
+
+	if (ret == 0 && job->in_place) {
+		ret = copy_to_eof(fp_in, fp_out);
+	}
+
+	if (ret == 0 && fflush(fp_out)) {
+		fprintf(stderr, "Error: Couldn't write file %s; %s\n", job->output_fname, strerror(errno));
+		ret = -1;
+	}
+out:
+	FCLOSE(fp_in);
+	FCLOSE(fp_out);
+
+	return ret;
+}
+
+/*
+ * Description : Copies the whole input file into the (empty) output file,
+ *               in the kernel with copy_file_range when possible
+ *
+ * @Inputs  : fp_in  - Input file pointer
+ *            fp_out - Output file pointer
+ *            size   - Input file size
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int copy_file(FILE *fp_in, FILE *fp_out, size_t size)
+{
+	loff_t off_in = 0;
+	loff_t off_out = 0;
+	ssize_t n;
+
+	while (off_in < size) {
+		n = copy_file_range(fileno(fp_in), &off_in, fileno(fp_out), &off_out, size - off_in, 0);
+		if (n <= 0) {
+			break;
+		}
+	}
+	if (off_in == size) {
+		return 0;
+	}
+
+	/* Not supported between these files: copy through user space */
+	if (off_in != 0) {
+		fprintf(stderr, "Error: Couldn't copy file; %s\n", strerror(errno));
+		return -1;
+	}
+	rewind(fp_in);
+	return copy_through(fp_in, fp_out, size);
+}
+
+/*
+ * Description : Encrypts the region through memory mappings: the input image
+ *               is mapped read-only and the output file, sized with
+ *               ftruncate, is mapped writable, so the cipher kernel reads
+ *               plaintext from the page cache and writes the ciphertext
+ *               straight into the output mapping without any copy.
+ *               In in-place mode the input image is copied into the output
+ *               file and the region is encrypted directly in the output
+ *               mapping.
+ *
+ * @Inputs  : job    - Encryption job
+ *            rgn    - Region to encrypt
+ *            fp_in  - Input image
+ *            fp_out - Output file, opened for reading and writing
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int encrypt_mmap(const struct enc_job *job, const struct enc_region *rgn,
+			FILE *fp_in, FILE *fp_out)
+{
+	uint8_t *in_map = MAP_FAILED;
+	uint8_t *out_map = MAP_FAILED;
+	size_t in_map_size = rgn->end_address - MX7ULP_QSPI_BASE_ADDR;
+	size_t out_map_size = rgn->end_address - rgn->start_address;
+	size_t enc_image_size = rgn->end_address - rgn->start_address;
+	uint32_t image_start_offset = rgn->start_address - MX7ULP_QSPI_BASE_ADDR;
+	const uint8_t *src;
+	const uint8_t *in;
+	uint8_t *dst;
+	uint32_t pos;
+	uint32_t len;
+	struct stat st;
+	int ret = -1;
+
+	if (fstat(fileno(fp_in), &st)) {
+		fprintf(stderr, "Error: Couldn't stat file %s; %s\n", job->input_fname, strerror(errno));
+		goto out;
+	}
+	if (st.st_size < in_map_size) {
+		printf("Error: File read error; region ends beyond %s\n", job->input_fname);
+		goto out;
+	}
+
+	if (job->in_place) {
+		/* Copy of the input image, encrypted in its own mapping */
+		if (copy_file(fp_in, fp_out, st.st_size)) {
+			goto out;
+		}
+		out_map_size = in_map_size;
+	} else {
+		/* Input image up to the end of the region, read-only */
+		in_map = mmap(NULL, in_map_size, PROT_READ, MAP_SHARED, fileno(fp_in), 0);
+		if (in_map == MAP_FAILED) {
+			fprintf(stderr, "Error: Couldn't map file %s; %s\n", job->input_fname, strerror(errno));
+			goto out;
+		}
+		madvise(in_map, in_map_size, MADV_SEQUENTIAL);
+
+		/* Output file sized to the region */
+		if (ftruncate(fileno(fp_out), enc_image_size)) {
+			fprintf(stderr, "Error: Couldn't resize file %s; %s\n", job->output_fname, strerror(errno));
+			goto out;
+		}
+	}
+
+	out_map = mmap(NULL, out_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(fp_out), 0);
+	if (out_map == MAP_FAILED) {
+		fprintf(stderr, "Error: Couldn't map file %s; %s\n", job->output_fname, strerror(errno));
+		goto out;
+	}
+	madvise(out_map, out_map_size, MADV_SEQUENTIAL);
+
+	if (job->in_place) {
+		dst = out_map + image_start_offset;
+		src = dst;
+	} else {
+		dst = out_map;
+		src = in_map + image_start_offset;
+	}
+
+	/* Perform AES-128-CTR encryption, erased ranges from ERASED_BYTE */
+	for (pos = 0; pos < enc_image_size; pos += len) {
+		len = enc_image_size - pos;
+		if (erased_run(job, rgn->start_address + pos, &len)) {
+			memset(dst + pos, ERASED_BYTE, len);
+			in = dst + pos;
+		} else {
+			in = src + pos;
+		}
+		if (ctr_crypt(job, rgn, in, dst + pos, len, rgn->start_address + pos)) {
+			goto out;
+		}
+	}
+
+	ret = 0;
+out:
+	if (in_map != MAP_FAILED) {
+		munmap(in_map, in_map_size);
+	}
+	if (out_map != MAP_FAILED) {
+		munmap(out_map, out_map_size);
+	}
+
+	return ret;
+}
+
+/*
+ * Description : Runs one encryption job: writes the image header file, if
+ *               any, and encrypts the region [start_address, end_address) of the input
+ *               image into the output file with the selected I/O mode. In
+ *               in-place mode the output is the whole input image with the
+ *               region encrypted at its offset. stdin and stdout are
+ *               handled by encrypt_region_pipe.
+ *
+ * @Inputs  : job - Encryption job
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+int encrypt_region(const struct enc_job *job)
+{
+	const struct enc_region *rgn = &job->region[0];
+	FILE *fp_in = NULL;
+	FILE *fp_out = NULL;
+	int image_size = 0;
+	uint32_t image_start_offset = 0;
+	uint32_t image_end_offset = 0;
+	int ret = -1;
+
+	if (IS_STDIO(job->input_fname) || IS_STDIO(job->output_fname)) {
+		return encrypt_region_pipe(job);
+	}
+
+	image_size = get_file_size(&fp_in, job->input_fname);
+	if (image_size < 0) {
+		fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
+		goto out;
+	} else if (image_size <= IMG_HDR_SIZE) {
+		printf("Error: File size should be greater than 4096 bytes");
+		goto out;
+	}
+
+	if (job->header_fname != NULL && write_image_header(fp_in, job->header_fname)) {
+		goto out;
+	}
+
+	/* Output mapping needs the file opened for reading too */
+	fp_out = fopen(job->output_fname, (job->io_mode == IO_MODE_MMAP) ? "w+b" : "wb");
+	if (fp_out == NULL) {
+		fprintf(stderr, "Error: Couldn't open file %s; %s\n", job->output_fname, strerror(errno));
+		goto out;
+	}
+
+	image_start_offset = rgn->start_address - MX7ULP_QSPI_BASE_ADDR;
+	image_end_offset = rgn->end_address - MX7ULP_QSPI_BASE_ADDR;
+	if (job->in_place && job->io_mode != IO_MODE_MMAP) {
+		/* Pass the image through up to the region */
+		rewind(fp_in);
+		if (copy_through(fp_in, fp_out, image_start_offset)) {
+			goto out;
+		}
+	}
+
+	/* Seek to the image start offset */
+	if (fseek(fp_in , image_start_offset , SEEK_SET)) {
+		errno = ENOENT;
+		fprintf(stderr, "Error: Couldn't seek to offset 0x%X %s; %s\n", image_start_offset, job->input_fname, strerror(errno));
+		goto out;
+	}
+
+	switch (job->io_mode) {
+	case IO_MODE_STREAM:
+		ret = encrypt_stream(job, rgn, fp_in, fp_out);
+		break;
+	case IO_MODE_MMAP:
+		ret = encrypt_mmap(job, rgn, fp_in, fp_out);
+		break;
+	case IO_MODE_URING:
+		ret = encrypt_uring(job, rgn, fp_in, fp_out);
+		break;
+	case IO_MODE_PIPELINE:
+		ret = encrypt_pipeline(job, rgn, fp_in, fp_out);
+		break;
+	case IO_MODE_BUFFER:
+	default:
+		ret = encrypt_buffered(job, rgn, fp_in, fp_out);
+		break;
+	}
+
+	if (ret == 0 && job->in_place && job->io_mode != IO_MODE_MMAP &&
+	    image_size > image_end_offset) {
+		/* Pass the rest of the image through */
+		ret = copy_through(fp_in, fp_out, image_size - image_end_offset);
+	}
+
+	if (ret == 0 && fflush(fp_out)) {
+		fprintf(stderr, "Error: Couldn't write file %s; %s\n", job->output_fname, strerror(errno));
+		ret = -1;
+	}
+out:
+	FCLOSE(fp_in);
+	FCLOSE(fp_out);
+
+	return ret;
+}
+
+/*
+ * Description : Produces the complete OTFAD image from the input image in a
+ *               single pass: the keyblob area is reserved (zeroed), the
+ *               header and any gap between regions are copied through
+ *               unchanged and every region is encrypted with its own key
+ *               and counter. Regions must be sorted by address.
+ *               In mmap mode the input file is copied into the output file
+ *               and the regions are encrypted in the output mapping; the
+ *               other modes read and write the image once, sequentially,
+ *               which also works with stdin and stdout.
+ *
+ * @Inputs  : job - Encryption job with job->n_regions regions
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+int encrypt_image_layout(const struct enc_job *job)
+{
+	const struct enc_region *rgn;
+	FILE *fp_in = NULL;
+	FILE *fp_out = NULL;
+	uint8_t *out_map = MAP_FAILED;
+	uint8_t keyblob_area[KEYBLOB_AREA_SIZE];
+	int image_size = 0;
+	uint32_t pos = 0;
+	uint32_t image_start_offset;
+	uint32_t image_end_offset;
+	struct enc_job seq_job;
+	int pipe_io = IS_STDIO(job->input_fname) || IS_STDIO(job->output_fname);
+	int ret = -1;
+	int i;
+
+	if (pipe_io) {
+		/* Size unknown: a short input shows up as a read error */
+		job = pipe_job(job, &seq_job);
+		fp_in = open_image(job->input_fname, "rb");
+		if (fp_in == NULL) {
+			goto out;
+		}
+	} else {
+		image_size = get_file_size(&fp_in, job->input_fname);
+		if (image_size < 0) {
+			fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
+			goto out;
+		}
+
+		rgn = &job->region[job->n_regions - 1];
+		if (rgn->end_address - MX7ULP_QSPI_BASE_ADDR > image_size) {
+			printf("Error: File read error; region ends beyond %s\n", job->input_fname);
+			goto out;
+		}
+	}
+
+	fp_out = open_image(job->output_fname, (job->io_mode == IO_MODE_MMAP) ? "w+b" : "wb");
+	if (fp_out == NULL) {
+		goto out;
+	}
+
+	memset(keyblob_area, 0, KEYBLOB_AREA_SIZE);
+
+	if (job->io_mode == IO_MODE_MMAP) {
+		if (copy_file(fp_in, fp_out, image_size)) {
+			goto out;
+		}
+
+		out_map = mmap(NULL, image_size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(fp_out), 0);
+		if (out_map == MAP_FAILED) {
+			fprintf(stderr, "Error: Couldn't map file %s; %s\n", job->output_fname, strerror(errno));
+			goto out;
+		}
+
+		/* Reserve the keyblob area */
+		memcpy(out_map, keyblob_area, KEYBLOB_AREA_SIZE);
+
+		for (i = 0; i < job->n_regions; i++) {
+			rgn = &job->region[i];
+			image_start_offset = rgn->start_address - MX7ULP_QSPI_BASE_ADDR;
+			apply_erased(job, out_map + image_start_offset, rgn->end_address - rgn->start_address,
+				     rgn->start_address);
+		}
+		if (ctr_crypt_regions(job, out_map, MX7ULP_QSPI_BASE_ADDR)) {
+			goto out;
+		}
+	} else {
+		/* Reserve the keyblob area */
+		if (skip_through(fp_in, NULL, KEYBLOB_AREA_SIZE) ||
+		    KEYBLOB_AREA_SIZE != fwrite(keyblob_area, 1, KEYBLOB_AREA_SIZE, fp_out)) {
+			printf("Error: Keyblob area - File write failed\n");
+			goto out;
+		}
+		pos = KEYBLOB_AREA_SIZE;
+
+		for (i = 0; i < job->n_regions; i++) {
+			rgn = &job->region[i];
+			image_start_offset = rgn->start_address - MX7ULP_QSPI_BASE_ADDR;
+			image_end_offset = rgn->end_address - MX7ULP_QSPI_BASE_ADDR;
+
+			/* Header or gap before the region */
+			if (copy_through(fp_in, fp_out, image_start_offset - pos)) {
+				goto out;
+			}
+			if (encrypt_sequential(job, rgn, fp_in, fp_out)) {
+				goto out;
+			}
+			pos = image_end_offset;
+		}
+
+		/* Rest of the image */
+		if (pipe_io ? copy_to_eof(fp_in, fp_out) :
+			      copy_through(fp_in, fp_out, image_size - pos)) {
+			goto out;
+		}
+	}
+
+	ret = 0;
+	if (fflush(fp_out)) {
+		fprintf(stderr, "Error: Couldn't write file %s; %s\n", job->output_fname, strerror(errno));
+		ret = -1;
+	}
+out:
+	if (out_map != MAP_FAILED) {
+		munmap(out_map, image_size);
+	}
+	FCLOSE(fp_in);
+	FCLOSE(fp_out);
+
+	return ret;
+}
+
+/*
+ * Description : Loads the key and counter files of a region and creates
+ *               its CTR context
+ *
+ * @Inputs  : key_fname - Image Encryption Key file
+ *            ctr_fname - Counter file
+ *            start     - Start address (hex string)
+ *            end       - End address (hex string)
+ *            rgn       - Region to fill
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int load_region(const char *key_fname, const char *ctr_fname,
+		       const char *start, const char *end, struct enc_region *rgn)
+{
+	uint8_t *key_buf = NULL;
+	uint8_t *ctr_buf = NULL;
+	int err;
+	int ret = -1;
+
+	key_buf = alloc_buffer(NULL, key_fname, AES_KEY_SIZE);
+	if (key_buf == NULL) {
+		printf("Error: Error allocating memory for Image Encryption key\n");
+		goto out;
+	}
+	ctr_buf = alloc_buffer(NULL, ctr_fname, CTR_SIZE);
+	if (ctr_buf == NULL) {
+		printf("Error: Error allocating memory for Counter\n");
+		goto out;
+	}
+
+	rgn->start_address = strtol(start, NULL, BASE_HEX);
+	rgn->end_address = strtol(end, NULL, BASE_HEX);
+	err = otfad_ctr_new(key_buf, ctr_buf, &rgn->ctx);
+	if (err) {
+		printf("Error: %s\n", otfad_strerror(err));
+		goto out;
+	}
+
+	ret = 0;
+out:
+	BUF_FREE(key_buf);
+	BUF_FREE(ctr_buf);
+
+	return ret;
+}
+
+/*
+ * Description : Parses a -r option: <key-file>,<counter-file>,<start>,<end>
+ *
+ * @Inputs  : arg - Option argument
+ *            rgn - Region to fill
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int parse_region(const char *arg, struct enc_region *rgn)
+{
+	char *fields[4];
+	char *str = NULL;
+	char *saveptr = NULL;
+	int ret = -1;
+	int i;
+
+	str = strdup(arg);
+	if (str == NULL) {
+		fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < 4; i++) {
+		fields[i] = strtok_r(i ? NULL : str, ",", &saveptr);
+		if (fields[i] == NULL) {
+			printf("Error: Region %s should be <key-file>,<counter-file>,<start-address>,<end-address>\n", arg);
+			goto out;
+		}
+	}
+
+	ret = load_region(fields[0], fields[1], fields[2], fields[3], rgn);
+out:
+	FREE(str);
+
+	return ret;
+}
+
+/*
+ * Description : Parses an erased range given as <start-address>,<end-address>
+ *
+ * @Inputs  : arg - Option argument
+ *            e   - Erased range to fill
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int parse_erased(const char *arg, struct addr_range *e)
+{
+	char *end;
+
+	e->start = strtoul(arg, &end, BASE_HEX);
+	if (*end != ',') {
+		printf("Error: Erased range %s should be <start-address>,<end-address>\n", arg);
+		return -1;
+	}
+	e->end = strtoul(end + 1, NULL, BASE_HEX);
+
+	if (e->start < MX7ULP_QSPI_BASE_ADDR || e->end <= e->start) {
+		printf("Error: Erased range %s: End Address should be greater than Start address and greater than QSPI Base Address\n", arg);
+		return -1;
+	}
+	/* Encryption restarts at the range boundaries */
+	if ((e->start | e->end) % ERASED_ALIGN) {
+		printf("Error: Erased range %s should be %d-byte aligned\n", arg, ERASED_ALIGN);
+		return -1;
+	}
+#if DEBUG
+	printf("Erased range = 0x%08X - 0x%08X\n", e->start, e->end);
+#endif
+
+	return 0;
+}
+
+/*
+ * Description : Sorts the regions of a job by address and checks that they
+ *               lie in the boot image and do not overlap
+ *
+ * @Inputs  : job - Encryption job
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int check_regions(struct enc_job *job)
+{
+	struct enc_region tmp;
+	int i, j;
+
+	for (i = 1; i < job->n_regions; i++) {
+		for (j = i; j > 0 && job->region[j].start_address < job->region[j - 1].start_address; j--) {
+			tmp = job->region[j];
+			job->region[j] = job->region[j - 1];
+			job->region[j - 1] = tmp;
+		}
+	}
+
+	for (i = 0; i < job->n_regions; i++) {
+		if (job->region[i].start_address < MX7ULP_QSPI_BASE_ADDR + IMG_START_OFFSET || \
+		    job->region[i].end_address <= job->region[i].start_address) {
+			printf("Error: Region %d: End Address should be greater than Start address and Start Address not below 0x%08X\n",
+			       i, MX7ULP_QSPI_BASE_ADDR + IMG_START_OFFSET);
+			return -1;
+		}
+		if (i > 0 && job->region[i].start_address < job->region[i - 1].end_address) {
+			printf("Error: Region %d overlaps region %d\n", i, i - 1);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Reads a batch manifest: one job per line,
+ *               <input> <key-file> <counter-file> <start> <end> <output>
+ *               separated by blanks. Empty lines and lines starting with '#'
+ *               are skipped. Every job inherits the I/O mode, in-place and
+ *               keystream cache options of tmpl and runs on one thread.
+ *
+ * @Inputs  : tmpl   - Job holding the command line options
+ *            fname  - Manifest file name
+ *            jobs   - Jobs output, to be released with free_batch
+ *            n_jobs - Number of jobs output
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int parse_manifest(const struct enc_job *tmpl, const char *fname,
+			  struct batch_job **jobs, int *n_jobs)
+{
+	FILE *fp = NULL;
+	struct batch_job *job_list = NULL;
+	struct batch_job *tmp;
+	struct enc_job *job;
+	struct enc_region *rgn;
+	char *fields[BATCH_FIELDS + 1];
+	char *line = NULL;
+	char *saveptr;
+	size_t line_size = 0;
+	int n = 0;
+	int line_no = 0;
+	int ret = -1;
+	int i;
+
+	fp = fopen(fname, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "Error: Couldn't open file %s; %s\n", fname, strerror(errno));
+		return -1;
+	}
+
+	while (getline(&line, &line_size, fp) != -1) {
+		line_no++;
+		for (i = 0; i <= BATCH_FIELDS; i++) {
+			fields[i] = strtok_r(i ? NULL : line, " \t\r\n", &saveptr);
+			if (fields[i] == NULL) {
+				break;
+			}
+		}
+		if (i == 0 || fields[0][0] == '#') {
+			continue;
+		}
+		if (i != BATCH_FIELDS) {
+			printf("Error: %s:%d: expected <input> <key-file> <counter-file> <start> <end> <output>\n",
+			       fname, line_no);
+			goto out;
+		}
+
+		if (IS_STDIO(fields[0]) || IS_STDIO(fields[5])) {
+			printf("Error: %s:%d: stdin and stdout can't be used in a manifest\n", fname, line_no);
+			goto out;
+		}
+
+		tmp = realloc(job_list, (n + 1) * sizeof(*job_list));
+		if (tmp == NULL) {
+			fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(errno));
+			goto out;
+		}
+		job_list = tmp;
+
+		job = &job_list[n].job;
+		*job = *tmpl;
+		job->n_regions = 1;
+		job->n_threads = 1;
+		job->header_fname = NULL;
+		memset(job->region, 0, sizeof(job->region));
+		job->input_fname = strdup(fields[0]);
+		job->output_fname = strdup(fields[5]);
+		job_list[n].ret = -1;
+		n++;
+		if (job->input_fname == NULL || job->output_fname == NULL) {
+			fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(errno));
+			goto out;
+		}
+
+		rgn = &job->region[0];
+		if (load_region(fields[1], fields[2], fields[3], fields[4], rgn)) {
+			printf("Error: %s:%d: invalid job\n", fname, line_no);
+			goto out;
+		}
+
+		/* Validate start and end address based on QSPI base address */
+		if (rgn->start_address < MX7ULP_QSPI_BASE_ADDR || \
+		    rgn->end_address < MX7ULP_QSPI_BASE_ADDR || \
+		    rgn->end_address <= rgn->start_address) {
+			printf("Error: %s:%d: End Address should be greater than Start address and greater than QSPI Base Address\n",
+			       fname, line_no);
+			goto out;
+		}
+	}
+
+	if (n == 0) {
+		printf("Error: No job in %s\n", fname);
+		goto out;
+	}
+
+	ret = 0;
+out:
+	FREE(line);
+	FCLOSE(fp);
+	*jobs = job_list;
+	*n_jobs = n;
+
+	return ret;
+}
+
+/*
+ * Description : Releases the jobs of a batch
+ *
+ * @Inputs  : jobs   - Jobs
+ *            n_jobs - Number of jobs
+ */
+static void free_batch(struct batch_job *jobs, int n_jobs)
+{
+	int i;
+
+	for (i = 0; i < n_jobs; i++) {
+		ks_cache_unmap(&jobs[i].job.region[0]);
+		digest_free(&jobs[i].job.region[0]);
+		otfad_ctr_free(jobs[i].job.region[0].ctx);
+		FREE(jobs[i].job.input_fname);
+		FREE(jobs[i].job.output_fname);
+	}
+	free(jobs);
+}
+
+/*
+ * Description : qsort comparator ordering batch jobs largest region first
+ */
+static int cmp_batch_job(const void *a, const void *b)
+{
+	const struct enc_region *ra = &((const struct batch_job *)a)->job.region[0];
+	const struct enc_region *rb = &((const struct batch_job *)b)->job.region[0];
+	uint32_t size_a = ra->end_address - ra->start_address;
+	uint32_t size_b = rb->end_address - rb->start_address;
+
+	return (size_a < size_b) - (size_a > size_b);
+}
+
+/*
+ * Description : Worker of the batch pool. Takes the next job until all jobs
+ *               are done.
+ *
+ * @Inputs  : arg - Shared batch_pool
+ */
+static void *batch_worker(void *arg)
+{
+	struct batch_pool *pool = arg;
+	struct batch_job *bj;
+	int i;
+
+	while ((i = __atomic_fetch_add(&pool->next_job, 1, __ATOMIC_RELAXED)) < pool->n_jobs) {
+		bj = &pool->jobs[i];
+		if (bj->job.ks_cache_dir != NULL && ks_cache_map(&bj->job, &bj->job.region[0])) {
+			continue;
+		}
+		if (digest_begin(&bj->job)) {
+			continue;
+		}
+		bj->ret = encrypt_region(&bj->job);
+		if (bj->ret == 0) {
+			bj->ret = digest_end(&bj->job);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Re-encrypts a plaintext patch into an encrypted image file,
+ *               in place. Only the patched bytes are written. The image is
+ *               the output of the region alone, starting at start_address,
+ *               or a full image (-p, -r) starting at the QSPI base address.
+ *
+ * @Inputs  : job - Encryption job of the region holding the patch
+ *            arg - Patch given as <plaintext-file>,<address>
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int patch_image(const struct enc_job *job, const char *arg)
+{
+	const struct enc_region *rgn = &job->region[0];
+	FILE *fp_patch = NULL;
+	uint8_t *patch = NULL;
+	uint8_t *ct = NULL;
+	char *fname = NULL;
+	char *sep;
+	uint32_t patch_addr;
+	uint32_t image_addr;
+	int patch_size;
+	struct stat st;
+	int fd = -1;
+	int err;
+	int ret = -1;
+
+	fname = strdup(arg);
+	if (fname == NULL) {
+		fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(errno));
+		return -1;
+	}
+	sep = strrchr(fname, ',');
+	if (sep == NULL) {
+		printf("Error: Patch %s should be <plaintext-file>,<address>\n", arg);
+		goto out;
+	}
+	*sep = '\0';
+	patch_addr = strtoul(sep + 1, NULL, BASE_HEX);
+
+	patch_size = get_file_size(&fp_patch, fname);
+	if (patch_size < 0) {
+		goto out;
+	}
+	if (patch_addr < rgn->start_address || patch_addr > rgn->end_address ||
+	    patch_size > rgn->end_address - patch_addr) {
+		printf("Error: Patch 0x%08X-0x%08X should be in region 0x%08X-0x%08X\n", patch_addr,
+		       patch_addr + patch_size, rgn->start_address, rgn->end_address);
+		goto out;
+	}
+
+	if (otfad_buf_alloc(patch_size, OTFAD_BUF_HUGE, (void **)&patch) ||
+	    otfad_buf_alloc(patch_size, OTFAD_BUF_HUGE, (void **)&ct)) {
+		fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(ENOMEM));
+		goto out;
+	}
+	if (patch_size != fread(patch, 1, patch_size, fp_patch)) {
+		fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
+		goto out;
+	}
+
+	fd = open(job->input_fname, O_WRONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Error: Couldn't open file %s; %s\n", job->input_fname, strerror(errno));
+		goto out;
+	}
+	image_addr = job->in_place ? MX7ULP_QSPI_BASE_ADDR : rgn->start_address;
+	if (st.st_size < patch_addr - image_addr + patch_size) {
+		printf("Error: Patch ends beyond %s\n", job->input_fname);
+		goto out;
+	}
+
+	/* Ciphertext of the patch alone, the image is not read */
+	err = otfad_ctr_patch(rgn->ctx, ct, patch_size, patch_addr, patch, patch_size, patch_addr);
+	if (err) {
+		printf("Error: Encryption failed; %s\n", otfad_strerror(err));
+		ERR_print_errors_fp(stderr);
+		goto out;
+	}
+
+	if (pwrite(fd, ct, patch_size, patch_addr - image_addr) != patch_size) {
+		printf("Error: Encrypted Image - File write failed\n");
+		goto out;
+	}
+
+	ret = 0;
+out:
+	if (fd >= 0 && close(fd)) {
+		fprintf(stderr, "Error: Couldn't write file %s; %s\n", job->input_fname, strerror(errno));
+		ret = -1;
+	}
+	FCLOSE(fp_patch);
+	BUF_FREE(patch);
+	BUF_FREE(ct);
+	FREE(fname);
+
+	return ret;
+}
+
+/*
+ * Description : Runs all jobs of a batch manifest in this process, largest
+ *               first, on a pool of tmpl->n_threads workers (the calling
+ *               thread included). A failed job doesn't stop the others.
+ *
+ * @Inputs  : tmpl  - Job holding the command line options
+ *            fname - Manifest file name
+ *
+ * @Outputs : return 0 if all jobs succeeded, -1 otherwise
+ *
+ */
+static int run_batch(const struct enc_job *tmpl, const char *fname)
+{
+	struct batch_pool pool;
+	pthread_t *threads = NULL;
+	int n_threads = tmpl->n_threads;
+	int started = 0;
+	int failed = 0;
+	int i;
+
+	memset(&pool, 0, sizeof(pool));
+	if (parse_manifest(tmpl, fname, &pool.jobs, &pool.n_jobs)) {
+		free_batch(pool.jobs, pool.n_jobs);
+		return -1;
+	}
+
+	qsort(pool.jobs, pool.n_jobs, sizeof(*pool.jobs), cmp_batch_job);
+
+	if (n_threads > pool.n_jobs) {
+		n_threads = pool.n_jobs;
+	}
+	if (n_threads > 1) {
+		threads = malloc((n_threads - 1) * sizeof(pthread_t));
+	}
+	for (i = 0; threads != NULL && i < n_threads - 1; i++) {
+		if (pthread_create(&threads[i], NULL, batch_worker, &pool)) {
+			fprintf(stderr, "Warning: Couldn't create thread %d, continuing with %d\n", i, started + 1);
+			break;
+		}
+		started++;
+	}
+
+	/* Jobs of threads that couldn't be started are picked up here */
+	batch_worker(&pool);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	FREE(threads);
+
+	for (i = 0; i < pool.n_jobs; i++) {
+		if (pool.jobs[i].ret) {
+			printf("Error: Job %s -> %s failed\n", pool.jobs[i].job.input_fname,
+			       pool.jobs[i].job.output_fname);
+			failed++;
+		} else {
+			printf("Encrypted Image generated: %s\n", pool.jobs[i].job.output_fname);
+		}
+	}
+	free_batch(pool.jobs, pool.n_jobs);
+
+	return failed ? -1 : 0;
+}
+
+int main (int argc, char **argv)
+{
+	FILE *fp_in = NULL;
+
+	uint8_t *key_buf = NULL;
+	uint8_t *ctr_buf = NULL;
+
+	struct enc_job job;
+	struct enc_region *rgn = &job.region[0];
+	const uint8_t *key;
+	const uint8_t *ctr;
+	char *batch_fname = NULL;
+	char *patch_arg = NULL;
+	int n_regions = 0;
+
+	int next_opt = 0;
+	int err;
+	int i;
+
+	memset(&job, 0, sizeof(job));
+	job.n_threads = 1;
+	job.io_mode = IO_MODE_BUFFER;
+
+	/* Handle command line options */
+	handle_cl_opt(argc, argv);
+
+	/* Start from the first command-line option */
+	optind = 0;
 	/* Perform actions according to command-line option */
 	do {
 		next_opt = getopt_long(argc, argv, short_opt, long_opt, NULL);
 		switch (next_opt)
 		{
+		/* Input image */
+		case 'i':
+			job.input_fname = optarg;
+			break;
 		/* Image Encryption Key */
 		case 'k':
 			key_buf = alloc_buffer(fp_in, optarg, AES_KEY_SIZE);
@@ -352,114 +2727,145 @@ int main (int argc, char **argv)
 			break;
 		/* Start Address */
 		case 's':
-			start_address = strtol(optarg, NULL, BASE_HEX);
-			system_address = start_address;
+			rgn->start_address = strtol(optarg, NULL, BASE_HEX);
 #if DEBUG
-			printf("Start Address = 0x%08X\n", start_address);
+			printf("Start Address = 0x%08X\n", rgn->start_address);
 #endif
 			break;
 		/* End Address */
 		case 'e':
-			end_address = strtol(optarg, NULL, BASE_HEX);
+			rgn->end_address = strtol(optarg, NULL, BASE_HEX);
 #if DEBUG
-			printf("End Address = 0x%08X\n", end_address);
+			printf("End Address = 0x%08X\n", rgn->end_address);
 #endif
 			break;
-		/* Ouput file */
-		case 'o':
-			output_fname = optarg;
-			fp_out = fopen(optarg, "wb");
-			if (fp_out == NULL) {
-				fprintf(stderr, "Error: Couldn't open file %s; %s\n", optarg, strerror(errno));
+		/* Region of the complete image */
+		case 'r':
+			if (parse_region(optarg, &job.region[n_regions])) {
 				goto err;
 			}
+			n_regions++;
 			break;
-		default:
+		/* Ouput file */
+		case 'o':
+			job.output_fname = optarg;
 			break;
-		}
-	} while (next_opt != -1);
-
-	/* Validate start and end address based on QSPI base address */
-	if (start_address < MX7ULP_QSPI_BASE_ADDR || \
-	    end_address < MX7ULP_QSPI_BASE_ADDR || \
-	    end_address <= start_address) {
-		printf("Error: End Address should be greater than Start address and greater than QSPI Base Address\n");
-		goto err;
-	}
-
-	/* Split up the Header and Image according to Start and End Address */
-	/* Start from the first command-line option */
-	optind = 0;
-	/* Perform actions according to command-line option */
-	do {
-		next_opt = getopt_long(argc, argv, short_opt, long_opt, NULL);
-		switch (next_opt)
-		{
-		case 'i':
-			image_size = get_file_size(&fp_in, optarg);
-			if (image_size < 0) {
-				fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
-				goto err;
-			} else if (image_size <= IMG_HDR_SIZE) {
-				printf("Error: File size should be greater than 4096 bytes");
-				goto err;
+		/* Number of encryption threads */
+		case 't':
+			job.n_threads = strtol(optarg, NULL, 10);
+			if (job.n_threads == 0) {
+				job.n_threads = sysconf(_SC_NPROCESSORS_ONLN);
 			}
-
-			/* Allocate memory to the buffer - Image header */
-			image_hdr_buf = malloc(IMG_HDR_SIZE);
-			if (image_hdr_buf == NULL || image_hdr_buf == 0) {
-				fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(errno));
+			if (job.n_threads < 1) {
+				printf("Error: Number of threads should be positive\n");
 				goto err;
 			}
-
-			/* Copy the file into the buffer - Image header */
-			result = fread(image_hdr_buf,1,IMG_HDR_SIZE,fp_in);
-			if (result != IMG_HDR_SIZE) {
-				fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
-				goto err;
+			break;
+		/* Encrypt in place in a copy of the input image */
+		case 'p':
+			job.in_place = 1;
+			break;
+		/* Keystream cache directory */
+		case 'K':
+			job.ks_cache_dir = optarg;
+			break;
+		/* Batch manifest */
+		case 'b':
+			batch_fname = optarg;
+			break;
+		/* Patch of an encrypted image */
+		case 'P':
+			patch_arg = optarg;
+			break;
+		/* Digests of the regions */
+		case 'd':
+			for (i = 0; digest_names[i] != NULL; i++) {
+				if (!strcmp(optarg, digest_names[i])) {
+					break;
+				}
 			}
-
-			image_start_offset = start_address - MX7ULP_QSPI_BASE_ADDR;
-			/* Seek to the image start offset */
-			if (fseek(fp_in , image_start_offset , SEEK_SET)) {
-				errno = ENOENT;
-				fprintf(stderr, "Error: Couldn't seek to offset 0x1000 %s; %s\n", optarg, strerror(errno));
+			if (digest_names[i] == NULL) {
+				printf("Error: Unknown digest %s\n", optarg);
 				goto err;
 			}
-
-			enc_image_size = end_address - start_address;
-
-			/* Allocate memory to the buffer - Image to be encrypted */
-			image_buf = malloc(enc_image_size);
-			if (image_buf == NULL || image_buf == 0) {
-				fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(errno));
+			job.digest = i + 1;
+			break;
+		/* Erased flash range */
+		case 'E':
+			if (parse_erased(optarg, &job.erased[job.n_erased])) {
 				goto err;
 			}
-
-			/* Copy the file into the buffer - Image to be encrypted */
-			result = fread(image_buf,1,enc_image_size,fp_in);
-			if (result != enc_image_size) {
-				fprintf(stderr, "Error: File read error; %s\n", strerror(errno));
+			job.n_erased++;
+			break;
+		/* I/O mode */
+		case 'm':
+			for (i = 0; io_mode_names[i] != NULL; i++) {
+				if (!strcmp(optarg, io_mode_names[i])) {
+					break;
+				}
+			}
+			if (io_mode_names[i] == NULL) {
+				printf("Error: Unknown I/O mode %s\n", optarg);
 				goto err;
 			}
-
-			FCLOSE(fp_in);
+			job.io_mode = i;
 			break;
 		default:
 			break;
 		}
 	} while (next_opt != -1);
 
+	/* Jobs of a manifest on a worker pool */
+	if (batch_fname != NULL) {
+		if (run_batch(&job, batch_fname)) {
+			goto err;
+		}
+
+		goto out;
+	}
+
+	/* All regions of the complete image in one pass */
+	if (n_regions) {
+		job.n_regions = n_regions;
+		if (check_regions(&job)) {
+			goto err;
+		}
+		for (i = 0; job.ks_cache_dir != NULL && i < job.n_regions; i++) {
+			if (ks_cache_map(&job, &job.region[i])) {
+				goto err;
+			}
+		}
+		if (digest_begin(&job) || encrypt_image_layout(&job) || digest_end(&job)) {
+			goto err;
+		}
+
+		printf("Encrypted Image generated: %s\n", job.output_fname);
+
+		goto out;
+	}
+	job.n_regions = 1;
+	if (patch_arg == NULL && !IS_STDIO(job.input_fname) && !IS_STDIO(job.output_fname)) {
+		job.header_fname = "header";
+	}
+
+	/* Validate start and end address based on QSPI base address */
+	if (rgn->start_address < MX7ULP_QSPI_BASE_ADDR || \
+	    rgn->end_address < MX7ULP_QSPI_BASE_ADDR || \
+	    rgn->end_address <= rgn->start_address) {
+		printf("Error: End Address should be greater than Start address and greater than QSPI Base Address\n");
+		goto err;
+	}
+
 	/* Choose whether to use test key or input key */
 	if(key_buf == NULL) {
-		image_enc_key = (unsigned char *)test_key;
+		key = test_key;
 		printf("Using Test Image Encryption Key as input\n");
 #if DEBUG
 		printf("Test Input Image Encryption Key:");
 #endif
 	} else {
-		/* Copy key value from input key file */
-		image_enc_key = key_buf;
+		/* Key value from input key file */
+		key = key_buf;
 #if DEBUG
 		printf("Input Image Encryption Key:");
 #endif
@@ -467,104 +2873,73 @@ int main (int argc, char **argv)
 
 #if DEBUG
 	for (i = 0; i < AES_KEY_SIZE; i++) {
-		printf("%02X", image_enc_key[i]);
+		printf("%02X", key[i]);
 	}
 	printf("\n");
 #endif
 
 	/* Choose whether to use test counter or input counter value */
 	if(ctr_buf == NULL) {
-		counter = (unsigned char *)test_ctr;
+		ctr = test_ctr;
 		printf("Using Test Couter as input\n");
-#if DEBUG
-		printf("Test Input Counter:");
-		for (i = 0; i < CTR_EXT_SIZE; i++) {
-			printf("%02X", test_ctr[i]);
-		}
-		printf("\n");
-#endif
 	}
 	else {
-		/* Allocate memory for counter value */
-		counter = malloc(CTR_EXT_SIZE);
-		if (counter == NULL || counter == 0) {
-			fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(errno));
-			goto err;
-		}
-
-		/* Copy Counter value from input counter file */
-		counter = ctr_buf;
-
-		/* Append counter with XOR of 0th byte with 4th byte etc...*/
-		for(i = 0; i < 4; i++) {
-			ctr_xor[i] = ctr_buf[i] ^ ctr_buf[i + 4];
-		}
+		ctr = ctr_buf;
+	}
 
 #if DEBUG
-		printf("Input Counter value:");
-		for (i = 0; i < CTR_SIZE; i++) {
-			printf("%02X", counter[i]);
-		}
-		printf("\n");
+	printf("QSPI System Address = 0x%08X\n", rgn->start_address);
+#endif
+	err = otfad_ctr_new(key, ctr, &rgn->ctx);
+	if (err) {
+		printf("Error: %s\n", otfad_strerror(err));
+		goto err;
+	}
 
-		printf("Counter XOR value\n");
-		for(i = 0; i < 4; i++) {
-			printf("ctr_xor[%d] = %X\n", i, ctr_xor[i]);
+	/* Only the patched bytes of the image */
+	if (patch_arg != NULL) {
+		if (patch_image(&job, patch_arg)) {
+			goto err;
 		}
 
-		printf("QSPI System Address = 0x%08X\n", system_address);
-#endif
-		/* Append Counter XOR value */
-		memcpy(counter + CTR_SIZE, ctr_xor, 4);
-		/* Append Counter value with QSPI addr */
-		memcpy(counter + CTR_SIZE + 4, &system_address, 4);
-	}
+		printf("Encrypted Image patched: %s\n", job.input_fname);
 
-	/* Perform AES-128-CTR encryption */
-	enc_image = do_aes_ctr_enc(image_buf, enc_image_size, image_enc_key, counter, system_address);
-	if(enc_image == NULL) {
-		printf("Error: Encryption failed\n");
-		goto err;
+		goto out;
 	}
 
-	/* Write the image header to the header file */
-	fp_hdr = fopen("header", "wb");
-	if (fp_hdr == NULL) {
-		fprintf(stderr, "Error: Couldn't open file %s; %s\n", "header", strerror(errno));
+	if (job.ks_cache_dir != NULL && ks_cache_map(&job, rgn)) {
 		goto err;
 	}
 
-	if(IMG_HDR_SIZE != fwrite((const char *)image_hdr_buf, 1, IMG_HDR_SIZE, fp_hdr)) {
-		printf("Error: Image header - File write failed\n");
+	if (digest_begin(&job) || encrypt_region(&job) || digest_end(&job)) {
 		goto err;
 	}
 
-	/* Write Encrypted image to the output file */
-	if(enc_image_size != fwrite((const char *)enc_image, 1, enc_image_size, fp_out)) {
-		printf("Error: Encrypted Image - File write failed\n");
-		goto err;
+	if (job.header_fname != NULL) {
+		printf("Header file generated: %s\n", job.header_fname);
 	}
+	printf("Encrypted Image generated: %s\n", job.output_fname);
 
-	printf("Header file generated: header\n");
-	printf("Encrypted Image generated: %s\n", output_fname);
-
-	FREE(image_hdr_buf);
-	FREE(image_buf);
-	FREE(key_buf);
-	FREE(ctr_buf);
-	FCLOSE(fp_in);
-	FCLOSE(fp_out);
-	FCLOSE(fp_hdr);
+out:
+	for (i = 0; i < NUM_CONTEXT; i++) {
+		ks_cache_unmap(&job.region[i]);
+		digest_free(&job.region[i]);
+		otfad_ctr_free(job.region[i].ctx);
+	}
+	BUF_FREE(key_buf);
+	BUF_FREE(ctr_buf);
+	otfad_buf_pool_drain();
 
 	return EXIT_SUCCESS;
 err:
-	FREE(image_hdr_buf);
-	FREE(image_buf);
-	FREE(key_buf);
-	FREE(ctr_buf);
-	FCLOSE(fp_in);
-	FCLOSE(fp_out);
-	FCLOSE(fp_hdr);
+	for (i = 0; i < NUM_CONTEXT; i++) {
+		ks_cache_unmap(&job.region[i]);
+		digest_free(&job.region[i]);
+		otfad_ctr_free(job.region[i].ctx);
+	}
+	BUF_FREE(key_buf);
+	BUF_FREE(ctr_buf);
+	otfad_buf_pool_drain();
 
 	return EXIT_FAILURE;
 }
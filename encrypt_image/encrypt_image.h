@@ -4,28 +4,55 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#define _GNU_SOURCE
+
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
 
 /* OpenSSL includes*/
-#include <openssl/rand.h>
-#include <openssl/bio.h>
-#include <openssl/evp.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
+
+#include "otfad.h"
+#include "uring_io.h"
 
-#define MAX_SIZE         0xFFFFF
 #define TEST             0
 #define BASE_HEX         16
 
 #define AES_KEY_SIZE     16
 #define CTR_SIZE         8
-#define CTR_EXT_SIZE     16
 #define IMG_START_OFFSET 4096
 #define IMG_HDR_SIZE     IMG_START_OFFSET
-#define SYS_ADDR_OFFSET  12
+#define STREAM_CHUNK_SIZE 0x100000
 #define MX7ULP_QSPI_BASE_ADDR   0xC0000000
+#define KEYBLOB_AREA_SIZE       0x100
+#define KS_CACHE_MAGIC          "OTFADKS1"
+#define KS_CACHE_HDR_SIZE       0x1000
+#define BATCH_FIELDS            6
+#define URING_QUEUE_DEPTH       8
+#define PIPELINE_DEPTH          4
+#define MAX_ERASED_RANGES       16
+#define ERASED_BYTE             0xFF
+#define ERASED_ALIGN            16
+#define DIGEST_PLAIN            0x1
+#define DIGEST_CIPHER           0x2
+#define DIGEST_SUFFIX           ".digest"
+#define CACHE_LINE_SIZE         64
+/* File name of stdin (-i) and stdout (-o) */
+#define STDIO_FNAME             "-"
+#define IS_STDIO(fname)         (!strcmp(fname, STDIO_FNAME))
+#define NUM_CONTEXT             OTFAD_NUM_CONTEXT
 
 #define FREE(x)         do { \
 				if(x != NULL) { \
@@ -34,6 +61,12 @@
 				} \
 			} while(0)
 
+/* Frees a buffer of the libotfad buffer pool */
+#define BUF_FREE(x)     do { \
+				otfad_buf_free(x); \
+				x = NULL; \
+			} while(0)
+
 #define FCLOSE(x)         do { \
 				if(x != NULL) { \
 					fclose(x); \
@@ -41,13 +74,139 @@
 				} \
 			} while(0)
 
-#define SWAP32(a, b)    do{unsigned int tmp; tmp=a; a=b; b=tmp;}while(0)
+/* I/O modes, in the order of io_mode_names */
+enum io_mode {
+	IO_MODE_BUFFER,
+	IO_MODE_STREAM,
+	IO_MODE_MMAP,
+	IO_MODE_URING,
+	IO_MODE_PIPELINE,
+};
+
+/* State of a chunk buffer of the io_uring pipeline */
+enum chunk_state {
+	CHUNK_FREE,
+	CHUNK_READING,
+	CHUNK_READ,
+	CHUNK_WRITING,
+};
+
+/* Chunk buffer of the io_uring pipeline */
+struct uring_chunk {
+	uint8_t *buf;
+	/* Offset of the chunk in the region */
+	uint32_t pos;
+	uint32_t len;
+	/* Bytes written through the ring, the unaligned tail excluded */
+	uint32_t wlen;
+	enum chunk_state state;
+};
+
+/* SHA-256 and CRC32 of the plaintext [0] and ciphertext [1] of a region */
+struct region_digest {
+	EVP_MD_CTX *sha[2];
+	uint32_t crc[2];
+};
+
+/* A region of the image encrypted with its own key and counter */
+struct enc_region {
+	struct otfad_ctr *ctx;
+	uint32_t start_address;
+	uint32_t end_address;
+	/* Keystream of the region mapped from the cache, or NULL */
+	const uint8_t *ks;
+	/* Digests updated while encrypting, or NULL */
+	struct region_digest *digest;
+};
+
+/* System address range [start, end) */
+struct addr_range {
+	uint32_t start;
+	uint32_t end;
+};
+
+/* One encryption job: one or more regions of an input image */
+struct enc_job {
+	char *input_fname;
+	char *output_fname;
+	struct enc_region region[NUM_CONTEXT];
+	int n_regions;
+	int n_threads;
+	enum io_mode io_mode;
+	int in_place;
+	char *ks_cache_dir;
+	char *header_fname;
+	/* Ranges of erased flash, encrypted as ERASED_BYTE without reading */
+	struct addr_range erased[MAX_ERASED_RANGES];
+	int n_erased;
+	/* DIGEST_PLAIN and/or DIGEST_CIPHER */
+	int digest;
+};
+
+/* Chunk passed between the stages of the pipeline */
+struct pipe_chunk {
+	uint8_t *buf;
+	/* System address of the first byte, for the CTR counter */
+	uint32_t sys_addr;
+	uint32_t len;
+};
+
+/*
+ * Lock-free single-producer/single-consumer ring of chunks. It can hold
+ * every chunk of the pipeline, so a push never waits. The producer only
+ * writes tail and the consumer only writes head, each on its own cache
+ * line.
+ */
+struct spsc_ring {
+	struct pipe_chunk *slot[PIPELINE_DEPTH];
+	unsigned int head __attribute__((aligned(CACHE_LINE_SIZE)));
+	unsigned int tail __attribute__((aligned(CACHE_LINE_SIZE)));
+};
+
+/* Reader -> encryptor -> writer pipeline of one region */
+struct pipeline {
+	const struct enc_job *job;
+	const struct enc_region *rgn;
+	FILE *fp_in;
+	FILE *fp_out;
+	uint32_t chunk_size;
+	uint32_t n_chunks;
+	/* Empty chunks back to the reader */
+	struct spsc_ring free_ring;
+	/* Read chunks to the encryptor */
+	struct spsc_ring read_ring;
+	/* Encrypted chunks to the writer */
+	struct spsc_ring enc_ring;
+	/* Set by a failing stage to stop the others */
+	int abort;
+};
+
+/* One job of a batch manifest */
+struct batch_job {
+	struct enc_job job;
+	int ret;
+};
+
+/* Jobs shared by the batch worker pool */
+struct batch_pool {
+	struct batch_job *jobs;
+	int n_jobs;
+	int next_job;
+};
+
+/* Header of a keystream cache file, the keystream follows at KS_CACHE_HDR_SIZE */
+struct ks_cache_hdr {
+	char magic[8];
+	uint32_t start_address;
+	uint32_t size;
+	uint8_t id[OTFAD_KEYSTREAM_ID_SIZE];
+};
 
 /************************
 	Command line arguments
 ************************/
 /* Valid short command line option letters. */
-const char* const short_opt = "i:k:c:s:e:o:h";
+const char* const short_opt = "i:k:c:s:e:r:o:t:m:pK:b:E:d:P:B:Th";
 
 /* Valid long command line options. */
 const struct option long_opt[] =
@@ -57,7 +216,18 @@ const struct option long_opt[] =
 	{"counter", required_argument,  0, 'c'},
 	{"start-address", required_argument,  0, 's'},
 	{"end-address", required_argument, 0, 'e'},
+	{"region", required_argument, 0, 'r'},
 	{"output", required_argument,  0, 'o'},
+	{"threads", required_argument,  0, 't'},
+	{"io-mode", required_argument,  0, 'm'},
+	{"in-place", no_argument,  0, 'p'},
+	{"keystream-cache", required_argument,  0, 'K'},
+	{"batch", required_argument,  0, 'b'},
+	{"erased", required_argument,  0, 'E'},
+	{"digest", required_argument,  0, 'd'},
+	{"patch", required_argument,  0, 'P'},
+	{"aes-backend", required_argument,  0, 'B'},
+	{"self-test", no_argument,  0, 'T'},
 	{"help", no_argument, 0, 'h'},
 	{NULL, 0, NULL, 0}
 };
@@ -65,22 +235,56 @@ const struct option long_opt[] =
 /* Option descriptions */
 const char* opt_desc[] =
 {
-	"Input image to be decrypted",
+	"Input image to be decrypted (- for stdin)",
 	"Input image encryption key (128-bit)",
 	"Input counter (64 bit)",
 	"Start Address of encryption in File (32-bit)",
 	"End Address of encryption in File (32-bit)",
-	"Output File",
+	"Region <key-file>,<counter-file>,<start-address>,<end-address>, once per context: output the complete image",
+	"Output File (- for stdout)",
+	"Number of encryption threads (0: one per online CPU)",
+	"I/O mode: buffer (default), stream, mmap, uring or pipeline",
+	"Output the whole input image with the region encrypted in place",
+	"Directory of the keystream cache, reused while key, counter and addresses are unchanged",
+	"Manifest of jobs <input> <key-file> <counter-file> <start> <end> <output>, one per line, run on -t threads",
+	"Erased flash range <start-address>,<end-address>: encrypted as 0xFF without reading the input",
+	"SHA-256 and CRC32 of the plain, cipher or both texts of the regions, written to <output>.digest",
+	"Patch <plaintext-file>,<address>: re-encrypt the patch into the encrypted input image, in place (-p: full image)",
+	"AES backend: openssl, aesni, vaes, portable (bitsliced) or auto (default: $OTFAD_AES_BACKEND, else auto)",
+	"Check the AES implementations usable on this host against OpenSSL, then exit",
 	"This text",
 	NULL
 };
 
+/* I/O mode names for the -m option */
+const char* io_mode_names[] =
+{
+	"buffer",
+	"stream",
+	"mmap",
+	"uring",
+	"pipeline",
+	NULL
+};
+
+/* Digest names for the -d option, index is the DIGEST_* mask - 1 */
+const char* digest_names[] =
+{
+	"plain",
+	"cipher",
+	"both",
+	NULL
+};
+
 /*********************************
 	Globals
  ********************************/
 
 uint8_t qspi_base_addr[4] = "\xC0\x00\x00\x00";
 
+/* Image output with -o -, stdout itself then goes to stderr */
+static int data_out_fd = STDOUT_FILENO;
+
 static const unsigned char test_key[16] =
 {
 	0x00, 0x01, 0x02, 0x03, // key_w0
@@ -89,10 +293,8 @@ static const unsigned char test_key[16] =
 	0x0c, 0x0d, 0x0e, 0x0f, // key_w3
 };
 
-static unsigned char test_ctr[16] =
+static const unsigned char test_ctr[8] =
 {
 	0x01, 0x23, 0x45, 0x67, // ctr_w0
 	0x89, 0xab, 0xcd, 0xef, // ctr_w1
-	0x88, 0x88, 0x88, 0x88, // XOR(ctr_w0, ctr_w1)
-	0xC0, 0x00, 0x10, 0x00, //systemAddress [31...4],0000h + 0x1000 offset
 };
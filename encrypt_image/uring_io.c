@@ -0,0 +1,286 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring_io.h"
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+
+/*
+ * Description : Sets up an io_uring instance and maps its rings
+ *
+ * @Inputs  : ring    - Ring to set up
+ *            entries - Submission queue size
+ *
+ * @Outputs : return 0 on success, negated errno on failure
+ *
+ */
+int uring_init(struct uring *ring, unsigned int entries)
+{
+	struct io_uring_params p;
+	uint8_t *sq_ring;
+	uint8_t *cq_ring;
+	int err;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&p, 0, sizeof(p));
+	ring->sq_ring = MAP_FAILED;
+	ring->cq_ring = MAP_FAILED;
+	ring->sqes = MAP_FAILED;
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0) {
+		return -errno;
+	}
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		/* Both rings share one mapping */
+		if (ring->cq_ring_size > ring->sq_ring_size) {
+			ring->sq_ring_size = ring->cq_ring_size;
+		}
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		goto err;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+				     MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			goto err;
+		}
+	}
+
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		goto err;
+	}
+
+	sq_ring = ring->sq_ring;
+	cq_ring = ring->cq_ring;
+	ring->sq_head = (unsigned int *)(sq_ring + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)(sq_ring + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *)(sq_ring + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)(sq_ring + p.sq_off.array);
+	ring->cq_head = (unsigned int *)(cq_ring + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)(cq_ring + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *)(cq_ring + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq_ring + p.cq_off.cqes);
+	ring->sq_entries = p.sq_entries;
+	ring->sq_local_tail = *ring->sq_tail;
+
+	return 0;
+err:
+	err = -errno;
+	uring_exit(ring);
+
+	return err;
+}
+
+/*
+ * Description : Unmaps the rings and closes the io_uring instance, which
+ *               also releases the registered buffers
+ *
+ * @Inputs  : ring - Ring set up by uring_init
+ */
+void uring_exit(struct uring *ring)
+{
+	if (ring->sqes != MAP_FAILED && ring->sqes != NULL) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+	if (ring->cq_ring != MAP_FAILED && ring->cq_ring != NULL &&
+	    ring->cq_ring != ring->sq_ring) {
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+	if (ring->sq_ring != MAP_FAILED && ring->sq_ring != NULL) {
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	}
+	if (ring->fd >= 0) {
+		close(ring->fd);
+	}
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+}
+
+/*
+ * Description : Registers I/O buffers with the kernel, so they are pinned
+ *               once instead of on every request. Later requests on a
+ *               registered buffer use the fixed buffer opcodes.
+ *
+ * @Inputs  : ring - Ring
+ *            iov  - Buffers
+ *            n    - Number of buffers
+ *
+ * @Outputs : return 0 on success, negated errno on failure (e.g. above
+ *            RLIMIT_MEMLOCK), in which case plain requests are used
+ *
+ */
+int uring_register_buffers(struct uring *ring, const struct iovec *iov, unsigned int n)
+{
+	if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iov, n) < 0) {
+		return -errno;
+	}
+	ring->fixed_buffers = 1;
+
+	return 0;
+}
+
+/*
+ * Description : Queues a read or write request, submitted by the next
+ *               uring_submit
+ *
+ * @Inputs  : ring      - Ring
+ *            write     - 0 to read, 1 to write
+ *            fd        - File descriptor
+ *            buf       - Buffer
+ *            len       - Number of bytes
+ *            off       - File offset
+ *            buf_index - Index of buf in the registered buffers
+ *            user_data - Returned with the completion
+ *
+ * @Outputs : return 0 on success, -EBUSY if the submission queue is full
+ *
+ */
+int uring_queue_rw(struct uring *ring, int write, int fd, void *buf, unsigned int len,
+		   uint64_t off, int buf_index, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	unsigned int idx;
+
+	if (ring->sq_local_tail - head >= ring->sq_entries) {
+		return -EBUSY;
+	}
+
+	idx = ring->sq_local_tail & *ring->sq_mask;
+	sqe = &ring->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	if (ring->fixed_buffers) {
+		sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		sqe->buf_index = buf_index;
+	} else {
+		sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+	}
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->user_data = user_data;
+
+	ring->sq_array[idx] = idx;
+	ring->sq_local_tail++;
+	ring->to_submit++;
+
+	return 0;
+}
+
+/*
+ * Description : Submits the queued requests and waits for completions
+ *
+ * @Inputs  : ring    - Ring
+ *            wait_nr - Number of completions to wait for (0: don't wait)
+ *
+ * @Outputs : return 0 on success, negated errno on failure
+ *
+ */
+int uring_submit(struct uring *ring, unsigned int wait_nr)
+{
+	int ret;
+
+	/* Publish the new entries before the kernel reads the tail */
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+	do {
+		ret = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait_nr,
+			      wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0) {
+		return -errno;
+	}
+	ring->to_submit -= ret;
+
+	return 0;
+}
+
+/*
+ * Description : Takes the next completion, if any
+ *
+ * @Inputs  : ring      - Ring
+ *            user_data - user_data of the request
+ *            res       - Result of the request (byte count or negated errno)
+ *
+ * @Outputs : return 1 if a completion was taken, 0 if none is pending
+ *
+ */
+int uring_peek_cqe(struct uring *ring, uint64_t *user_data, int *res)
+{
+	unsigned int head = *ring->cq_head;
+	struct io_uring_cqe *cqe;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
+
+	cqe = &ring->cqes[head & *ring->cq_mask];
+	*user_data = cqe->user_data;
+	*res = cqe->res;
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+#else
+
+int uring_init(struct uring *ring, unsigned int entries)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+
+	return -ENOSYS;
+}
+
+void uring_exit(struct uring *ring)
+{
+}
+
+int uring_register_buffers(struct uring *ring, const struct iovec *iov, unsigned int n)
+{
+	return -ENOSYS;
+}
+
+int uring_queue_rw(struct uring *ring, int write, int fd, void *buf, unsigned int len,
+		   uint64_t off, int buf_index, uint64_t user_data)
+{
+	return -ENOSYS;
+}
+
+int uring_submit(struct uring *ring, unsigned int wait_nr)
+{
+	return -ENOSYS;
+}
+
+int uring_peek_cqe(struct uring *ring, uint64_t *user_data, int *res)
+{
+	return 0;
+}
+
+#endif /* HAVE_IO_URING */
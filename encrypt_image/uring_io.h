@@ -0,0 +1,54 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef URING_IO_H
+#define URING_IO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING   1
+#endif
+#endif
+
+/* Alignment of O_DIRECT offsets, lengths and buffers */
+#define DIO_ALIGN               4096
+
+/* Minimal io_uring instance, set up through the raw system calls */
+struct uring {
+	int fd;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_ring_size;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	unsigned int sq_entries;
+	unsigned int sq_local_tail;
+	unsigned int to_submit;
+	int fixed_buffers;
+};
+
+int uring_init(struct uring *ring, unsigned int entries);
+void uring_exit(struct uring *ring);
+int uring_register_buffers(struct uring *ring, const struct iovec *iov, unsigned int n);
+int uring_queue_rw(struct uring *ring, int write, int fd, void *buf, unsigned int len,
+		   uint64_t off, int buf_index, uint64_t user_data);
+int uring_submit(struct uring *ring, unsigned int wait_nr);
+int uring_peek_cqe(struct uring *ring, uint64_t *user_data, int *res);
+
+#endif /* URING_IO_H */
@@ -6,41 +6,6 @@
 
 #include "key_scrambler.h"
 
-/*
- * Description : This function scrambles the input OTFAD key
- *
- * @Inputs  : otfad_key - OTFAD Key encryption key
- *            key_scramble - Input key scramble
- *            key_scramble_align - Input key scramble align
- *
- * @Outputs : scrambled_kek - Scrambled OTFAD key encryption key
- *
- */
-unsigned char *scramble_otfad_key(unsigned char *otfad_key, unsigned char *key_scramble, uint8_t key_scramble_align, int ctx_sel)
-{
-	unsigned char *scrambled_kek = NULL;
-	int i = 0, j = 0, k = 0;
-
-	scrambled_kek = malloc(OTFAD_KEY_SIZE);
-	memcpy(scrambled_kek, otfad_key, OTFAD_KEY_SIZE);
-
-	/*
-	 * retrieve the 2‐bit align select from the 8‐bit key_scramble_align
-	 * context_0_select = key_scramble_align[1:0]
-	 * context_1_select = key_scramble_align[3:2]
-	 * context_2_select = key_scramble_align[5:4]
-	 * context_3_select = key_scramble_align[7:6]
-	 */
-	j = 2 * ctx_sel;
-	k = ((key_scramble_align & (3 << j)) >> j);
-	/* XOR 4‐byte key_scramble[] into appropriate 4‐bytes of scrambled_kek[] output */
-	for (i = 0; i < 4; i++) {
-		scrambled_kek[4*k + i] ^= key_scramble[i];
-	}
-
-	return &scrambled_kek[0];
-}
-
 /*
  * Description : This function reads the input file and returns size
  *
@@ -99,10 +64,9 @@ static unsigned char *alloc_buffer(FILE *fp, char *input_file, int check_size)
 		return NULL;
 	}
 
-	/* Allocate memory to the buffer */
-	buff = malloc(file_size);
-	if (buff == NULL || buff == 0) {
-		fprintf(stderr, "Error allocating memory; %s\n", strerror(errno));
+	/* Allocate memory to the buffer, cleared when freed */
+	if (otfad_buf_alloc(file_size, OTFAD_BUF_SECRET, (void **)&buff)) {
+		fprintf(stderr, "Error allocating memory; %s\n", strerror(ENOMEM));
 		return NULL;
 	}
 
@@ -110,6 +74,7 @@ static unsigned char *alloc_buffer(FILE *fp, char *input_file, int check_size)
 	result = fread(buff,1,file_size,fp);
 	if (result != file_size) {
 		fprintf(stderr, "File read error; %s\n", strerror(errno));
+		BUF_FREE(buff);
 		return NULL;
 	}
 	FCLOSE(fp);
@@ -224,11 +189,14 @@ int main (int argc, char **argv)
 	unsigned char *in_key_scramble = NULL;
 	uint8_t in_key_scramble_align = 0;
 	int context = 0;
-	unsigned char *otfad_scrambled_key = NULL;
+	uint8_t otfad_scrambled_key[OTFAD_KEY_SIZE];
 	char *output_fname = NULL;
 
-	int i = 0;
 	int next_opt = 0;
+	int err = 0;
+#if DEBUG
+	int i = 0;
+#endif
 
 	if (argc != 1) {
 		handle_cli(argc, argv);
@@ -301,23 +269,10 @@ int main (int argc, char **argv)
 	printf("\nKey Scramble Align: %02X", in_key_scramble_align);
 #endif
 
-	/*
-	 * According to OTFAD engine's integration with 7ULP
-	 * the Scramble Key needs to be bit reversed at byte level.
-	 */
-	for (i = 0; i < KEY_SCRAMBLE_SIZE; i++) {
-		BIT_REVERSE8(in_key_scramble[i]);
-	}
-
-#if DEBUG
-	printf("\nKey Scramble (After bit reversal): ");
-	for (i = 0; i < KEY_SCRAMBLE_SIZE; i++) {
-		printf("%02X", in_key_scramble[i]);
-	}
-#endif
-	otfad_scrambled_key = scramble_otfad_key(in_otfad_key, in_key_scramble, in_key_scramble_align, context);
-	if(otfad_scrambled_key == NULL) {
-		printf("Error: Key Scrambling failed\n");
+	/* The Scramble Key is bit reversed at byte level by otfad_key_scramble */
+	err = otfad_key_scramble(in_otfad_key, in_key_scramble, in_key_scramble_align, context, otfad_scrambled_key);
+	if (err) {
+		printf("Error: Key Scrambling failed; %s\n", otfad_strerror(err));
 		goto err;
 	}
 
@@ -348,8 +303,8 @@ int main (int argc, char **argv)
 		}
 		printf("\n");
 #endif
-		FREE(in_otfad_key);
-		FREE(in_key_scramble);
+		BUF_FREE(in_otfad_key);
+		BUF_FREE(in_key_scramble);
 		FCLOSE(fp_out);
 	}
 
@@ -357,12 +312,13 @@ int main (int argc, char **argv)
 		printf("OTFAD Scrambled Key generated: %s\n", output_fname);
 	}
 
-	FREE(otfad_scrambled_key);
 	return EXIT_SUCCESS;
 err:
-	FREE(in_otfad_key);
-	FREE(in_key_scramble);
-	FREE(otfad_scrambled_key);
+	/* The test sequence uses the static test keys */
+	if (argc != 1) {
+		BUF_FREE(in_otfad_key);
+		BUF_FREE(in_key_scramble);
+	}
 	FCLOSE(fp_out);
 	return EXIT_FAILURE;
 }
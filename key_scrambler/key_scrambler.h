@@ -14,18 +14,16 @@
 #include <errno.h>
 #include <getopt.h>
 
+#include "otfad.h"
 
-#define OTFAD_KEY_SIZE          16
-#define KEY_SCRAMBLE_SIZE       4
+#define KEY_SCRAMBLE_SIZE       OTFAD_KEY_SCRAMBLE_SIZE
 #define KEY_SCRAMBLE_ALIGN_MASK 0xFF
 #define BASE_HEX                16
-#define NUM_CONTEXT             4
 
-#define FREE(x)         do { \
-				if(x != NULL) { \
-					free(x); \
-					x = NULL; \
-				} \
+/* Frees a buffer of the libotfad buffer pool */
+#define BUF_FREE(x)     do { \
+				otfad_buf_free(x); \
+				x = NULL; \
 			} while(0)
 
 #define FCLOSE(x)         do { \
@@ -35,12 +33,6 @@
 				} \
 			} while(0)
 
-#define BIT_REVERSE8(x) do {   \
-				x = ((x & 0x55) << 1) | ((x & 0xAA) >> 1);  \
-				x = ((x & 0x33) << 2) | ((x & 0xCC) >> 2);  \
-				x = ((x & 0x0F) << 4) | ((x & 0xF0) >> 4);  \
-			 } while(0)
-
 /************************
 	Command line arguments
 ************************/
@@ -69,8 +61,6 @@ const char* opt_desc[] =
 	NULL
 };
 
-unsigned char *do_aes128_key_wrap(unsigned char *, unsigned char *);
-
 /* OTFAD Key to be burned in Fuse */
 static const unsigned char test_otfad_key[OTFAD_KEY_SIZE] =
 {
@@ -5,33 +5,6 @@
  */
 
 #include "key_wrap.h"
-#include "compute_crc32.h"
-#include "aes128_key_wrap.h"
-
-/*
- * Description : This function calls aes128_key_wrap function with input
- *               parameters
- * @input  : plaintext  - Plaintext
- *           iv         - Initialization Vector
- *           kek        - Key Encrpytion Key
- * @output : ciphertext - Ciphertext
- *
- */
-unsigned char *do_aes128_key_wrap(unsigned char *in_plaintext, unsigned char *in_kek)
-{
-        static unsigned char *wrapped_ciphertext;
-
-        wrapped_ciphertext = aes128_key_wrap(in_plaintext, iv, in_kek);
-
-#if DEBUG
-        int i;
-        printf("\nCiphertext: ");
-        for (i = 0; i < MAX_CT_SIZE; i++)
-                printf("%02X", wrapped_ciphertext[i]);
-#endif
-
-        return &wrapped_ciphertext[0];
-}
 
 /*
  * Description : This function reads the input file and returns size
@@ -91,10 +64,9 @@ static unsigned char *alloc_buffer(FILE *fp, char *input_file, int check_size)
                 return NULL;
         }
 
-        /* Allocate memory to the buffer */
-        buff = malloc(file_size);
-        if (buff == NULL || buff == 0) {
-                fprintf(stderr, "Error allocating memory; %s\n", strerror(errno));
+        /* Allocate memory to the buffer, cleared when freed */
+        if (otfad_buf_alloc(file_size, OTFAD_BUF_SECRET, (void **)&buff)) {
+                fprintf(stderr, "Error allocating memory; %s\n", strerror(ENOMEM));
                 return NULL;
         }
 
@@ -102,6 +74,7 @@ static unsigned char *alloc_buffer(FILE *fp, char *input_file, int check_size)
         result = fread(buff,1,file_size,fp);
         if (result != file_size) {
                 fprintf(stderr, "File read error; %s\n", strerror(errno));
+                BUF_FREE(buff);
                 return NULL;
         }
         FCLOSE(fp);
@@ -214,20 +187,22 @@ int main (int argc, char **argv)
         FILE *fp_in = NULL;
         FILE *fp_out = NULL;
 
-        unsigned char *unwrapped_plaintext = NULL;
+        uint8_t plaintext[MAX_PT_SIZE];
+        const uint8_t *unwrapped_plaintext = NULL;
         unsigned char *in_otfad_key = NULL;
-        unsigned char *aes_key_wrap = NULL;
+        uint8_t key_blob[KEY_BLOB_SIZE];
         uint8_t *in_enc_key = NULL;
         uint8_t *in_counter = NULL;
         uint32_t start_addr = 0;
         uint32_t end_addr = 0;
-        uint32_t crc32 = 0;
+        int err = 0;
 
-        uint32_t temp[4] = {0};
         int vld = 0; //Valid bit
         char *output_fname = NULL;
-        int i = 0;
         int next_opt = 0;
+#if DEBUG
+        int i = 0;
+#endif
 
         if (argc != 1) {
                 handle_cli(argc, argv);
@@ -265,12 +240,11 @@ int main (int argc, char **argv)
                                 break;
                         /* Start Address */
                         case 's':
-                                /* Least Significant 9 bits are reserved as 0 */
-                                start_addr = (strtol(optarg, NULL, 16) & SRT_ADDR_MASK);
+                                start_addr = strtol(optarg, NULL, 16);
                                 break;
                         /* End Address */
                         case 'e':
-                                end_addr = (strtol(optarg, NULL, 16) & END_ADDR_MASK) | END_ADDR_RSVD | RO | ADE;
+                                end_addr = strtol(optarg, NULL, 16);
                                 break;
                         /* Valid bit */
                         case 'v':
@@ -291,33 +265,23 @@ int main (int argc, char **argv)
                         }
                 } while (next_opt != -1);
 
-                /* Append Valid bit to End address */
-                end_addr = end_addr | (vld << CTX_RGD_W_VLD_SHIFT);
-
-                /* Prepare plaintext */
-                /* key + ctr +
-                 * rgd_w0 <-- start_addr +
-                 * rgd_w1 <-- end_addr + AES decryption enabled + valid context
-                 * crc_w0 <-- CRC Filler
-                 * crc_w1 <-- Calculated CRC
-                 */
-                unwrapped_plaintext = malloc(MAX_PT_SIZE);
-                memcpy(unwrapped_plaintext, in_enc_key, AES_KEY_SIZE);
-                memcpy(unwrapped_plaintext + AES_KEY_SIZE, in_counter, CTR_SIZE);
-                *(uint32_t *)&unwrapped_plaintext[AES_KEY_SIZE + CTR_SIZE] = start_addr;
-                *(uint32_t *)&unwrapped_plaintext[AES_KEY_SIZE + CTR_SIZE + 4] = end_addr;
-                *(uint32_t *)&unwrapped_plaintext[AES_KEY_SIZE + CTR_SIZE + 8] = CRC32_FILLER;
-
-                crc32 = compute_crc32(unwrapped_plaintext, 32);
-
-                *(uint32_t *)&unwrapped_plaintext[AES_KEY_SIZE + CTR_SIZE + 12] = crc32;
-                FREE(in_enc_key);
-                FREE(in_counter);
+                /* Prepare plaintext: key + ctr + region descriptor + CRC */
+                err = otfad_keyblob_plaintext(in_enc_key, in_counter, start_addr, end_addr, vld, plaintext);
+                if (err) {
+                        printf("Error: Key Blob plaintext: %s\n", otfad_strerror(err));
+                        goto err;
+                }
+                unwrapped_plaintext = plaintext;
+                BUF_FREE(in_enc_key);
+                BUF_FREE(in_counter);
 
 #if DEBUG
+                memcpy(&start_addr, &plaintext[AES_KEY_SIZE + CTR_SIZE], 4);
+                memcpy(&end_addr, &plaintext[AES_KEY_SIZE + CTR_SIZE + 4], 4);
                 printf("Start Address = 0x%08X\n", start_addr);
                 printf("End Address = 0x%08X\n", end_addr);
-                printf("CRC32 = 0x%08X\n", crc32);
+                printf("CRC32 = 0x%02X%02X%02X%02X\n", plaintext[MAX_PT_SIZE - 1], plaintext[MAX_PT_SIZE - 2],
+                       plaintext[MAX_PT_SIZE - 3], plaintext[MAX_PT_SIZE - 4]);
 #endif
         }
         else {
@@ -325,65 +289,35 @@ int main (int argc, char **argv)
                 /* Standard output selected*/
                 fp_out = stdout;
                 in_otfad_key = (unsigned char *)test_otfad_key;
-                unwrapped_plaintext = (unsigned char *)test_pt;
+                unwrapped_plaintext = test_pt;
         }
 
-        /* Wrap the Image Encryption key */
-        aes_key_wrap = do_aes128_key_wrap(unwrapped_plaintext, in_otfad_key);
-        if(aes_key_wrap == NULL) {
-                printf("Error: Key Wrapping failed\n");
+        /* Wrap the Image Encryption key into the Key Blob */
+        err = otfad_keyblob_wrap(unwrapped_plaintext, in_otfad_key, key_blob);
+        if (err) {
+                printf("Error: Key Wrapping failed; %s\n", otfad_strerror(err));
+                ERR_print_errors_fp(stderr);
                 goto err;
         }
 
-        /*
-         *  For MX7ULP:
-         *  1. Post swap needed, given otfad_io will do the bytes swap within every
-         *     64bits wrapped data before send them to aes engine.
-         *  2. otp_key[127:0] should be byte reversed compared with KEK string.
-         *     For example, KEK=00112233445566778899AABBCCDDEEFF, the otp_key should be:
-         *     otp_key[127:0] = 128'h33221100_77665544_BBAA9988_FFEEDDCC
-         */
-        for (i = 0; i < MAX_CT_SIZE; i += 16) {
-                memcpy(temp, &aes_key_wrap[i], 16);
-                temp[0] = __builtin_bswap32(temp[0]);
-                temp[1] = __builtin_bswap32(temp[1]);
-                temp[2] = __builtin_bswap32(temp[2]);
-                temp[3] = __builtin_bswap32(temp[3]);
-                SWAP32(temp[0], temp[1]);
-                SWAP32(temp[2], temp[3]);
-                memcpy(&aes_key_wrap[i], temp, 16);
-        }
-
         /* stdout selected for test mode */
         if (argc == 1) {
 #if DEBUG
                 printf("\nOutput Key Blob:");
-                for (i = 0; i < MAX_CT_SIZE; i++) {
-                        printf("%02X", aes_key_wrap[i]);
-                }
-
-                for (i = 0; i < PAD_SIZE; i++) {
-                        printf("%s","00");
+                for (i = 0; i < KEY_BLOB_SIZE; i++) {
+                        printf("%02X", key_blob[i]);
                 }
                 printf("\n");
 #endif
         }
         /* Key blob output written to the output file */
         else {
-                /* Write ciphertext to file */
-                if(MAX_CT_SIZE != fwrite((const char *)aes_key_wrap, 1, MAX_CT_SIZE, fp_out)) {
+                /* Write key blob, padded to 0x40, to file */
+                if(KEY_BLOB_SIZE != fwrite((const char *)key_blob, 1, KEY_BLOB_SIZE, fp_out)) {
                         printf("Error: File write failed\n");
                         goto err;
                 }
 
-                /* Pad file to 0x40 */
-                i = PAD_SIZE;
-                while(i) {
-                        fputc(0, fp_out);
-                        i--;
-                }
-
-
 #if DEBUG
                 /* Go to the beginning of the output file to print its contents */
                 rewind(fp_out);
@@ -395,16 +329,15 @@ int main (int argc, char **argv)
                         c = fgetc(fp_out);
                         fprintf(stdout,"%02X", c);
                         i++;
-                } while(c != EOF && i < (MAX_CT_SIZE + PAD_SIZE));
+                } while(c != EOF && i < KEY_BLOB_SIZE);
                 printf("\n");
 #endif
 
-                FREE(unwrapped_plaintext);
                 FCLOSE(fp_out);
         }
 
         if (argc != 1) {
-                FREE(in_otfad_key);
+                BUF_FREE(in_otfad_key);
         }
 
         if (output_fname != NULL) {
@@ -413,10 +346,12 @@ int main (int argc, char **argv)
 
         return EXIT_SUCCESS;
 err:
-        FREE(unwrapped_plaintext);
-        FREE(in_enc_key);
-        FREE(in_counter);
-        FREE(in_otfad_key);
+        BUF_FREE(in_enc_key);
+        BUF_FREE(in_counter);
+        /* The test sequence uses the static test key */
+        if (argc != 1) {
+                BUF_FREE(in_otfad_key);
+        }
         FCLOSE(fp_in);
         FCLOSE(fp_out);
 
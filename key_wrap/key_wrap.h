@@ -15,37 +15,20 @@
 #include <getopt.h>
 
 /* OpenSSL includes*/
-#include <openssl/rand.h>
-#include <openssl/bio.h>
-#include <openssl/evp.h>
 #include <openssl/err.h>
 
-#define OTFAD_KEY_SIZE          16
+#include "otfad.h"
+
 #define AES_KEY_SIZE            16
-#define IV_SIZE                 8
 #define CTR_SIZE                8
-#define MAX_PT_SIZE             40
-#define MAX_CT_SIZE             48
-#define PAD_SIZE                16
-#define CRC32_FILLER            0x00000000
+#define MAX_PT_SIZE             OTFAD_KEYBLOB_PT_SIZE
+#define KEY_BLOB_SIZE           OTFAD_KEYBLOB_SIZE
 #define BASE_HEX                16
-// #define NUM_CONTEXT             4
-
-/* Region descriptor defines */
-#define CTX_RGD_W_RO_SHIFT      2
-#define CTX_RGD_W_ADE_SHIFT     1
-#define CTX_RGD_W_VLD_SHIFT     0
-#define RO                      0x0 << CTX_RGD_W_RO_SHIFT
-#define ADE                     0x1 << CTX_RGD_W_ADE_SHIFT
-#define SRT_ADDR_MASK           0xFFFFFC00
-#define END_ADDR_MASK           0xFFFFFFF8
-#define END_ADDR_RSVD           0x3F8
 
-#define FREE(x)         do { \
-                                if(x != NULL) { \
-                                        free(x); \
-                                        x = NULL; \
-                                } \
+/* Frees a buffer of the libotfad buffer pool */
+#define BUF_FREE(x)     do { \
+                                otfad_buf_free(x); \
+                                x = NULL; \
                         } while(0)
 
 #define FCLOSE(x)         do { \
@@ -55,8 +38,6 @@
                                 } \
                         } while(0)
 
-#define SWAP32(a, b)    do{unsigned int tmp; tmp=a; a=b; b=tmp;}while(0)
-
 /************************
         Command line arguments
 ************************/
@@ -90,8 +71,6 @@ const char* opt_desc[] =
         NULL
 };
 
-unsigned char *do_aes128_key_wrap(unsigned char *, unsigned char *);
-
 /* OTFAD Key to be burned in Fuse */
 static const unsigned char test_otfad_key[OTFAD_KEY_SIZE] =
 {
@@ -99,11 +78,6 @@ static const unsigned char test_otfad_key[OTFAD_KEY_SIZE] =
         0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
 };
 
-/* IV is constant as per RFC3394 */
-static unsigned char iv[IV_SIZE] = {
-        0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6
-};
-
 static const unsigned char test_pt[MAX_PT_SIZE] =
 {
         0x00, 0x01, 0x02, 0x03, // key_w0
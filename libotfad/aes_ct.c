@@ -0,0 +1,496 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+
+/* OpenSSL includes*/
+#include <openssl/crypto.h>
+
+#include "otfad.h"
+#include "otfad_swap.h"
+#include "aes_ct.h"
+
+/*
+ * Bitsliced AES-128, for hosts without AES-NI. The state of 8 blocks is held
+ * in 8 bit planes (see aes_ct_word) and every step is a fixed sequence of
+ * logic operations and shifts: there are no table lookups nor branches
+ * depending on the key or the data, so the timing is constant. The S-box is
+ * the circuit of Boyar and Peralta (113 gates); ShiftRows and MixColumns
+ * move whole bytes of the planes.
+ */
+
+/* Bytes of each column in row r of a plane */
+#define AES_CT_ROW(r)   ((aes_ct_word){0xFFu << (8 * (r)), 0xFFu << (8 * (r)), \
+					   0xFFu << (8 * (r)), 0xFFu << (8 * (r))})
+
+static const uint8_t rcon[AES_CT_ROUNDS] = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36
+};
+
+/*
+ * Description : Applies the AES S-box to every byte of the bit planes
+ *
+ * @Inputs  : q - Bit planes, q[i] holding bit i of the bytes
+ */
+static void aes_ct_sbox(aes_ct_word *q)
+{
+	aes_ct_word x0, x1, x2, x3, x4, x5, x6, x7;
+	aes_ct_word y1, y2, y3, y4, y5, y6, y7, y8, y9;
+	aes_ct_word y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+	aes_ct_word y20, y21;
+	aes_ct_word z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+	aes_ct_word z10, z11, z12, z13, z14, z15, z16, z17;
+	aes_ct_word t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+	aes_ct_word t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+	aes_ct_word t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+	aes_ct_word t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+	aes_ct_word t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+	aes_ct_word t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+	aes_ct_word t60, t61, t62, t63, t64, t65, t66, t67;
+	aes_ct_word s0, s1, s2, s3, s4, s5, s6, s7;
+
+	x0 = q[7];
+	x1 = q[6];
+	x2 = q[5];
+	x3 = q[4];
+	x4 = q[3];
+	x5 = q[2];
+	x6 = q[1];
+	x7 = q[0];
+
+	/* Top linear transformation */
+	y14 = x3 ^ x5;
+	y13 = x0 ^ x6;
+	y9 = x0 ^ x3;
+	y8 = x0 ^ x5;
+	t0 = x1 ^ x2;
+	y1 = t0 ^ x7;
+	y4 = y1 ^ x3;
+	y12 = y13 ^ y14;
+	y2 = y1 ^ x0;
+	y5 = y1 ^ x6;
+	y3 = y5 ^ y8;
+	t1 = x4 ^ y12;
+	y15 = t1 ^ x5;
+	y20 = t1 ^ x1;
+	y6 = y15 ^ x7;
+	y10 = y15 ^ t0;
+	y11 = y20 ^ y9;
+	y7 = x7 ^ y11;
+	y17 = y10 ^ y11;
+	y19 = y10 ^ y8;
+	y16 = t0 ^ y11;
+	y21 = y13 ^ y16;
+	y18 = x0 ^ y16;
+
+	/* Non-linear section: inversion in GF(2^4)^2 */
+	t2 = y12 & y15;
+	t3 = y3 & y6;
+	t4 = t3 ^ t2;
+	t5 = y4 & x7;
+	t6 = t5 ^ t2;
+	t7 = y13 & y16;
+	t8 = y5 & y1;
+	t9 = t8 ^ t7;
+	t10 = y2 & y7;
+	t11 = t10 ^ t7;
+	t12 = y9 & y11;
+	t13 = y14 & y17;
+	t14 = t13 ^ t12;
+	t15 = y8 & y10;
+	t16 = t15 ^ t12;
+	t17 = t4 ^ t14;
+	t18 = t6 ^ t16;
+	t19 = t9 ^ t14;
+	t20 = t11 ^ t16;
+	t21 = t17 ^ y20;
+	t22 = t18 ^ y19;
+	t23 = t19 ^ y21;
+	t24 = t20 ^ y18;
+
+	t25 = t21 ^ t22;
+	t26 = t21 & t23;
+	t27 = t24 ^ t26;
+	t28 = t25 & t27;
+	t29 = t28 ^ t22;
+	t30 = t23 ^ t24;
+	t31 = t22 ^ t26;
+	t32 = t31 & t30;
+	t33 = t32 ^ t24;
+	t34 = t23 ^ t33;
+	t35 = t27 ^ t33;
+	t36 = t24 & t35;
+	t37 = t36 ^ t34;
+	t38 = t27 ^ t36;
+	t39 = t29 & t38;
+	t40 = t25 ^ t39;
+
+	t41 = t40 ^ t37;
+	t42 = t29 ^ t33;
+	t43 = t29 ^ t40;
+	t44 = t33 ^ t37;
+	t45 = t42 ^ t41;
+	z0 = t44 & y15;
+	z1 = t37 & y6;
+	z2 = t33 & x7;
+	z3 = t43 & y16;
+	z4 = t40 & y1;
+	z5 = t29 & y7;
+	z6 = t42 & y11;
+	z7 = t45 & y17;
+	z8 = t41 & y10;
+	z9 = t44 & y12;
+	z10 = t37 & y3;
+	z11 = t33 & y4;
+	z12 = t43 & y13;
+	z13 = t40 & y5;
+	z14 = t29 & y2;
+	z15 = t42 & y9;
+	z16 = t45 & y14;
+	z17 = t41 & y8;
+
+	/* Bottom linear transformation */
+	t46 = z15 ^ z16;
+	t47 = z10 ^ z11;
+	t48 = z5 ^ z13;
+	t49 = z9 ^ z10;
+	t50 = z2 ^ z12;
+	t51 = z2 ^ z5;
+	t52 = z7 ^ z8;
+	t53 = z0 ^ z3;
+	t54 = z6 ^ z7;
+	t55 = z16 ^ z17;
+	t56 = z12 ^ t48;
+	t57 = t50 ^ t53;
+	t58 = z4 ^ t46;
+	t59 = z3 ^ t54;
+	t60 = t46 ^ t57;
+	t61 = z14 ^ t57;
+	t62 = t52 ^ t58;
+	t63 = t49 ^ t58;
+	t64 = z4 ^ t59;
+	t65 = t61 ^ t62;
+	t66 = z1 ^ t63;
+	s0 = t59 ^ t63;
+	s6 = t56 ^ ~t62;
+	s7 = t48 ^ ~t60;
+	t67 = t64 ^ t65;
+	s3 = t53 ^ t66;
+	s4 = t51 ^ t66;
+	s5 = t47 ^ t65;
+	s1 = t64 ^ ~s3;
+	s2 = t55 ^ ~t67;
+
+	q[7] = s0;
+	q[6] = s1;
+	q[5] = s2;
+	q[4] = s3;
+	q[3] = s4;
+	q[2] = s5;
+	q[1] = s6;
+	q[0] = s7;
+}
+
+/*
+ * Description : ShiftRows: row r of the state is rotated left by r columns
+ *
+ * @Inputs  : q - Bit planes
+ */
+static void aes_ct_shift_rows(aes_ct_word *q)
+{
+	aes_ct_word x;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		x = q[i];
+		q[i] = (x & AES_CT_ROW(0)) |
+		       (__builtin_shuffle(x, (aes_ct_word){1, 2, 3, 0}) & AES_CT_ROW(1)) |
+		       (__builtin_shuffle(x, (aes_ct_word){2, 3, 0, 1}) & AES_CT_ROW(2)) |
+		       (__builtin_shuffle(x, (aes_ct_word){3, 0, 1, 2}) & AES_CT_ROW(3));
+	}
+}
+
+/*
+ * Description : MixColumns: each byte becomes 2.a[r] + 3.a[r+1] + a[r+2] +
+ *               a[r+3] of its column, computed as xtime(a[r] ^ a[r+1]) ^
+ *               a[r+1] ^ (a[r+2] ^ a[r+3])
+ *
+ * @Inputs  : q - Bit planes
+ */
+static void aes_ct_mix_columns(aes_ct_word *q)
+{
+	aes_ct_word r1[8];
+	aes_ct_word s[8];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		/* Row r + 1 of the column, then the sum of rows r and r + 1 */
+		r1[i] = (q[i] >> 8) | (q[i] << 24);
+		s[i] = q[i] ^ r1[i];
+	}
+
+	/* xtime(s): multiplication by x modulo x^8 + x^4 + x^3 + x + 1 */
+	q[0] = s[7];
+	q[1] = s[0] ^ s[7];
+	q[2] = s[1];
+	q[3] = s[2] ^ s[7];
+	q[4] = s[3] ^ s[7];
+	q[5] = s[4];
+	q[6] = s[5];
+	q[7] = s[6];
+
+	for (i = 0; i < 8; i++) {
+		q[i] ^= r1[i] ^ (s[i] >> 16) ^ (s[i] << 16);
+	}
+}
+
+/*
+ * Description : Exchanges the bits selected by mask in b with the bits n
+ *               positions higher in a
+ */
+#define AES_CT_SWAPMOVE(a, b, mask, n)  do { \
+		aes_ct_word t_ = (((a) >> (n)) ^ (b)) & (mask); \
+		(b) ^= t_; \
+		(a) ^= t_ << (n); \
+	} while (0)
+
+#define AES_CT_BYTES(x) ((aes_ct_word){0x01010101u * (x), 0x01010101u * (x), \
+					0x01010101u * (x), 0x01010101u * (x)})
+
+/*
+ * Description : Transposes the 8x8 bit matrix at each byte position of 8
+ *               words: bit i of byte j of word b and bit b of byte j of word
+ *               i are exchanged. This turns 8 blocks into bit planes and
+ *               back.
+ *
+ * @Inputs  : q - Words, transposed in place
+ */
+static void aes_ct_ortho(aes_ct_word *q)
+{
+	AES_CT_SWAPMOVE(q[0], q[1], AES_CT_BYTES(0x55), 1);
+	AES_CT_SWAPMOVE(q[2], q[3], AES_CT_BYTES(0x55), 1);
+	AES_CT_SWAPMOVE(q[4], q[5], AES_CT_BYTES(0x55), 1);
+	AES_CT_SWAPMOVE(q[6], q[7], AES_CT_BYTES(0x55), 1);
+
+	AES_CT_SWAPMOVE(q[0], q[2], AES_CT_BYTES(0x33), 2);
+	AES_CT_SWAPMOVE(q[1], q[3], AES_CT_BYTES(0x33), 2);
+	AES_CT_SWAPMOVE(q[4], q[6], AES_CT_BYTES(0x33), 2);
+	AES_CT_SWAPMOVE(q[5], q[7], AES_CT_BYTES(0x33), 2);
+
+	AES_CT_SWAPMOVE(q[0], q[4], AES_CT_BYTES(0x0F), 4);
+	AES_CT_SWAPMOVE(q[1], q[5], AES_CT_BYTES(0x0F), 4);
+	AES_CT_SWAPMOVE(q[2], q[6], AES_CT_BYTES(0x0F), 4);
+	AES_CT_SWAPMOVE(q[3], q[7], AES_CT_BYTES(0x0F), 4);
+}
+
+/*
+ * Description : Loads 16 bytes, byte j at bits 8 * (j % 4) of element j / 4
+ *               whatever the host byte order
+ */
+static inline aes_ct_word aes_ct_load(const uint8_t *p)
+{
+	aes_ct_word x;
+
+	memcpy(&x, p, sizeof(x));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	x = (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+#endif
+	return x;
+}
+
+/*
+ * Description : Stores 16 bytes loaded by aes_ct_load
+ */
+static inline void aes_ct_store(uint8_t *p, aes_ct_word x)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	x = (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+#endif
+	memcpy(p, &x, sizeof(x));
+}
+
+/*
+ * Description : SubWord of the key schedule, through the bitsliced S-box
+ *
+ * @Inputs  : w - 4 bytes, substituted in place
+ */
+static void aes_ct_sub_word(uint8_t *w)
+{
+	aes_ct_word q[8];
+	uint32_t v;
+	int i, k;
+
+	for (i = 0; i < 8; i++) {
+		v = 0;
+		for (k = 0; k < 4; k++) {
+			v |= (uint32_t)((w[k] >> i) & 1) << k;
+		}
+		q[i] = (aes_ct_word){v, 0, 0, 0};
+	}
+
+	aes_ct_sbox(q);
+
+	for (k = 0; k < 4; k++) {
+		w[k] = 0;
+		for (i = 0; i < 8; i++) {
+			w[k] |= (uint8_t)(((q[i][0] >> k) & 1) << i);
+		}
+	}
+}
+
+/*
+ * Description : Expands an AES-128 key into bitsliced round keys, each byte
+ *               of a round key spread to all the blocks of a batch
+ *
+ * @Inputs  : key - Key
+ *            sk  - Key schedule output
+ */
+void aes_ct_key_setup(const unsigned char *key, struct aes_ct_key *sk)
+{
+	uint8_t rk[(AES_CT_ROUNDS + 1) * 16];
+	uint8_t t[4];
+	uint32_t v[4];
+	int n, i, c, r;
+
+	memcpy(rk, key, 16);
+	for (n = 16; n < (int)sizeof(rk); n += 4) {
+		memcpy(t, rk + n - 4, 4);
+		if (n % 16 == 0) {
+			/* RotWord, SubWord and Rcon */
+			t[0] = rk[n - 3];
+			t[1] = rk[n - 2];
+			t[2] = rk[n - 1];
+			t[3] = rk[n - 4];
+			aes_ct_sub_word(t);
+			t[0] ^= rcon[n / 16 - 1];
+		}
+		for (i = 0; i < 4; i++) {
+			rk[n + i] = rk[n - 16 + i] ^ t[i];
+		}
+	}
+
+	for (n = 0; n <= AES_CT_ROUNDS; n++) {
+		for (i = 0; i < 8; i++) {
+			for (c = 0; c < 4; c++) {
+				v[c] = 0;
+				for (r = 0; r < 4; r++) {
+					v[c] |= (-(uint32_t)((rk[16 * n + 4 * c + r] >> i) & 1) & 0xFF) << (8 * r);
+				}
+			}
+			sk->rk[n][i] = (aes_ct_word){v[0], v[1], v[2], v[3]};
+		}
+	}
+
+	OPENSSL_cleanse(rk, sizeof(rk));
+	OPENSSL_cleanse(t, sizeof(t));
+}
+
+/*
+ * Description : Encrypts AES_CT_BLOCKS blocks in place
+ *
+ * @Inputs  : sk  - Key schedule
+ *            buf - Blocks
+ */
+static void aes_ct_encrypt_batch(const struct aes_ct_key *sk, uint8_t *buf)
+{
+	aes_ct_word q[8];
+	int n, i;
+
+	for (i = 0; i < AES_CT_BLOCKS; i++) {
+		q[i] = aes_ct_load(buf + 16 * i);
+	}
+	aes_ct_ortho(q);
+
+	for (i = 0; i < 8; i++) {
+		q[i] ^= sk->rk[0][i];
+	}
+	for (n = 1; n < AES_CT_ROUNDS; n++) {
+		aes_ct_sbox(q);
+		aes_ct_shift_rows(q);
+		aes_ct_mix_columns(q);
+		for (i = 0; i < 8; i++) {
+			q[i] ^= sk->rk[n][i];
+		}
+	}
+	aes_ct_sbox(q);
+	aes_ct_shift_rows(q);
+	for (i = 0; i < 8; i++) {
+		q[i] ^= sk->rk[AES_CT_ROUNDS][i];
+	}
+
+	aes_ct_ortho(q);
+	for (i = 0; i < AES_CT_BLOCKS; i++) {
+		aes_ct_store(buf + 16 * i, q[i]);
+	}
+}
+
+/*
+ * Description : AES-128 ECB encryption, AES_CT_BLOCKS blocks at a time
+ *
+ * @Inputs  : sk       - Key schedule
+ *            in       - Input blocks
+ *            out      - Output blocks (may be equal to in)
+ *            n_blocks - Number of blocks
+ */
+void aes_ct_encrypt(const struct aes_ct_key *sk, const uint8_t *in, uint8_t *out,
+		    size_t n_blocks)
+{
+	uint8_t buf[AES_CT_BLOCKS * 16];
+	size_t n;
+
+	for (; n_blocks; n_blocks -= n, in += n * 16, out += n * 16) {
+		n = (n_blocks > AES_CT_BLOCKS) ? AES_CT_BLOCKS : n_blocks;
+		memset(buf, 0, sizeof(buf));
+		memcpy(buf, in, n * 16);
+		aes_ct_encrypt_batch(sk, buf);
+		memcpy(out, buf, n * 16);
+	}
+
+	OPENSSL_cleanse(buf, sizeof(buf));
+}
+
+/*
+ * Description : OTFAD AES-128-CTR with the bitsliced AES: the counter blocks
+ *               of AES_CT_BLOCKS consecutive addresses are encrypted at once
+ *               and the keystream is applied in the OTFAD byte order
+ *
+ * @Inputs  : in       - Input data
+ *            out      - Output buffer of size bytes (may be equal to in)
+ *            size     - Input size
+ *            sk       - Key schedule from aes_ct_key_setup
+ *            ctr      - Counter template (bytes 0 to SYS_ADDR_OFFSET - 1 used)
+ *            sys_addr - System Address of the first byte of in
+ */
+void aes_ct_ctr_enc(const uint8_t *in, uint8_t *out, size_t size,
+		    const struct aes_ct_key *sk, const unsigned char *ctr,
+		    uint32_t sys_addr)
+{
+	uint8_t ks[AES_CT_BLOCKS * 16];
+	uint32_t blk_addr;
+	size_t off;
+	size_t len;
+	int b;
+
+	for (off = 0; off < size; off += len) {
+		len = (size - off > sizeof(ks)) ? sizeof(ks) : size - off;
+
+		/* Counter template + big-endian system address of each block */
+		for (b = 0; b < AES_CT_BLOCKS; b++) {
+			blk_addr = sys_addr + (uint32_t)(off + b * 16);
+			memcpy(ks + 16 * b, ctr, OTFAD_SYS_ADDR_OFFSET);
+			ks[16 * b + OTFAD_SYS_ADDR_OFFSET] = (uint8_t)((blk_addr >> 24) & 0xFF);
+			ks[16 * b + OTFAD_SYS_ADDR_OFFSET + 1] = (uint8_t)((blk_addr >> 16) & 0xFF);
+			ks[16 * b + OTFAD_SYS_ADDR_OFFSET + 2] = (uint8_t)((blk_addr >> 8) & 0xFF);
+			ks[16 * b + OTFAD_SYS_ADDR_OFFSET + 3] = (uint8_t)(blk_addr & 0xFF);
+		}
+		aes_ct_encrypt_batch(sk, ks);
+
+		/* Swap the encrypted counters as per OTFAD and XOR them with the input */
+		otfad_swap_xor(out + off, in + off, ks, len);
+	}
+
+	OPENSSL_cleanse(ks, sizeof(ks));
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef AES_CT_H
+#define AES_CT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AES_CT_ROUNDS           10
+/* Number of blocks encrypted at once by the bitsliced kernel */
+#define AES_CT_BLOCKS           8
+
+/*
+ * Bit plane of 8 blocks: byte j of the 128-bit word holds bit i of byte j of
+ * each block (block b in bit b), i.e. element c holds column c of the state
+ */
+typedef uint32_t aes_ct_word __attribute__((vector_size(16)));
+
+/* Bitsliced AES-128 key schedule: 8 bit planes per round key */
+struct aes_ct_key {
+	aes_ct_word rk[AES_CT_ROUNDS + 1][8];
+};
+
+void aes_ct_key_setup(const unsigned char *key, struct aes_ct_key *sk);
+void aes_ct_encrypt(const struct aes_ct_key *sk, const uint8_t *in, uint8_t *out,
+		    size_t n_blocks);
+void aes_ct_ctr_enc(const uint8_t *in, uint8_t *out, size_t size,
+		    const struct aes_ct_key *sk, const unsigned char *ctr,
+		    uint32_t sys_addr);
+
+#endif /* AES_CT_H */
@@ -0,0 +1,496 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+
+#include "aesni_ctr.h"
+#include "otfad_swap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define AESNI_TARGET    __attribute__((target("aes,sse4.1")))
+#define VAES_TARGET     __attribute__((target("aes,sse4.1,vaes,avx512f,avx512bw")))
+/* Keeps the blocks of an interleaved iteration in registers at -O2 */
+#define AESNI_UNROLL    _Pragma("GCC unroll 8")
+
+#define AES128_ROUNDS   10
+
+#define KEY_EXP(k, rcon) aes128_key_exp_step(k, _mm_aeskeygenassist_si128(k, rcon))
+
+/*
+ * Description : One step of the AES-128 key schedule
+ */
+static inline AESNI_TARGET __m128i aes128_key_exp_step(__m128i key, __m128i keygened)
+{
+	keygened = _mm_shuffle_epi32(keygened, _MM_SHUFFLE(3, 3, 3, 3));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, keygened);
+}
+
+/*
+ * Description : Expands the 128-bit key into the 11 round keys
+ */
+static AESNI_TARGET void aes128_key_expand(const unsigned char *key, __m128i *rk)
+{
+	rk[0] = _mm_loadu_si128((const __m128i *)key);
+	rk[1] = KEY_EXP(rk[0], 0x01);
+	rk[2] = KEY_EXP(rk[1], 0x02);
+	rk[3] = KEY_EXP(rk[2], 0x04);
+	rk[4] = KEY_EXP(rk[3], 0x08);
+	rk[5] = KEY_EXP(rk[4], 0x10);
+	rk[6] = KEY_EXP(rk[5], 0x20);
+	rk[7] = KEY_EXP(rk[6], 0x40);
+	rk[8] = KEY_EXP(rk[7], 0x80);
+	rk[9] = KEY_EXP(rk[8], 0x1B);
+	rk[10] = KEY_EXP(rk[9], 0x36);
+}
+
+/*
+ * Description : Builds the OTFAD counter block of the given system address,
+ *               i.e. the counter template with the big-endian address in
+ *               the last word
+ */
+static inline AESNI_TARGET __m128i otfad_ctr_block(__m128i tmpl, uint32_t sys_addr)
+{
+	return _mm_insert_epi32(tmpl, (int)__builtin_bswap32(sys_addr), 3);
+}
+
+/*
+ * Description : Checks through CPUID whether AES-NI (and SSE4.1 used to build
+ *               the counter blocks) is available on the running CPU
+ *
+ * @Outputs : return 1 if the AES-NI kernel can be used, 0 otherwise
+ */
+int aesni_ctr_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse4.1");
+}
+
+/*
+ * Description : Checks through CPUID whether OpenSSL falls back to table
+ *               lookups for AES on the running CPU, i.e. it has neither
+ *               AES-NI nor SSSE3 for the vector permutation AES
+ *
+ * @Outputs : return 1 if OpenSSL AES uses tables, 0 otherwise
+ */
+int aes_tables_used(void)
+{
+	__builtin_cpu_init();
+	return !__builtin_cpu_supports("aes") && !__builtin_cpu_supports("ssse3");
+}
+
+/*
+ * Description : OTFAD AES-128-CTR using AES-NI. AESNI_CTR_BLOCKS counter
+ *               blocks are encrypted at once to hide the AESENC latency, the
+ *               MX7ULP byte order transform (bswap32 each word, then swap
+ *               word pairs) is a single PSHUFB and the keystream is XORed
+ *               with the input in registers.
+ *
+ * @Inputs  : in       - Plaintext to encrypt
+ *            out      - Ciphertext output (may be equal to in)
+ *            size     - Plaintext size
+ *            ks       - Encryption key schedule from aesni_key_setup
+ *            ctr      - Counter template (bytes 0 to SYS_ADDR_OFFSET - 1 used)
+ *            sys_addr - System Address of the first byte of in
+ */
+AESNI_TARGET void aesni_ctr_enc(const uint8_t *in, uint8_t *out, size_t size,
+				const struct aesni_key *ks, const unsigned char *ctr,
+				uint32_t sys_addr)
+{
+	const __m128i swap_mask = _mm_setr_epi8(OTFAD_SWAP_MASK);
+	__m128i rk[AES128_ROUNDS + 1];
+	__m128i tmpl;
+	__m128i b[AESNI_CTR_BLOCKS];
+	uint8_t last[16] = {0};
+	size_t off = 0;
+	int r, k;
+
+	for (r = 0; r <= AES128_ROUNDS; r++) {
+		rk[r] = _mm_load_si128((const __m128i *)ks->rk[r]);
+	}
+	tmpl = _mm_loadu_si128((const __m128i *)ctr);
+
+	for (; size - off >= AESNI_CTR_BLOCKS * 16; off += AESNI_CTR_BLOCKS * 16) {
+		for (k = 0; k < AESNI_CTR_BLOCKS; k++) {
+			b[k] = otfad_ctr_block(tmpl, sys_addr + (uint32_t)(off + k * 16));
+			b[k] = _mm_xor_si128(b[k], rk[0]);
+		}
+		for (r = 1; r < AES128_ROUNDS; r++) {
+			for (k = 0; k < AESNI_CTR_BLOCKS; k++) {
+				b[k] = _mm_aesenc_si128(b[k], rk[r]);
+			}
+		}
+		for (k = 0; k < AESNI_CTR_BLOCKS; k++) {
+			b[k] = _mm_aesenclast_si128(b[k], rk[AES128_ROUNDS]);
+			b[k] = _mm_shuffle_epi8(b[k], swap_mask);
+			b[k] = _mm_xor_si128(b[k], _mm_loadu_si128((const __m128i *)(in + off + k * 16)));
+			_mm_storeu_si128((__m128i *)(out + off + k * 16), b[k]);
+		}
+	}
+
+	/* Remaining blocks, the last one possibly partial */
+	for (; off < size; off += 16) {
+		b[0] = otfad_ctr_block(tmpl, sys_addr + (uint32_t)off);
+		b[0] = _mm_xor_si128(b[0], rk[0]);
+		for (r = 1; r < AES128_ROUNDS; r++) {
+			b[0] = _mm_aesenc_si128(b[0], rk[r]);
+		}
+		b[0] = _mm_aesenclast_si128(b[0], rk[AES128_ROUNDS]);
+		b[0] = _mm_shuffle_epi8(b[0], swap_mask);
+		if (size - off >= 16) {
+			b[0] = _mm_xor_si128(b[0], _mm_loadu_si128((const __m128i *)(in + off)));
+			_mm_storeu_si128((__m128i *)(out + off), b[0]);
+		} else {
+			memcpy(last, in + off, size - off);
+			b[0] = _mm_xor_si128(b[0], _mm_loadu_si128((const __m128i *)last));
+			_mm_storeu_si128((__m128i *)last, b[0]);
+			memcpy(out + off, last, size - off);
+		}
+	}
+}
+
+/*
+ * Description : OTFAD AES-128-CTR of up to AESNI_MULTI_LANES regions, each
+ *               with its own key and counter, using AES-NI. The
+ *               AESNI_CTR_BLOCKS blocks of an iteration are taken round-robin
+ *               from the regions with blocks left, each encrypted with the
+ *               round keys of its region, so the AES pipeline stays full
+ *               even when every region is only a few blocks long.
+ *
+ * @Inputs  : lane    - Regions
+ *            n_lanes - Number of regions, at most AESNI_MULTI_LANES
+ */
+AESNI_TARGET void aesni_ctr_enc_multi(const struct aesni_ctr_lane *lane, int n_lanes)
+{
+	const __m128i swap_mask = _mm_setr_epi8(OTFAD_SWAP_MASK);
+	__m128i rk[AESNI_MULTI_LANES][AES128_ROUNDS + 1];
+	__m128i tmpl[AESNI_MULTI_LANES];
+	size_t pos[AESNI_MULTI_LANES];
+	size_t step[AESNI_MULTI_LANES];
+	int act[AESNI_MULTI_LANES];
+	const __m128i *slot_rk[AESNI_CTR_BLOCKS];
+	const struct aesni_ctr_lane *slot_lane[AESNI_CTR_BLOCKS];
+	size_t slot_pos[AESNI_CTR_BLOCKS];
+	int slot_num[AESNI_CTR_BLOCKS];
+	__m128i b[AESNI_CTR_BLOCKS];
+	uint8_t last[16];
+	size_t len;
+	int n_act;
+	int whole;
+	int l, n, r, k;
+
+	for (l = 0; l < n_lanes; l++) {
+		for (r = 0; r <= AES128_ROUNDS; r++) {
+			rk[l][r] = _mm_load_si128((const __m128i *)lane[l].ks->rk[r]);
+		}
+		tmpl[l] = _mm_loadu_si128((const __m128i *)lane[l].ctr);
+		pos[l] = 0;
+	}
+
+	for (;;) {
+		/* Deal the slots round-robin to the regions with blocks left */
+		n_act = 0;
+		for (l = 0; l < n_lanes; l++) {
+			if (pos[l] < lane[l].size) {
+				act[n_act++] = l;
+			}
+			step[l] = 0;
+		}
+		if (n_act == 0) {
+			break;
+		}
+		for (k = 0; k < AESNI_CTR_BLOCKS; k++) {
+			l = act[k % n_act];
+			slot_num[k] = l;
+			slot_rk[k] = rk[l];
+			slot_lane[k] = &lane[l];
+			slot_pos[k] = 16 * (k / n_act);
+			step[l] += 16;
+		}
+
+		/* Whole iterations with this assignment */
+		for (;;) {
+			whole = 1;
+			for (n = 0; n < n_act; n++) {
+				l = act[n];
+				whole &= lane[l].size - pos[l] >= step[l];
+			}
+			if (!whole) {
+				break;
+			}
+			AESNI_UNROLL
+			for (k = 0; k < AESNI_CTR_BLOCKS; k++) {
+				l = slot_num[k];
+				b[k] = otfad_ctr_block(tmpl[l], lane[l].sys_addr + (uint32_t)(pos[l] + slot_pos[k]));
+				b[k] = _mm_xor_si128(b[k], slot_rk[k][0]);
+			}
+			for (r = 1; r < AES128_ROUNDS; r++) {
+				AESNI_UNROLL
+				for (k = 0; k < AESNI_CTR_BLOCKS; k++) {
+					b[k] = _mm_aesenc_si128(b[k], slot_rk[k][r]);
+				}
+			}
+			AESNI_UNROLL
+			for (k = 0; k < AESNI_CTR_BLOCKS; k++) {
+				l = slot_num[k];
+				b[k] = _mm_aesenclast_si128(b[k], slot_rk[k][AES128_ROUNDS]);
+				b[k] = _mm_shuffle_epi8(b[k], swap_mask);
+				b[k] = _mm_xor_si128(b[k], _mm_loadu_si128((const __m128i *)(slot_lane[k]->in + pos[l] + slot_pos[k])));
+				_mm_storeu_si128((__m128i *)(slot_lane[k]->out + pos[l] + slot_pos[k]), b[k]);
+			}
+			for (n = 0; n < n_act; n++) {
+				pos[act[n]] += step[act[n]];
+			}
+		}
+
+		/* One block of each region running out, the last one possibly
+		 * partial; the slots are dealt again to the regions left */
+		for (n = 0; n < n_act; n++) {
+			l = act[n];
+			b[n] = otfad_ctr_block(tmpl[l], lane[l].sys_addr + (uint32_t)pos[l]);
+			b[n] = _mm_xor_si128(b[n], rk[l][0]);
+		}
+		for (r = 1; r < AES128_ROUNDS; r++) {
+			for (n = 0; n < n_act; n++) {
+				b[n] = _mm_aesenc_si128(b[n], rk[act[n]][r]);
+			}
+		}
+		for (n = 0; n < n_act; n++) {
+			l = act[n];
+			b[n] = _mm_aesenclast_si128(b[n], rk[l][AES128_ROUNDS]);
+			b[n] = _mm_shuffle_epi8(b[n], swap_mask);
+			len = lane[l].size - pos[l];
+			if (len >= 16) {
+				b[n] = _mm_xor_si128(b[n], _mm_loadu_si128((const __m128i *)(lane[l].in + pos[l])));
+				_mm_storeu_si128((__m128i *)(lane[l].out + pos[l]), b[n]);
+				pos[l] += 16;
+			} else {
+				memset(last, 0, sizeof(last));
+				memcpy(last, lane[l].in + pos[l], len);
+				b[n] = _mm_xor_si128(b[n], _mm_loadu_si128((const __m128i *)last));
+				_mm_storeu_si128((__m128i *)last, b[n]);
+				memcpy(lane[l].out + pos[l], last, len);
+				pos[l] = lane[l].size;
+			}
+		}
+	}
+}
+
+/*
+ * Description : Expands an AES-128 key for aesni_ecb; the decryption
+ *               schedule is the encryption one reversed, with InvMixColumns
+ *               applied to the inner round keys
+ *
+ * @Inputs  : key     - Key
+ *            decrypt - 1 for decryption, 0 for encryption
+ *            ks      - Key schedule output
+ */
+AESNI_TARGET void aesni_key_setup(const unsigned char *key, int decrypt, struct aesni_key *ks)
+{
+	__m128i rk[AES128_ROUNDS + 1];
+	int r;
+
+	aes128_key_expand(key, rk);
+	for (r = 0; r <= AES128_ROUNDS; r++) {
+		if (!decrypt) {
+			_mm_store_si128((__m128i *)ks->rk[r], rk[r]);
+		} else if (r == 0 || r == AES128_ROUNDS) {
+			_mm_store_si128((__m128i *)ks->rk[r], rk[AES128_ROUNDS - r]);
+		} else {
+			_mm_store_si128((__m128i *)ks->rk[r], _mm_aesimc_si128(rk[AES128_ROUNDS - r]));
+		}
+	}
+	ks->decrypt = decrypt;
+}
+
+/*
+ * Description : AES-128 ECB encryption or decryption using AES-NI,
+ *               AESNI_CTR_BLOCKS blocks in flight
+ *
+ * @Inputs  : ks       - Key schedule from aesni_key_setup
+ *            in       - Input blocks
+ *            out      - Output blocks (may be equal to in)
+ *            n_blocks - Number of blocks
+ */
+AESNI_TARGET void aesni_ecb(const struct aesni_key *ks, const uint8_t *in, uint8_t *out,
+			    size_t n_blocks)
+{
+	__m128i rk[AES128_ROUNDS + 1];
+	__m128i b[AESNI_CTR_BLOCKS];
+	size_t n;
+	int r, k;
+
+	for (r = 0; r <= AES128_ROUNDS; r++) {
+		rk[r] = _mm_load_si128((const __m128i *)ks->rk[r]);
+	}
+
+	for (; n_blocks; n_blocks -= n, in += n * 16, out += n * 16) {
+		n = (n_blocks > AESNI_CTR_BLOCKS) ? AESNI_CTR_BLOCKS : n_blocks;
+		for (k = 0; k < n; k++) {
+			b[k] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + k * 16)), rk[0]);
+		}
+		if (ks->decrypt) {
+			for (r = 1; r < AES128_ROUNDS; r++) {
+				for (k = 0; k < n; k++) {
+					b[k] = _mm_aesdec_si128(b[k], rk[r]);
+				}
+			}
+			for (k = 0; k < n; k++) {
+				b[k] = _mm_aesdeclast_si128(b[k], rk[AES128_ROUNDS]);
+			}
+		} else {
+			for (r = 1; r < AES128_ROUNDS; r++) {
+				for (k = 0; k < n; k++) {
+					b[k] = _mm_aesenc_si128(b[k], rk[r]);
+				}
+			}
+			for (k = 0; k < n; k++) {
+				b[k] = _mm_aesenclast_si128(b[k], rk[AES128_ROUNDS]);
+			}
+		}
+		for (k = 0; k < n; k++) {
+			_mm_storeu_si128((__m128i *)(out + k * 16), b[k]);
+		}
+	}
+}
+
+/*
+ * Description : Checks through CPUID whether VAES with AVX-512 (F and BW) is
+ *               available on the running CPU
+ *
+ * @Outputs : return 1 if the VAES kernel can be used, 0 otherwise
+ */
+int vaes_ctr_supported(void)
+{
+	__builtin_cpu_init();
+	return aesni_ctr_supported() &&
+	       __builtin_cpu_supports("vaes") &&
+	       __builtin_cpu_supports("avx512f") &&
+	       __builtin_cpu_supports("avx512bw");
+}
+
+/*
+ * Description : OTFAD AES-128-CTR using VAES on 512-bit registers. Each
+ *               iteration handles VAES_CTR_BLOCKS counter blocks in four
+ *               registers of four blocks. The system addresses are kept in
+ *               the last dword of every 128-bit lane and advanced with one
+ *               vector add per register, then byte swapped into place with
+ *               VPSHUFB and merged with the counter template. The remaining
+ *               tail is handed to the 128-bit AES-NI kernel.
+ *
+ * @Inputs  : in       - Plaintext to encrypt
+ *            out      - Ciphertext output (may be equal to in)
+ *            size     - Plaintext size
+ *            ks       - Encryption key schedule from aesni_key_setup
+ *            ctr      - Counter template (bytes 0 to SYS_ADDR_OFFSET - 1 used)
+ *            sys_addr - System Address of the first byte of in
+ */
+VAES_TARGET void vaes_ctr_enc(const uint8_t *in, uint8_t *out, size_t size,
+			      const struct aesni_key *ks, const unsigned char *ctr,
+			      uint32_t sys_addr)
+{
+	const __m512i swap_mask = _mm512_broadcast_i32x4(_mm_setr_epi8(OTFAD_SWAP_MASK));
+	/* Big-endian address in dword 3 of each lane, other bytes cleared */
+	const __m512i addr_mask = _mm512_broadcast_i32x4(
+			_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+				      -1, -1, -1, -1, 15, 14, 13, 12));
+	const __m512i addr_step = _mm512_set_epi32(VAES_CTR_BLOCKS * 16, 0, 0, 0,
+						   VAES_CTR_BLOCKS * 16, 0, 0, 0,
+						   VAES_CTR_BLOCKS * 16, 0, 0, 0,
+						   VAES_CTR_BLOCKS * 16, 0, 0, 0);
+	__m512i rk[AES128_ROUNDS + 1];
+	__m512i tmpl;
+	__m512i addr[VAES_CTR_BLOCKS / 4];
+	__m512i b[VAES_CTR_BLOCKS / 4];
+	size_t off = 0;
+	int r, k;
+
+	for (r = 0; r <= AES128_ROUNDS; r++) {
+		rk[r] = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i *)ks->rk[r]));
+	}
+
+	/* Counter template with the system address word cleared */
+	tmpl = _mm512_broadcast_i32x4(_mm_insert_epi32(_mm_loadu_si128((const __m128i *)ctr), 0, 3));
+
+	for (k = 0; k < VAES_CTR_BLOCKS / 4; k++) {
+		addr[k] = _mm512_set_epi32(sys_addr + (k * 4 + 3) * 16, 0, 0, 0,
+					   sys_addr + (k * 4 + 2) * 16, 0, 0, 0,
+					   sys_addr + (k * 4 + 1) * 16, 0, 0, 0,
+					   sys_addr + (k * 4 + 0) * 16, 0, 0, 0);
+	}
+
+	for (; size - off >= VAES_CTR_BLOCKS * 16; off += VAES_CTR_BLOCKS * 16) {
+		for (k = 0; k < VAES_CTR_BLOCKS / 4; k++) {
+			b[k] = _mm512_or_si512(tmpl, _mm512_shuffle_epi8(addr[k], addr_mask));
+			b[k] = _mm512_xor_si512(b[k], rk[0]);
+			addr[k] = _mm512_add_epi32(addr[k], addr_step);
+		}
+		for (r = 1; r < AES128_ROUNDS; r++) {
+			for (k = 0; k < VAES_CTR_BLOCKS / 4; k++) {
+				b[k] = _mm512_aesenc_epi128(b[k], rk[r]);
+			}
+		}
+		for (k = 0; k < VAES_CTR_BLOCKS / 4; k++) {
+			b[k] = _mm512_aesenclast_epi128(b[k], rk[AES128_ROUNDS]);
+			b[k] = _mm512_shuffle_epi8(b[k], swap_mask);
+			b[k] = _mm512_xor_si512(b[k], _mm512_loadu_si512((const void *)(in + off + k * 64)));
+			_mm512_storeu_si512((void *)(out + off + k * 64), b[k]);
+		}
+	}
+
+	if (off < size) {
+		aesni_ctr_enc(in + off, out + off, size - off, ks, ctr, sys_addr + (uint32_t)off);
+	}
+}
+
+#else /* !x86 */
+
+int aesni_ctr_supported(void)
+{
+	return 0;
+}
+
+int aes_tables_used(void)
+{
+	/* OpenSSL has native or vector permutation AES on other hosts */
+	return 0;
+}
+
+void aesni_ctr_enc(const uint8_t *in, uint8_t *out, size_t size,
+		   const struct aesni_key *ks, const unsigned char *ctr,
+		   uint32_t sys_addr)
+{
+}
+
+void aesni_ctr_enc_multi(const struct aesni_ctr_lane *lane, int n_lanes)
+{
+}
+
+void aesni_key_setup(const unsigned char *key, int decrypt, struct aesni_key *ks)
+{
+}
+
+void aesni_ecb(const struct aesni_key *ks, const uint8_t *in, uint8_t *out, size_t n_blocks)
+{
+}
+
+int vaes_ctr_supported(void)
+{
+	return 0;
+}
+
+void vaes_ctr_enc(const uint8_t *in, uint8_t *out, size_t size,
+		  const struct aesni_key *ks, const unsigned char *ctr,
+		  uint32_t sys_addr)
+{
+}
+
+#endif
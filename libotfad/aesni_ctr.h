@@ -0,0 +1,49 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef AESNI_CTR_H
+#define AESNI_CTR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of counter blocks kept in flight by the AES-NI kernel */
+#define AESNI_CTR_BLOCKS        8
+/* Number of counter blocks per iteration of the VAES (AVX-512) kernel */
+#define VAES_CTR_BLOCKS         16
+/* Number of regions, each with its own key, interleaved by the multi-key kernel */
+#define AESNI_MULTI_LANES       4
+
+/* AES-128 key schedule of the AES-NI ECB function */
+struct aesni_key {
+	uint8_t rk[11][16] __attribute__((aligned(16)));
+	int decrypt;
+};
+
+/* Region of the multi-key kernel */
+struct aesni_ctr_lane {
+	const uint8_t *in;
+	uint8_t *out;
+	size_t size;
+	const struct aesni_key *ks;
+	const unsigned char *ctr;
+	uint32_t sys_addr;
+};
+
+int aesni_ctr_supported(void);
+int aes_tables_used(void);
+void aesni_ctr_enc(const uint8_t *in, uint8_t *out, size_t size,
+		   const struct aesni_key *ks, const unsigned char *ctr,
+		   uint32_t sys_addr);
+void aesni_ctr_enc_multi(const struct aesni_ctr_lane *lane, int n_lanes);
+void aesni_key_setup(const unsigned char *key, int decrypt, struct aesni_key *ks);
+void aesni_ecb(const struct aesni_key *ks, const uint8_t *in, uint8_t *out, size_t n_blocks);
+int vaes_ctr_supported(void);
+void vaes_ctr_enc(const uint8_t *in, uint8_t *out, size_t size,
+		  const struct aesni_key *ks, const unsigned char *ctr,
+		  uint32_t sys_addr);
+
+#endif /* AESNI_CTR_H */
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef OTFAD_H
+#define OTFAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTFAD_KEY_SIZE          16
+#define OTFAD_BLOCK_SIZE        16
+#define OTFAD_CTR_SIZE          8
+#define OTFAD_CTR_EXT_SIZE      16
+#define OTFAD_SYS_ADDR_OFFSET   12
+#define OTFAD_KEY_SCRAMBLE_SIZE 4
+#define OTFAD_KEYBLOB_PT_SIZE   40
+#define OTFAD_KEYBLOB_CT_SIZE   48
+#define OTFAD_KEYBLOB_SIZE      64
+#define OTFAD_NUM_CONTEXT       4
+#define OTFAD_KEYSTREAM_ID_SIZE 32
+/* Unit of work of the multi-threaded CTR operation */
+#define OTFAD_THREAD_SLICE_SIZE 0x40000
+/* Keystream line and default keystream cache size of the read emulator */
+#define OTFAD_READER_LINE_SIZE  128
+#define OTFAD_READER_CACHE_SIZE 0x100000
+/* Buffer pool: alignment of every buffer, huge page size */
+#define OTFAD_BUF_ALIGN         64
+#define OTFAD_BUF_HUGE_PAGE_SIZE 0x200000
+/* otfad_buf_alloc flags */
+#define OTFAD_BUF_HUGE          0x1     /* Image, chunk or keystream data */
+#define OTFAD_BUF_SECRET        0x2     /* Cleared when freed */
+/* Trace levels: one event per otfad_ctr_crypt call, or per block too */
+#define OTFAD_TRACE_OFF         0
+#define OTFAD_TRACE_CHUNK       1
+#define OTFAD_TRACE_BLOCK       2
+/* Default number of events kept per thread */
+#define OTFAD_TRACE_EVENTS      0x10000
+
+/* Error codes, returned negated */
+enum otfad_err {
+	OTFAD_OK = 0,
+	OTFAD_ERR_INVAL,        /* Invalid argument */
+	OTFAD_ERR_NOMEM,        /* Memory allocation failed */
+	OTFAD_ERR_CRYPTO,       /* OpenSSL error, see the OpenSSL error queue */
+	OTFAD_ERR_INTEGRITY,    /* Key unwrap IV or key blob CRC mismatch */
+	OTFAD_ERR_SELFTEST,     /* An AES implementation disagrees with OpenSSL */
+	OTFAD_ERR_BACKEND,      /* Unknown AES backend, or not supported by the CPU */
+	OTFAD_ERR_IO,           /* File error, see errno */
+};
+
+/* OTFAD AES-128-CTR context of one key and counter */
+struct otfad_ctr;
+
+/* One region of a multi-context CTR operation */
+struct otfad_ctr_op {
+	const struct otfad_ctr *ctx;
+	const uint8_t *in;
+	uint8_t *out;
+	size_t size;
+	uint32_t sys_addr;
+};
+
+/* OTFAD read emulator of an encrypted image */
+struct otfad_reader;
+
+/* One read of a batch */
+struct otfad_read {
+	uint32_t addr;
+	uint32_t size;
+	uint8_t *buf;
+};
+
+const char *otfad_strerror(int err);
+int otfad_selftest(void);
+int otfad_backend_select(const char *name);
+const char *otfad_backend_name(void);
+
+int otfad_ctr_new(const uint8_t *key, const uint8_t *ctr, struct otfad_ctr **ctx);
+void otfad_ctr_free(struct otfad_ctr *ctx);
+int otfad_ctr_crypt(const struct otfad_ctr *ctx, const uint8_t *in, uint8_t *out,
+		    size_t size, uint32_t sys_addr);
+int otfad_ctr_crypt_mt(const struct otfad_ctr *ctx, const uint8_t *in, uint8_t *out,
+		       size_t size, uint32_t sys_addr, int n_threads);
+int otfad_ctr_crypt_multi(const struct otfad_ctr_op *op, int n_op);
+int otfad_ctr_keystream_id(const struct otfad_ctr *ctx, uint32_t sys_addr, size_t size,
+			   uint8_t *id);
+int otfad_ctr_patch(const struct otfad_ctr *ctx, uint8_t *image, size_t image_size,
+		    uint32_t image_addr, const uint8_t *patch, size_t patch_size,
+		    uint32_t patch_addr);
+int otfad_trace_start(const char *fname, int level, size_t n_events);
+int otfad_trace_stop(void);
+int otfad_buf_alloc(size_t size, unsigned int flags, void **buf);
+void otfad_buf_free(void *buf);
+void otfad_buf_pool_drain(void);
+void otfad_xor(const uint8_t *in, const uint8_t *ks, uint8_t *out, size_t size);
+
+int otfad_reader_new(const uint8_t *image, size_t image_size, uint32_t image_addr,
+		     size_t cache_size, struct otfad_reader **rd);
+int otfad_reader_add_region(struct otfad_reader *rd, const struct otfad_ctr *ctx,
+			    uint32_t start_addr, uint32_t size);
+int otfad_reader_read(struct otfad_reader *rd, uint32_t addr, uint8_t *buf, size_t size);
+int otfad_reader_read_batch(struct otfad_reader *rd, const struct otfad_read *req, size_t n_req);
+void otfad_reader_stats(struct otfad_reader *rd, uint64_t *hits, uint64_t *misses);
+void otfad_reader_free(struct otfad_reader *rd);
+
+int otfad_key_wrap(const uint8_t *pt, size_t pt_size, const uint8_t *kek, uint8_t *ct);
+int otfad_keyblob_plaintext(const uint8_t *key, const uint8_t *ctr, uint32_t start_addr,
+			    uint32_t end_addr, int valid, uint8_t *pt);
+int otfad_keyblob_wrap(const uint8_t *pt, const uint8_t *kek, uint8_t *blob);
+int otfad_key_unwrap(const uint8_t *ct, size_t ct_size, const uint8_t *kek, uint8_t *pt);
+int otfad_keyblob_unwrap(const uint8_t *blob, const uint8_t *kek, uint8_t *pt);
+int otfad_keyblob_parse(const uint8_t *pt, uint8_t *key, uint8_t *ctr, uint32_t *start_addr,
+			uint32_t *end_addr, int *valid);
+
+int otfad_key_scramble(const uint8_t *otfad_key, const uint8_t *key_scramble,
+		       uint8_t key_scramble_align, int ctx_sel, uint8_t *scrambled_key);
+
+uint32_t otfad_crc32(const uint8_t *in, size_t size);
+uint32_t otfad_crc32_ieee(uint32_t crc, const uint8_t *in, size_t size);
+
+#endif /* OTFAD_H */
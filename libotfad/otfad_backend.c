@@ -0,0 +1,382 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/* OpenSSL includes*/
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+
+#include "otfad.h"
+#include "otfad_backend.h"
+#include "aesni_ctr.h"
+#include "aes_ct.h"
+
+/* Blocks per EVP update, the length being an int */
+#define EVP_ECB_MAX_BLOCKS      0x10000
+
+/* AES-128-ECB cipher fetched once for the process */
+static pthread_once_t evp_once = PTHREAD_ONCE_INIT;
+static const EVP_CIPHER *evp_cipher;
+
+/* Backend named by OTFAD_AES_BACKEND_ENV, read once */
+static pthread_once_t env_once = PTHREAD_ONCE_INIT;
+static const struct otfad_aes_backend *env_backend;
+static int env_err;
+
+/* Backend set by otfad_backend_select, overrides the environment */
+static const struct otfad_aes_backend *selected_backend;
+
+/*
+ * Description : Fetches the AES-128-ECB implementation from the OpenSSL
+ *               providers once, rather than implicitly at every
+ *               EVP_EncryptInit_ex of EVP_aes_128_ecb()
+ */
+static void evp_fetch(void)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	evp_cipher = EVP_CIPHER_fetch(NULL, "AES-128-ECB", NULL);
+#else
+	evp_cipher = EVP_aes_128_ecb();
+#endif
+}
+
+static int backend_always(void)
+{
+	return 1;
+}
+
+/*
+ * Description : OpenSSL key schedule: an EVP context of the fetched cipher
+ */
+static int openssl_key_new(const uint8_t *key, int decrypt, void **ks)
+{
+	EVP_CIPHER_CTX *evp_ctx;
+
+	pthread_once(&evp_once, evp_fetch);
+	if (evp_cipher == NULL) {
+		return -OTFAD_ERR_CRYPTO;
+	}
+
+	evp_ctx = EVP_CIPHER_CTX_new();
+	if (evp_ctx == NULL) {
+		return -OTFAD_ERR_NOMEM;
+	}
+	if (!EVP_CipherInit_ex(evp_ctx, evp_cipher, NULL, key, NULL, !decrypt) ||
+	    !EVP_CIPHER_CTX_set_padding(evp_ctx, 0)) {
+		EVP_CIPHER_CTX_free(evp_ctx);
+		return -OTFAD_ERR_CRYPTO;
+	}
+	*ks = evp_ctx;
+
+	return 0;
+}
+
+static int openssl_ecb(void *ks, const uint8_t *in, uint8_t *out, size_t n_blocks)
+{
+	size_t n;
+	int outlen;
+
+	for (; n_blocks; n_blocks -= n, in += n * 16, out += n * 16) {
+		n = (n_blocks > EVP_ECB_MAX_BLOCKS) ? EVP_ECB_MAX_BLOCKS : n_blocks;
+		if (!EVP_CipherUpdate(ks, out, &outlen, in, (int)(n * 16)) || outlen != n * 16) {
+			return -OTFAD_ERR_CRYPTO;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Copies an OpenSSL key schedule, without expanding the key
+ *               again: an EVP context is only used by one thread at a time
+ */
+static int openssl_key_dup(const void *ks, void **dup)
+{
+	EVP_CIPHER_CTX *evp_ctx;
+
+	evp_ctx = EVP_CIPHER_CTX_new();
+	if (evp_ctx == NULL) {
+		return -OTFAD_ERR_NOMEM;
+	}
+	if (!EVP_CIPHER_CTX_copy(evp_ctx, ks)) {
+		EVP_CIPHER_CTX_free(evp_ctx);
+		return -OTFAD_ERR_CRYPTO;
+	}
+	*dup = evp_ctx;
+
+	return 0;
+}
+
+static void openssl_key_free(void *ks)
+{
+	EVP_CIPHER_CTX_free(ks);
+}
+
+/*
+ * Description : AES-NI key schedule, shared by the AES-NI and VAES backends
+ */
+static int aesni_key_new(const uint8_t *key, int decrypt, void **ks)
+{
+	struct aesni_key *k;
+
+	k = malloc(sizeof(*k));
+	if (k == NULL) {
+		return -OTFAD_ERR_NOMEM;
+	}
+	aesni_key_setup(key, decrypt, k);
+	*ks = k;
+
+	return 0;
+}
+
+static int aesni_ecb_blocks(void *ks, const uint8_t *in, uint8_t *out, size_t n_blocks)
+{
+	aesni_ecb(ks, in, out, n_blocks);
+	return 0;
+}
+
+static void aesni_ctr_blocks(const uint8_t *in, uint8_t *out, size_t size,
+			     const void *ks, const unsigned char *ctr, uint32_t sys_addr)
+{
+	aesni_ctr_enc(in, out, size, ks, ctr, sys_addr);
+}
+
+static void vaes_ctr_blocks(const uint8_t *in, uint8_t *out, size_t size,
+			    const void *ks, const unsigned char *ctr, uint32_t sys_addr)
+{
+	vaes_ctr_enc(in, out, size, ks, ctr, sys_addr);
+}
+
+static void aesni_key_free(void *ks)
+{
+	if (ks != NULL) {
+		OPENSSL_cleanse(ks, sizeof(struct aesni_key));
+		free(ks);
+	}
+}
+
+/*
+ * Description : Bitsliced key schedule, encryption only
+ */
+static int portable_key_new(const uint8_t *key, int decrypt, void **ks)
+{
+	struct aes_ct_key *k;
+
+	if (decrypt) {
+		return -OTFAD_ERR_INVAL;
+	}
+	k = malloc(sizeof(*k));
+	if (k == NULL) {
+		return -OTFAD_ERR_NOMEM;
+	}
+	aes_ct_key_setup(key, k);
+	*ks = k;
+
+	return 0;
+}
+
+static int portable_ecb(void *ks, const uint8_t *in, uint8_t *out, size_t n_blocks)
+{
+	aes_ct_encrypt(ks, in, out, n_blocks);
+	return 0;
+}
+
+static void portable_ctr_blocks(const uint8_t *in, uint8_t *out, size_t size,
+				const void *ks, const unsigned char *ctr, uint32_t sys_addr)
+{
+	aes_ct_ctr_enc(in, out, size, ks, ctr, sys_addr);
+}
+
+static void portable_key_free(void *ks)
+{
+	if (ks != NULL) {
+		OPENSSL_cleanse(ks, sizeof(struct aes_ct_key));
+		free(ks);
+	}
+}
+
+const struct otfad_aes_backend otfad_backend_openssl = {
+	.name = "openssl",
+	.caps = OTFAD_AES_CAP_DECRYPT,
+	.supported = backend_always,
+	.key_new = openssl_key_new,
+	.key_dup = openssl_key_dup,
+	.ecb = openssl_ecb,
+	.key_free = openssl_key_free,
+	.ctr = NULL,
+};
+
+const struct otfad_aes_backend otfad_backend_aesni = {
+	.name = "aesni",
+	.caps = OTFAD_AES_CAP_DECRYPT | OTFAD_AES_CAP_CTR | OTFAD_AES_CAP_CONST_TIME,
+	.supported = aesni_ctr_supported,
+	.key_new = aesni_key_new,
+	.ecb = aesni_ecb_blocks,
+	.key_free = aesni_key_free,
+	.ctr = aesni_ctr_blocks,
+};
+
+const struct otfad_aes_backend otfad_backend_vaes = {
+	.name = "vaes",
+	.caps = OTFAD_AES_CAP_DECRYPT | OTFAD_AES_CAP_CTR | OTFAD_AES_CAP_CONST_TIME,
+	.supported = vaes_ctr_supported,
+	.key_new = aesni_key_new,
+	.ecb = aesni_ecb_blocks,
+	.key_free = aesni_key_free,
+	.ctr = vaes_ctr_blocks,
+};
+
+const struct otfad_aes_backend otfad_backend_portable = {
+	.name = "portable",
+	.caps = OTFAD_AES_CAP_CTR | OTFAD_AES_CAP_CONST_TIME,
+	.supported = backend_always,
+	.key_new = portable_key_new,
+	.ecb = portable_ecb,
+	.key_free = portable_key_free,
+	.ctr = portable_ctr_blocks,
+};
+
+const struct otfad_aes_backend *const otfad_backends[] = {
+	&otfad_backend_vaes,
+	&otfad_backend_aesni,
+	&otfad_backend_portable,
+	&otfad_backend_openssl,
+	NULL
+};
+
+/*
+ * Description : Default backend of the running CPU: the VAES or AES-NI
+ *               kernels, else the bitsliced AES where OpenSSL would use
+ *               lookup tables
+ */
+static const struct otfad_aes_backend *backend_auto(void)
+{
+	if (vaes_ctr_supported()) {
+		return &otfad_backend_vaes;
+	}
+	if (aesni_ctr_supported()) {
+		return &otfad_backend_aesni;
+	}
+	if (aes_tables_used()) {
+		return &otfad_backend_portable;
+	}
+	return &otfad_backend_openssl;
+}
+
+/*
+ * Description : Looks a backend up by name, "auto" being the default one
+ *
+ * @Inputs  : name - Backend name
+ *            be   - Backend output
+ *
+ * @Outputs : return 0 on success, -OTFAD_ERR_BACKEND if it is unknown or
+ *            can't run on this CPU
+ */
+static int backend_find(const char *name, const struct otfad_aes_backend **be)
+{
+	int i;
+
+	if (!strcmp(name, "auto")) {
+		*be = backend_auto();
+		return 0;
+	}
+	for (i = 0; otfad_backends[i] != NULL; i++) {
+		if (!strcmp(name, otfad_backends[i]->name)) {
+			if (!otfad_backends[i]->supported()) {
+				break;
+			}
+			*be = otfad_backends[i];
+			return 0;
+		}
+	}
+
+	return -OTFAD_ERR_BACKEND;
+}
+
+static void backend_env(void)
+{
+	const char *name = getenv(OTFAD_AES_BACKEND_ENV);
+
+	if (name == NULL || *name == '\0') {
+		env_backend = backend_auto();
+	} else {
+		env_err = backend_find(name, &env_backend);
+	}
+}
+
+/*
+ * Description : Returns the AES backend of new CTR contexts and key wraps:
+ *               the one set by otfad_backend_select, else the one named by
+ *               the OTFAD_AES_BACKEND environment variable, else the default
+ *               of the running CPU
+ *
+ * @Inputs  : be - Backend output
+ *
+ * @Outputs : return 0 on success, -OTFAD_ERR_BACKEND if the environment
+ *            names an unknown or unsupported backend
+ */
+int otfad_backend_get(const struct otfad_aes_backend **be)
+{
+	const struct otfad_aes_backend *sel = __atomic_load_n(&selected_backend, __ATOMIC_ACQUIRE);
+
+	if (sel != NULL) {
+		*be = sel;
+		return 0;
+	}
+
+	pthread_once(&env_once, backend_env);
+	if (env_err) {
+		return env_err;
+	}
+	*be = env_backend;
+
+	return 0;
+}
+
+/*
+ * Description : Selects the AES backend of the process, e.g. from a command
+ *               line option. Contexts created before keep their backend.
+ *
+ * @Inputs  : name - "openssl", "aesni", "vaes", "portable" (bitsliced) or
+ *                   "auto"; NULL to go back to the environment variable
+ *
+ * @Outputs : return 0 on success, -OTFAD_ERR_BACKEND if the backend is
+ *            unknown or can't run on this CPU
+ */
+int otfad_backend_select(const char *name)
+{
+	const struct otfad_aes_backend *be = NULL;
+	int err;
+
+	if (name != NULL) {
+		err = backend_find(name, &be);
+		if (err) {
+			return err;
+		}
+	}
+	__atomic_store_n(&selected_backend, be, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * Description : Names the AES backend in use
+ *
+ * @Outputs : return the backend name, or NULL if the environment names an
+ *            unknown or unsupported backend
+ */
+const char *otfad_backend_name(void)
+{
+	const struct otfad_aes_backend *be;
+
+	if (otfad_backend_get(&be)) {
+		return NULL;
+	}
+	return be->name;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef OTFAD_BACKEND_H
+#define OTFAD_BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Environment variable naming the AES backend of all the tools */
+#define OTFAD_AES_BACKEND_ENV   "OTFAD_AES_BACKEND"
+
+/* Capability flags of an AES backend */
+#define OTFAD_AES_CAP_DECRYPT   0x1     /* ECB decryption, for the key unwrap */
+#define OTFAD_AES_CAP_CTR       0x2     /* Native OTFAD CTR kernel */
+#define OTFAD_AES_CAP_CONST_TIME 0x4    /* No key or data dependent lookups */
+
+/*
+ * AES-128 implementation. A key schedule is set up once per key. The CTR
+ * kernel only reads its arguments, schedule included, and can run on any
+ * number of threads; so can ecb, unless the backend has key_dup.
+ */
+struct otfad_aes_backend {
+	const char *name;
+	unsigned int caps;
+	/* 1 if the backend can run on this CPU */
+	int (*supported)(void);
+	/* Key schedule for encryption, or decryption with OTFAD_AES_CAP_DECRYPT */
+	int (*key_new)(const uint8_t *key, int decrypt, void **ks);
+	/* Copy of a key schedule that ecb updates (OpenSSL), for one thread;
+	 * NULL if ecb only reads it */
+	int (*key_dup)(const void *ks, void **dup);
+	int (*ecb)(void *ks, const uint8_t *in, uint8_t *out, size_t n_blocks);
+	void (*key_free)(void *ks);
+	/* With OTFAD_AES_CAP_CTR: OTFAD CTR of a buffer with an encryption key
+	 * schedule, as aesni_ctr_enc */
+	void (*ctr)(const uint8_t *in, uint8_t *out, size_t size,
+		    const void *ks, const unsigned char *ctr, uint32_t sys_addr);
+};
+
+extern const struct otfad_aes_backend otfad_backend_openssl;
+extern const struct otfad_aes_backend otfad_backend_aesni;
+extern const struct otfad_aes_backend otfad_backend_vaes;
+extern const struct otfad_aes_backend otfad_backend_portable;
+/* All backends, NULL terminated */
+extern const struct otfad_aes_backend *const otfad_backends[];
+
+int otfad_backend_get(const struct otfad_aes_backend **be);
+
+#endif /* OTFAD_BACKEND_H */
@@ -0,0 +1,255 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/* OpenSSL includes*/
+#include <openssl/crypto.h>
+
+#include "otfad.h"
+
+/* Buffers from this size on are mapped, and may be backed by huge pages */
+#define BUF_MAP_MIN_SIZE        (OTFAD_BUF_HUGE_PAGE_SIZE / 2)
+/* Offset of the data in a mapping: the header sits right before it and the
+ * data stays page aligned, e.g. for O_DIRECT */
+#define BUF_MAP_OFFSET          0x1000
+/* Free mappings kept for reuse, in number and in bytes */
+#define BUF_POOL_MAX            16
+#define BUF_POOL_MAX_BYTES      0x10000000
+
+/* Header right before the data of every buffer */
+struct buf_hdr {
+	size_t size;            /* Size requested */
+	size_t map_size;        /* Size of the mapping, 0 for the heap */
+	unsigned int flags;
+	struct buf_hdr *next;   /* Next free mapping of the pool */
+} __attribute__((aligned(OTFAD_BUF_ALIGN)));
+
+/* Free mappings, by increasing size */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct buf_hdr *pool_head;
+static int pool_count;
+static size_t pool_bytes;
+/* Cleared once MAP_HUGETLB failed: no huge pages are reserved */
+static int hugetlb_ok = 1;
+
+static uint8_t *buf_data(struct buf_hdr *hdr)
+{
+	return (uint8_t *)(hdr + 1);
+}
+
+static struct buf_hdr *buf_hdr(void *buf)
+{
+	return (struct buf_hdr *)buf - 1;
+}
+
+static uint8_t *map_base(struct buf_hdr *hdr)
+{
+	return buf_data(hdr) - BUF_MAP_OFFSET;
+}
+
+/*
+ * Description : Takes the smallest free mapping of at least map_size bytes
+ *               out of the pool
+ *
+ * @Outputs : return the mapping header, NULL if none fits
+ */
+static struct buf_hdr *pool_get(size_t map_size)
+{
+	struct buf_hdr **p;
+	struct buf_hdr *hdr = NULL;
+
+	pthread_mutex_lock(&pool_lock);
+	for (p = &pool_head; *p != NULL; p = &(*p)->next) {
+		if ((*p)->map_size >= map_size) {
+			hdr = *p;
+			*p = hdr->next;
+			pool_count--;
+			pool_bytes -= hdr->map_size;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	return hdr;
+}
+
+/*
+ * Description : Puts a free mapping back in the pool, sorted by size
+ *
+ * @Outputs : return 0 if kept, -1 if the pool is full
+ */
+static int pool_put(struct buf_hdr *hdr)
+{
+	struct buf_hdr **p;
+	int ret = -1;
+
+	pthread_mutex_lock(&pool_lock);
+	if (pool_count < BUF_POOL_MAX && pool_bytes + hdr->map_size <= BUF_POOL_MAX_BYTES) {
+		for (p = &pool_head; *p != NULL && (*p)->map_size < hdr->map_size; p = &(*p)->next) {
+			;
+		}
+		hdr->next = *p;
+		*p = hdr;
+		pool_count++;
+		pool_bytes += hdr->map_size;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	return ret;
+}
+
+/*
+ * Description : Maps map_size bytes, a multiple of the huge page size:
+ *               reserved huge pages if the system has some, else anonymous
+ *               memory aligned on a huge page and advised for transparent
+ *               huge pages. The pages are faulted in at once rather than on
+ *               first touch.
+ *
+ * @Outputs : return the mapping, NULL on failure
+ */
+static uint8_t *map_huge(size_t map_size)
+{
+	uint8_t *map;
+	uint8_t *base;
+	size_t head;
+
+#ifdef MAP_HUGETLB
+	if (__atomic_load_n(&hugetlb_ok, __ATOMIC_RELAXED)) {
+		map = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+		if (map != MAP_FAILED) {
+			return map;
+		}
+		__atomic_store_n(&hugetlb_ok, 0, __ATOMIC_RELAXED);
+	}
+#endif
+
+	/* Over-map by a huge page to align the start on one */
+	map = mmap(NULL, map_size + OTFAD_BUF_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+	base = (uint8_t *)(((uintptr_t)map + OTFAD_BUF_HUGE_PAGE_SIZE - 1) &
+			   ~(uintptr_t)(OTFAD_BUF_HUGE_PAGE_SIZE - 1));
+	head = base - map;
+	if (head) {
+		munmap(map, head);
+	}
+	munmap(base + map_size, OTFAD_BUF_HUGE_PAGE_SIZE - head);
+
+#ifdef MADV_HUGEPAGE
+	madvise(base, map_size, MADV_HUGEPAGE);
+#endif
+#ifdef MADV_POPULATE_WRITE
+	/* Best effort, older kernels fault the pages in on first touch */
+	madvise(base, map_size, MADV_POPULATE_WRITE);
+#endif
+
+	return base;
+}
+
+/*
+ * Description : Allocates a buffer aligned on OTFAD_BUF_ALIGN bytes. With
+ *               OTFAD_BUF_HUGE, buffers of a megabyte or more are page
+ *               aligned, backed by huge pages where possible and taken
+ *               from the pool of freed ones first, so that jobs run one
+ *               after the other reuse already faulted-in memory.
+ *
+ * @Inputs  : size  - Buffer size
+ *            flags - OTFAD_BUF_HUGE for image, chunk and keystream data,
+ *                    OTFAD_BUF_SECRET to clear the buffer when freed
+ *            buf   - Buffer output
+ *
+ * @Outputs : return 0 on success, -OTFAD_ERR_NOMEM on failure
+ */
+int otfad_buf_alloc(size_t size, unsigned int flags, void **buf)
+{
+	struct buf_hdr *hdr = NULL;
+	size_t map_size;
+	uint8_t *map;
+	void *p;
+
+	if (buf == NULL) {
+		return -OTFAD_ERR_INVAL;
+	}
+	if (size > SIZE_MAX - BUF_MAP_OFFSET - 2 * OTFAD_BUF_HUGE_PAGE_SIZE) {
+		return -OTFAD_ERR_NOMEM;
+	}
+
+	if ((flags & OTFAD_BUF_HUGE) && size >= BUF_MAP_MIN_SIZE) {
+		map_size = (size + BUF_MAP_OFFSET + OTFAD_BUF_HUGE_PAGE_SIZE - 1) &
+			   ~(size_t)(OTFAD_BUF_HUGE_PAGE_SIZE - 1);
+		hdr = pool_get(map_size);
+		if (hdr == NULL) {
+			map = map_huge(map_size);
+			if (map == NULL) {
+				return -OTFAD_ERR_NOMEM;
+			}
+			hdr = (struct buf_hdr *)(map + BUF_MAP_OFFSET) - 1;
+			hdr->map_size = map_size;
+		}
+	} else {
+		if (posix_memalign(&p, OTFAD_BUF_ALIGN, sizeof(*hdr) + (size ? size : 1))) {
+			return -OTFAD_ERR_NOMEM;
+		}
+		hdr = p;
+		hdr->map_size = 0;
+	}
+	hdr->size = size;
+	hdr->flags = flags;
+	hdr->next = NULL;
+	*buf = buf_data(hdr);
+
+	return 0;
+}
+
+/*
+ * Description : Frees a buffer of otfad_buf_alloc: mappings go back to the
+ *               pool while it has room
+ *
+ * @Inputs  : buf - Buffer, may be NULL
+ */
+void otfad_buf_free(void *buf)
+{
+	struct buf_hdr *hdr;
+
+	if (buf == NULL) {
+		return;
+	}
+
+	hdr = buf_hdr(buf);
+	if (hdr->flags & OTFAD_BUF_SECRET) {
+		OPENSSL_cleanse(buf, hdr->size);
+	}
+	if (hdr->map_size == 0) {
+		free(hdr);
+	} else if (pool_put(hdr)) {
+		munmap(map_base(hdr), hdr->map_size);
+	}
+}
+
+/*
+ * Description : Unmaps the free buffers kept in the pool
+ */
+void otfad_buf_pool_drain(void)
+{
+	struct buf_hdr *hdr;
+
+	pthread_mutex_lock(&pool_lock);
+	while ((hdr = pool_head) != NULL) {
+		pool_head = hdr->next;
+		munmap(map_base(hdr), hdr->map_size);
+	}
+	pool_count = 0;
+	pool_bytes = 0;
+	pthread_mutex_unlock(&pool_lock);
+}
@@ -4,9 +4,10 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
-#ifndef KEY_WRAP_H
+#include <string.h>
+#include <pthread.h>
 
-#include <stdint.h>
+#include "otfad.h"
 
 static const uint32_t CRCTable[] = {
 	0x00000000,
@@ -63,6 +64,87 @@ static const uint32_t CRCTable[] = {
 	0xa2f33668, 0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
-#endif /* KEY_WRAP_H */
+/*
+ * Description : Computes the CRC32 of the key blob plaintext, as checked by
+ *               the OTFAD engine
+ *
+ * @Inputs  : in   - Input data
+ *            size - Input size
+ *
+ * @Outputs : return CRC32
+ */
+uint32_t otfad_crc32(const uint8_t *in, size_t size)
+{
+	uint32_t crc = 0xffffffff;
+	uint32_t crc_tbl_lookup = 0;
+
+	while (size--)
+	{
+		unsigned char c = *in++ & 0xff;
+		crc_tbl_lookup = CRCTable[(crc >> 24) ^ c];
+		crc = ((crc << 8) ^ (crc_tbl_lookup & 0xFFFFFF00)) | (crc_tbl_lookup & 0xFF);
+	}
+
+	return crc;
+}
+
+/* Slice-by-8 tables of the IEEE 802.3 CRC32, built on first use */
+static uint32_t crc32_ieee_table[8][256];
+static pthread_once_t crc32_ieee_once = PTHREAD_ONCE_INIT;
+
+static void crc32_ieee_init(void)
+{
+	uint32_t c;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++) {
+			c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+		}
+		crc32_ieee_table[0][i] = c;
+	}
+	for (i = 0; i < 256; i++) {
+		for (j = 1; j < 8; j++) {
+			c = crc32_ieee_table[j - 1][i];
+			crc32_ieee_table[j][i] = (c >> 8) ^ crc32_ieee_table[0][c & 0xFF];
+		}
+	}
+}
+
+/*
+ * Description : Updates the IEEE 802.3 CRC32 (zlib crc32(), Ethernet, PNG)
+ *               of a stream with the next bytes, 8 bytes at a time
+ *
+ * @Inputs  : crc  - CRC32 of the previous bytes, 0 for the first call
+ *            in   - Input data
+ *            size - Input size
+ *
+ * @Outputs : return the CRC32 of the stream up to in + size
+ */
+uint32_t otfad_crc32_ieee(uint32_t crc, const uint8_t *in, size_t size)
+{
+	const uint32_t (*t)[256] = crc32_ieee_table;
+	uint64_t v;
+
+	pthread_once(&crc32_ieee_once, crc32_ieee_init);
+
+	crc = ~crc;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	while (size >= 8) {
+		memcpy(&v, in, 8);
+		v ^= crc;
+		crc = t[7][v & 0xFF] ^ t[6][(v >> 8) & 0xFF] ^
+		      t[5][(v >> 16) & 0xFF] ^ t[4][(v >> 24) & 0xFF] ^
+		      t[3][(v >> 32) & 0xFF] ^ t[2][(v >> 40) & 0xFF] ^
+		      t[1][(v >> 48) & 0xFF] ^ t[0][v >> 56];
+		in += 8;
+		size -= 8;
+	}
+#endif
+	while (size--) {
+		crc = (crc >> 8) ^ t[0][(crc ^ *in++) & 0xFF];
+	}
 
-uint32_t compute_crc32(unsigned char *in, unsigned int size);
\ No newline at end of file
+	return ~crc;
+}
@@ -0,0 +1,918 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/* OpenSSL includes*/
+#include <openssl/evp.h>
+
+#include "otfad.h"
+#include "otfad_backend.h"
+#include "aesni_ctr.h"
+#include "otfad_swap.h"
+#include "otfad_trace.h"
+
+#define CTR_BATCH_BLOCKS        256
+/* Regions from this size fill the VAES kernel on their own */
+#define CTR_MULTI_VAES_MIN_SIZE 0x100
+/* Buffer size and seed of the self-test data */
+#define SELFTEST_SIZE           0x1000
+#define SELFTEST_SEED           0x4F544644
+/* Blocks of the ECB checks: partial and several batches of every kernel */
+#define SELFTEST_ECB_BLOCKS     24
+/* Domain of the keystream ids, to be changed with the keystream format */
+#define KEYSTREAM_ID_TAG        "OTFAD keystream v1"
+
+struct otfad_ctr {
+	uint8_t key[OTFAD_KEY_SIZE];
+	/* Counter, XOR of its two words; the system address is set per block */
+	uint8_t ctr[OTFAD_CTR_EXT_SIZE];
+	/* AES implementation and its encryption key schedule, set up once in
+	 * otfad_ctr_new */
+	const struct otfad_aes_backend *be;
+	void *ks;
+};
+
+/* Region shared by the threads of otfad_ctr_crypt_mt */
+struct ctr_thread_job {
+	const struct otfad_ctr *ctx;
+	const uint8_t *in;
+	uint8_t *out;
+	size_t size;
+	uint32_t sys_addr;
+	size_t n_slices;
+	size_t next_slice;
+	int err;
+};
+
+static const char *const otfad_err_str[] =
+{
+	"Success",
+	"Invalid argument",
+	"Out of memory",
+	"Cipher error",
+	"Integrity check failed",
+	"Self-test failed",
+	"AES backend unavailable",
+	"File error",
+};
+
+/*
+ * Description : Returns the description of a libotfad error code
+ *
+ * @Inputs  : err - Return value of a libotfad function
+ *
+ * @Outputs : return static error string
+ */
+const char *otfad_strerror(int err)
+{
+	if (err > 0 || -err >= sizeof(otfad_err_str) / sizeof(otfad_err_str[0])) {
+		return "Unknown error";
+	}
+	return otfad_err_str[-err];
+}
+
+/*
+ * Description : Sets the AES backend of a context up: the encryption key
+ *               schedule of its key
+ *
+ * @Inputs  : c  - Context, key set
+ *            be - Backend
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+static int ctr_key_setup(struct otfad_ctr *c, const struct otfad_aes_backend *be)
+{
+	int err;
+
+	err = be->key_new(c->key, 0, &c->ks);
+	if (err) {
+		c->ks = NULL;
+		return err;
+	}
+	c->be = be;
+
+	return 0;
+}
+
+/*
+ * Description : Creates the CTR context of a key and counter. The 128-bit
+ *               OTFAD counter (counter, XOR of its two words, system address),
+ *               the AES implementation and its key schedule are set up once;
+ *               the context is read-only afterwards and can be shared by any
+ *               number of threads.
+ *
+ * @Inputs  : key - Image encryption key (OTFAD_KEY_SIZE bytes)
+ *            ctr - Counter (OTFAD_CTR_SIZE bytes)
+ *            ctx - Context output, to be released with otfad_ctr_free
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_ctr_new(const uint8_t *key, const uint8_t *ctr, struct otfad_ctr **ctx)
+{
+	const struct otfad_aes_backend *be;
+	struct otfad_ctr *c;
+	int err;
+	int i;
+
+	if (key == NULL || ctr == NULL || ctx == NULL) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+	c = calloc(1, sizeof(*c));
+	if (c == NULL) {
+		return -OTFAD_ERR_NOMEM;
+	}
+
+	memcpy(c->key, key, OTFAD_KEY_SIZE);
+	memcpy(c->ctr, ctr, OTFAD_CTR_SIZE);
+	/* Append counter with XOR of 0th byte with 4th byte etc...*/
+	for (i = 0; i < 4; i++) {
+		c->ctr[OTFAD_CTR_SIZE + i] = ctr[i] ^ ctr[i + 4];
+	}
+
+#if DEBUG
+	printf("Input Counter value:");
+	for (i = 0; i < OTFAD_CTR_SIZE; i++) {
+		printf("%02X", c->ctr[i]);
+	}
+	printf("\n");
+
+	printf("Counter XOR value\n");
+	for (i = 0; i < 4; i++) {
+		printf("ctr_xor[%d] = %X\n", i, c->ctr[OTFAD_CTR_SIZE + i]);
+	}
+#endif
+
+	/* Trace named by the OTFAD_TRACE environment variable, if any */
+	otfad_trace_init();
+
+	/* Native VAES / AES-NI kernels, selected at runtime through CPUID,
+	 * the constant-time bitsliced AES where OpenSSL would use lookup
+	 * tables, or the backend named by OTFAD_AES_BACKEND */
+	err = otfad_backend_get(&be);
+	if (err == 0) {
+		err = ctr_key_setup(c, be);
+	}
+	if (err) {
+		otfad_ctr_free(c);
+		return err;
+	}
+
+	*ctx = c;
+
+	return 0;
+}
+
+/*
+ * Description : Releases a CTR context
+ *
+ * @Inputs  : ctx - Context returned by otfad_ctr_new, or NULL
+ */
+void otfad_ctr_free(struct otfad_ctr *ctx)
+{
+	if (ctx != NULL) {
+		if (ctx->ks != NULL) {
+			ctx->be->key_free(ctx->ks);
+		}
+		OPENSSL_cleanse(ctx, sizeof(*ctx));
+		free(ctx);
+	}
+}
+
+/*
+ * Description : OTFAD AES-128-CTR through the ECB blocks of a backend
+ *               without CTR kernel (OpenSSL). The counter blocks of up to
+ *               CTR_BATCH_BLOCKS blocks are built into a buffer (counter
+ *               template with the big-endian system address at
+ *               OTFAD_SYS_ADDR_OFFSET) and encrypted with a single ECB call.
+ *
+ * @Inputs  : ctx      - CTR context
+ *            in       - Input data
+ *            out      - Output buffer of size bytes (may be equal to in)
+ *            size     - Input size
+ *            sys_addr - System Address of the first byte of in
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+static int ctr_crypt_ecb(const struct otfad_ctr *ctx, const uint8_t *in, uint8_t *out,
+			 size_t size, uint32_t sys_addr)
+{
+	void *ks = ctx->ks;
+	unsigned char ctr_blocks[CTR_BATCH_BLOCKS * 16];
+	unsigned char enc_ctr[CTR_BATCH_BLOCKS * 16];
+	uint32_t blk_addr;
+	uint64_t t = 0;
+	size_t n_blocks = 0;
+	size_t batch_bytes = 0;
+	size_t i = 0;
+	size_t k = 0;
+	int trace = __atomic_load_n(&otfad_trace_level, __ATOMIC_RELAXED);
+	int ret;
+
+	if (trace) {
+		t = otfad_trace_time();
+	}
+
+	/* Own copy of a key schedule that ecb updates, once for the buffer */
+	if (ctx->be->key_dup != NULL) {
+		ret = ctx->be->key_dup(ctx->ks, &ks);
+		if (ret) {
+			return ret;
+		}
+	}
+
+	for (i = 0; i < size; i += batch_bytes) {
+		/* Number of counter blocks in this batch */
+		n_blocks = (size - i + 15) / 16;
+		if (n_blocks > CTR_BATCH_BLOCKS) {
+			n_blocks = CTR_BATCH_BLOCKS;
+		}
+		batch_bytes = n_blocks * 16;
+
+		/* Build the counter blocks: template + system address of each block */
+		for (k = 0; k < n_blocks; k++) {
+			blk_addr = sys_addr + (uint32_t)(i + k * 16);
+			memcpy(&ctr_blocks[k * 16], ctx->ctr, OTFAD_SYS_ADDR_OFFSET);
+			ctr_blocks[k * 16 + OTFAD_SYS_ADDR_OFFSET] = (uint8_t)((blk_addr >> 24) & 0xFF);
+			ctr_blocks[k * 16 + OTFAD_SYS_ADDR_OFFSET + 1] = (uint8_t)((blk_addr >> 16) & 0xFF);
+			ctr_blocks[k * 16 + OTFAD_SYS_ADDR_OFFSET + 2] = (uint8_t)((blk_addr >> 8) & 0xFF);
+			ctr_blocks[k * 16 + OTFAD_SYS_ADDR_OFFSET + 3] = (uint8_t)(blk_addr & 0xFF);
+		}
+
+		/* Encrypt all counter blocks of the batch at once */
+		ret = ctx->be->ecb(ks, ctr_blocks, enc_ctr, n_blocks);
+		if (ret) goto out;
+
+		/* One event for the call, then one per block, timed per batch */
+		if (trace) {
+			if (i == 0) {
+				otfad_trace_event(OTFAD_TRACE_EV_CHUNK, t, sys_addr, size, ctx->ctr,
+						  OTFAD_SYS_ADDR_OFFSET, otfad_trace_hash(enc_ctr, 1));
+			}
+			if (trace >= OTFAD_TRACE_BLOCK) {
+				t = otfad_trace_time();
+				for (k = 0; k < n_blocks; k++) {
+					otfad_trace_event(OTFAD_TRACE_EV_BLOCK, t, sys_addr + (uint32_t)(i + k * 16),
+							  (size - i - k * 16 < 16) ? size - i - k * 16 : 16,
+							  ctx->ctr, OTFAD_SYS_ADDR_OFFSET,
+							  otfad_trace_hash(&enc_ctr[k * 16], 1));
+				}
+			}
+		}
+
+		/* Swap Encrypted Counters as per OTFAD and XOR them with the input */
+		otfad_swap_xor(out + i, in + i, enc_ctr,
+			       (size - i < batch_bytes) ? size - i : batch_bytes);
+	}
+
+	ret = 0;
+out:
+	/* Clean up */
+	if (ks != ctx->ks) {
+		ctx->be->key_free(ks);
+	}
+	OPENSSL_cleanse(enc_ctr, sizeof(enc_ctr));
+
+	return ret;
+}
+
+/*
+ * Description : Records the trace event of a CTR call of a native kernel,
+ *               the keystream of its first block being generated again
+ *
+ * @Inputs  : ctx      - CTR context
+ *            t        - otfad_trace_time() at the start of the call
+ *            size     - Size of the call
+ *            sys_addr - System Address of the call
+ */
+static void ctr_trace_chunk(const struct otfad_ctr *ctx, uint64_t t, size_t size,
+			    uint32_t sys_addr)
+{
+	static const uint8_t zero[OTFAD_BLOCK_SIZE];
+	uint8_t ks[OTFAD_BLOCK_SIZE];
+
+	ctx->be->ctr(zero, ks, sizeof(ks), ctx->ks, ctx->ctr, sys_addr);
+	otfad_trace_event(OTFAD_TRACE_EV_CHUNK, t, sys_addr, size, ctx->ctr,
+			  OTFAD_SYS_ADDR_OFFSET, otfad_trace_hash(ks, 0));
+	OPENSSL_cleanse(ks, sizeof(ks));
+}
+
+/*
+ * Description : Performs the OTFAD AES-128-CTR operation; encryption and
+ *               decryption are the same operation. Only the context is
+ *               read, so any number of calls can run concurrently.
+ *
+ * @Inputs  : ctx      - CTR context
+ *            in       - Input data
+ *            out      - Output buffer of size bytes (may be equal to in)
+ *            size     - Input size
+ *            sys_addr - System Address of the first byte of in
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_ctr_crypt(const struct otfad_ctr *ctx, const uint8_t *in, uint8_t *out,
+		    size_t size, uint32_t sys_addr)
+{
+	uint64_t t;
+
+	if (ctx == NULL || (size && (in == NULL || out == NULL))) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+	/* Block traces need the encrypted counter of every block */
+	if (ctx->be->ctr == NULL || otfad_trace_on(OTFAD_TRACE_BLOCK)) {
+		return ctr_crypt_ecb(ctx, in, out, size, sys_addr);
+	}
+
+	if (otfad_trace_on(OTFAD_TRACE_CHUNK)) {
+		t = otfad_trace_time();
+		ctx->be->ctr(in, out, size, ctx->ks, ctx->ctr, sys_addr);
+		ctr_trace_chunk(ctx, t, size, sys_addr);
+		return 0;
+	}
+
+	ctx->be->ctr(in, out, size, ctx->ks, ctx->ctr, sys_addr);
+
+	return 0;
+}
+
+/*
+ * Description : Runs the interleaved AES-NI kernel on a set of lanes, with
+ *               the trace event of each region
+ *
+ * @Inputs  : lane    - Lanes
+ *            lane_op - Region of each lane
+ *            n_lanes - Number of lanes
+ */
+static void ctr_multi_lanes(const struct aesni_ctr_lane *lane,
+			    const struct otfad_ctr_op *const *lane_op, int n_lanes)
+{
+	uint64_t t;
+	int i;
+
+	if (!otfad_trace_on(OTFAD_TRACE_CHUNK)) {
+		aesni_ctr_enc_multi(lane, n_lanes);
+		return;
+	}
+
+	t = otfad_trace_time();
+	aesni_ctr_enc_multi(lane, n_lanes);
+	for (i = 0; i < n_lanes; i++) {
+		ctr_trace_chunk(lane_op[i]->ctx, t, lane_op[i]->size, lane_op[i]->sys_addr);
+	}
+}
+
+/*
+ * Description : Performs the OTFAD AES-128-CTR operation of several regions,
+ *               each with its own context, at once. With AES-NI, the blocks
+ *               of up to AESNI_MULTI_LANES regions are interleaved in the
+ *               same AES round loop, so small regions (e.g. the 4 contexts
+ *               of a boot image) don't leave the AES pipeline half empty.
+ *               Regions large enough for the VAES kernel, and contexts using
+ *               the bitsliced AES or OpenSSL, are processed one by one.
+ *
+ * @Inputs  : op   - Regions
+ *            n_op - Number of regions
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_ctr_crypt_multi(const struct otfad_ctr_op *op, int n_op)
+{
+	struct aesni_ctr_lane lane[AESNI_MULTI_LANES];
+	const struct otfad_ctr_op *lane_op[AESNI_MULTI_LANES];
+	int n_lanes = 0;
+	int err;
+	int i;
+
+	if (op == NULL && n_op) {
+		return -OTFAD_ERR_INVAL;
+	}
+	for (i = 0; i < n_op; i++) {
+		if (op[i].ctx == NULL || (op[i].size && (op[i].in == NULL || op[i].out == NULL))) {
+			return -OTFAD_ERR_INVAL;
+		}
+	}
+
+	for (i = 0; i < n_op; i++) {
+		if (op[i].size == 0) {
+			continue;
+		}
+		if ((op[i].ctx->be != &otfad_backend_aesni &&
+		     (op[i].ctx->be != &otfad_backend_vaes || op[i].size >= CTR_MULTI_VAES_MIN_SIZE)) ||
+		    otfad_trace_on(OTFAD_TRACE_BLOCK)) {
+			err = otfad_ctr_crypt(op[i].ctx, op[i].in, op[i].out, op[i].size, op[i].sys_addr);
+			if (err) {
+				return err;
+			}
+			continue;
+		}
+
+		lane[n_lanes].in = op[i].in;
+		lane[n_lanes].out = op[i].out;
+		lane[n_lanes].size = op[i].size;
+		lane[n_lanes].ks = op[i].ctx->ks;
+		lane[n_lanes].ctr = op[i].ctx->ctr;
+		lane[n_lanes].sys_addr = op[i].sys_addr;
+		lane_op[n_lanes] = &op[i];
+		if (++n_lanes == AESNI_MULTI_LANES) {
+			ctr_multi_lanes(lane, lane_op, n_lanes);
+			n_lanes = 0;
+		}
+	}
+	if (n_lanes) {
+		ctr_multi_lanes(lane, lane_op, n_lanes);
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Worker of the CTR thread pool. Takes the next unprocessed
+ *               slice of the region until all slices are done.
+ *
+ * @Inputs  : arg - Shared ctr_thread_job
+ */
+static void *ctr_thread_worker(void *arg)
+{
+	struct ctr_thread_job *job = arg;
+	size_t slice;
+	size_t offset;
+	size_t len;
+	int err;
+
+	while ((slice = __atomic_fetch_add(&job->next_slice, 1, __ATOMIC_RELAXED)) < job->n_slices) {
+		offset = slice * OTFAD_THREAD_SLICE_SIZE;
+		len = job->size - offset;
+		if (len > OTFAD_THREAD_SLICE_SIZE) {
+			len = OTFAD_THREAD_SLICE_SIZE;
+		}
+		err = otfad_ctr_crypt(job->ctx, job->in + offset, job->out + offset, len,
+				      job->sys_addr + (uint32_t)offset);
+		if (err) {
+			__atomic_store_n(&job->err, err, __ATOMIC_RELAXED);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Performs the OTFAD AES-128-CTR operation on a thread pool.
+ *               The data is split into OTFAD_THREAD_SLICE_SIZE slices; as
+ *               every OTFAD counter block only depends on its system
+ *               address, each slice is processed on its own and the output
+ *               is identical to the single threaded one.
+ *
+ * @Inputs  : ctx       - CTR context
+ *            in        - Input data
+ *            out       - Output buffer of size bytes (may be equal to in)
+ *            size      - Input size
+ *            sys_addr  - System Address of the first byte of in
+ *            n_threads - Number of worker threads, including the caller
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_ctr_crypt_mt(const struct otfad_ctr *ctx, const uint8_t *in, uint8_t *out,
+		       size_t size, uint32_t sys_addr, int n_threads)
+{
+	struct ctr_thread_job job;
+	pthread_t *threads = NULL;
+	int started = 0;
+	int i;
+
+	job.ctx = ctx;
+	job.in = in;
+	job.out = out;
+	job.size = size;
+	job.sys_addr = sys_addr;
+	job.next_slice = 0;
+	job.n_slices = (size + OTFAD_THREAD_SLICE_SIZE - 1) / OTFAD_THREAD_SLICE_SIZE;
+	job.err = 0;
+
+	if (n_threads > job.n_slices) {
+		n_threads = job.n_slices;
+	}
+	if (n_threads <= 1) {
+		return otfad_ctr_crypt(ctx, in, out, size, sys_addr);
+	}
+
+	/* The calling thread is one of the workers */
+	threads = malloc((n_threads - 1) * sizeof(pthread_t));
+	if (threads == NULL) {
+		return -OTFAD_ERR_NOMEM;
+	}
+
+	for (i = 0; i < n_threads - 1; i++) {
+		if (pthread_create(&threads[i], NULL, ctr_thread_worker, &job)) {
+			break;
+		}
+		started++;
+	}
+
+	/* Slices of threads that couldn't be started are picked up here */
+	ctr_thread_worker(&job);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	return job.err;
+}
+
+/*
+ * Description : Computes the id of the keystream of a context over an
+ *               address range: a SHA-256 digest of the key, counter and
+ *               range. The keystream of a range only depends on these
+ *               inputs, so the id can name a saved keystream; any change
+ *               of the inputs gives another id.
+ *
+ * @Inputs  : ctx      - CTR context
+ *            sys_addr - System Address of the first keystream byte
+ *            size     - Keystream size
+ *            id       - Id output (OTFAD_KEYSTREAM_ID_SIZE bytes)
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_ctr_keystream_id(const struct otfad_ctr *ctx, uint32_t sys_addr, size_t size,
+			   uint8_t *id)
+{
+	EVP_MD_CTX *md_ctx;
+	uint8_t range[12];
+	uint64_t size64 = size;
+	int i;
+	int ret = -OTFAD_ERR_CRYPTO;
+
+	if (ctx == NULL || id == NULL) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+	/* Big-endian start address and size */
+	for (i = 0; i < 4; i++) {
+		range[i] = (uint8_t)(sys_addr >> (24 - 8 * i));
+	}
+	for (i = 0; i < 8; i++) {
+		range[4 + i] = (uint8_t)(size64 >> (56 - 8 * i));
+	}
+
+	if(!(md_ctx = EVP_MD_CTX_new())) return -OTFAD_ERR_CRYPTO;
+	if(! EVP_DigestInit_ex(md_ctx, EVP_sha256(), NULL)) goto out;
+	if(! EVP_DigestUpdate(md_ctx, KEYSTREAM_ID_TAG, sizeof(KEYSTREAM_ID_TAG))) goto out;
+	if(! EVP_DigestUpdate(md_ctx, ctx->key, OTFAD_KEY_SIZE)) goto out;
+	if(! EVP_DigestUpdate(md_ctx, ctx->ctr, OTFAD_SYS_ADDR_OFFSET)) goto out;
+	if(! EVP_DigestUpdate(md_ctx, range, sizeof(range))) goto out;
+	if(! EVP_DigestFinal_ex(md_ctx, id, NULL)) goto out;
+
+	ret = 0;
+out:
+	EVP_MD_CTX_free(md_ctx);
+
+	return ret;
+}
+
+/*
+ * Description : Re-encrypts part of an encrypted image with new plaintext.
+ *               The counter of every block only depends on its system
+ *               address, so only the patched bytes are written and the rest
+ *               of the image is neither read nor changed. The patch may
+ *               start and end anywhere: partial blocks use the keystream of
+ *               their whole block.
+ *
+ * @Inputs  : ctx        - CTR context of the region holding the patch
+ *            image      - Encrypted image
+ *            image_size - Image size
+ *            image_addr - System Address of the first byte of image
+ *            patch      - Plaintext of the patch
+ *            patch_size - Patch size
+ *            patch_addr - System Address of the first byte of patch
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_ctr_patch(const struct otfad_ctr *ctx, uint8_t *image, size_t image_size,
+		    uint32_t image_addr, const uint8_t *patch, size_t patch_size,
+		    uint32_t patch_addr)
+{
+	uint8_t ks[OTFAD_BLOCK_SIZE];
+	uint8_t *out;
+	uint32_t block_addr;
+	size_t skip;
+	size_t n;
+	size_t i;
+	int err;
+
+	if (ctx == NULL || image == NULL || (patch_size && patch == NULL) ||
+	    patch_addr < image_addr || patch_addr - image_addr > image_size ||
+	    patch_size > image_size - (patch_addr - image_addr)) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+	out = image + (patch_addr - image_addr);
+	while (patch_size) {
+		skip = patch_addr % OTFAD_BLOCK_SIZE;
+		if (skip == 0 && patch_size >= OTFAD_BLOCK_SIZE) {
+			/* Whole blocks in one go */
+			n = patch_size - patch_size % OTFAD_BLOCK_SIZE;
+			err = otfad_ctr_crypt(ctx, patch, out, n, patch_addr);
+			if (err) {
+				return err;
+			}
+		} else {
+			/* Partial block: keystream of the block applied to its patched bytes */
+			n = OTFAD_BLOCK_SIZE - skip;
+			if (n > patch_size) {
+				n = patch_size;
+			}
+			block_addr = patch_addr - skip;
+			memset(ks, 0, sizeof(ks));
+			err = otfad_ctr_crypt(ctx, ks, ks, sizeof(ks), block_addr);
+			if (err) {
+				return err;
+			}
+			for (i = 0; i < n; i++) {
+				out[i] = patch[i] ^ ks[skip + i];
+			}
+		}
+		patch += n;
+		out += n;
+		patch_addr += n;
+		patch_size -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Fills a buffer with the self-test pseudo-random sequence
+ *               (xorshift32)
+ *
+ * @Inputs  : state - Generator state
+ *            buf   - Buffer
+ *            size  - Number of bytes
+ */
+static void selftest_fill(uint32_t *state, uint8_t *buf, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		*state ^= *state << 13;
+		*state ^= *state >> 17;
+		*state ^= *state << 5;
+		buf[i] = (uint8_t)*state;
+	}
+}
+
+/*
+ * Description : Encrypts blocks with a backend
+ *
+ * @Inputs  : be       - Backend
+ *            key      - Key
+ *            in       - Input blocks
+ *            out      - Output blocks
+ *            n_blocks - Number of blocks
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+static int selftest_ecb(const struct otfad_aes_backend *be, const uint8_t *key,
+			const uint8_t *in, uint8_t *out, size_t n_blocks)
+{
+	void *ks;
+	int err;
+
+	err = be->key_new(key, 0, &ks);
+	if (err) {
+		return err;
+	}
+	err = be->ecb(ks, in, out, n_blocks);
+	be->key_free(ks);
+
+	return err;
+}
+
+/*
+ * Description : OTFAD CTR of a context with another backend
+ *
+ * @Inputs  : ctx      - Context
+ *            be       - Backend
+ *            in       - Input data
+ *            out      - Output buffer
+ *            size     - Input size
+ *            sys_addr - System Address of the first byte of in
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+static int selftest_ctr(const struct otfad_ctr *ctx, const struct otfad_aes_backend *be,
+			const uint8_t *in, uint8_t *out, size_t size, uint32_t sys_addr)
+{
+	struct otfad_ctr test = *ctx;
+	int err;
+
+	err = ctr_key_setup(&test, be);
+	if (err) {
+		return err;
+	}
+	err = otfad_ctr_crypt(&test, in, out, size, sys_addr);
+	be->key_free(test.ks);
+	OPENSSL_cleanse(&test, sizeof(test));
+
+	return err;
+}
+
+/*
+ * Description : Checks the ECB encryption of a backend for every number of
+ *               blocks up to SELFTEST_ECB_BLOCKS, and its decryption if any
+ *
+ * @Inputs  : be  - Backend
+ *            key - Key
+ *            in  - Plaintext blocks
+ *            exp - Expected ciphertext blocks
+ *            out - Work buffer
+ *
+ * @Outputs : return 0 on success, -OTFAD_ERR_SELFTEST on a mismatch or
+ *            another negated otfad_err
+ */
+static int selftest_check_ecb(const struct otfad_aes_backend *be, const uint8_t *key,
+			      const uint8_t *in, const uint8_t *exp, uint8_t *out)
+{
+	void *ks;
+	size_t n;
+	int err;
+
+	for (n = 1; n <= SELFTEST_ECB_BLOCKS; n++) {
+		err = selftest_ecb(be, key, in, out, n);
+		if (err) {
+			return err;
+		}
+		if (memcmp(out, exp, n * 16)) {
+			return -OTFAD_ERR_SELFTEST;
+		}
+	}
+
+	if (be->caps & OTFAD_AES_CAP_DECRYPT) {
+		err = be->key_new(key, 1, &ks);
+		if (err) {
+			return err;
+		}
+		err = be->ecb(ks, exp, out, SELFTEST_ECB_BLOCKS);
+		be->key_free(ks);
+		if (err) {
+			return err;
+		}
+		if (memcmp(out, in, SELFTEST_ECB_BLOCKS * 16)) {
+			return -OTFAD_ERR_SELFTEST;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Checks every AES backend usable on this host against
+ *               OpenSSL: its ECB encryption (and decryption), its OTFAD CTR
+ *               operation at various sizes and addresses, then
+ *               otfad_ctr_crypt_multi() and the key wrap of the selected
+ *               backend against the RFC3394 test vector.
+ *
+ * @Outputs : return 0 on success, -OTFAD_ERR_SELFTEST on a mismatch or
+ *            another negated otfad_err
+ */
+int otfad_selftest(void)
+{
+	/* RFC3394 4.1: wrap 128 bits of key data with a 128-bit KEK */
+	static const uint8_t kw_kek[16] = {
+		0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+		0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F
+	};
+	static const uint8_t kw_pt[16] = {
+		0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+		0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF
+	};
+	static const uint8_t kw_ct[24] = {
+		0x1F, 0xA6, 0x8B, 0x0A, 0x81, 0x12, 0xB4, 0x47,
+		0xAE, 0xF3, 0x4B, 0xD8, 0xFB, 0x5A, 0x7B, 0x82,
+		0x9D, 0x3E, 0x86, 0x23, 0x71, 0xD2, 0xCF, 0xE5
+	};
+	static const size_t sizes[] = {
+		1, 15, 16, 17, 127, 128, 129, 255, 256, 1000, SELFTEST_SIZE
+	};
+	const struct otfad_aes_backend *be;
+	struct otfad_ctr *ctx[OTFAD_NUM_CONTEXT] = {NULL};
+	struct otfad_ctr_op op[OTFAD_NUM_CONTEXT];
+	uint8_t key[OTFAD_KEY_SIZE];
+	uint8_t ctr[OTFAD_CTR_SIZE];
+	uint8_t wrapped[sizeof(kw_ct)];
+	uint8_t *in = NULL;
+	uint8_t *exp = NULL;
+	uint8_t *out = NULL;
+	uint32_t state = SELFTEST_SEED;
+	uint32_t sys_addr;
+	int err;
+	int i, b;
+
+	in = malloc(SELFTEST_SIZE);
+	exp = malloc(SELFTEST_SIZE);
+	out = malloc(SELFTEST_SIZE);
+	if (in == NULL || exp == NULL || out == NULL) {
+		err = -OTFAD_ERR_NOMEM;
+		goto out;
+	}
+	selftest_fill(&state, in, SELFTEST_SIZE);
+	selftest_fill(&state, key, sizeof(key));
+	selftest_fill(&state, ctr, sizeof(ctr));
+
+	/* ECB of each backend, partial and several batches, against OpenSSL */
+	err = selftest_ecb(&otfad_backend_openssl, key, in, exp, SELFTEST_ECB_BLOCKS);
+	if (err) {
+		goto out;
+	}
+	for (b = 0; otfad_backends[b] != NULL; b++) {
+		be = otfad_backends[b];
+		if (!be->supported()) {
+			continue;
+		}
+		err = selftest_check_ecb(be, key, in, exp, out);
+		if (err) {
+			goto out;
+		}
+	}
+
+	/* CTR of each backend against OpenSSL */
+	err = otfad_ctr_new(key, ctr, &ctx[0]);
+	if (err) {
+		goto out;
+	}
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		sys_addr = 0xC0001000 + (uint32_t)i * 0x1230;
+		err = selftest_ctr(ctx[0], &otfad_backend_openssl, in, exp, sizes[i], sys_addr);
+		if (err) {
+			goto out;
+		}
+		for (b = 0; otfad_backends[b] != NULL; b++) {
+			if (!otfad_backends[b]->supported()) {
+				continue;
+			}
+			err = selftest_ctr(ctx[0], otfad_backends[b], in, out, sizes[i], sys_addr);
+			if (err) {
+				goto out;
+			}
+			if (memcmp(out, exp, sizes[i])) {
+				err = -OTFAD_ERR_SELFTEST;
+				goto out;
+			}
+		}
+	}
+
+	/* Contexts interleaved by otfad_ctr_crypt_multi, as selected */
+	for (i = 1; i < OTFAD_NUM_CONTEXT; i++) {
+		selftest_fill(&state, key, sizeof(key));
+		selftest_fill(&state, ctr, sizeof(ctr));
+		err = otfad_ctr_new(key, ctr, &ctx[i]);
+		if (err) {
+			goto out;
+		}
+	}
+	for (i = 0; i < OTFAD_NUM_CONTEXT; i++) {
+		op[i].ctx = ctx[i];
+		op[i].in = in + i * (SELFTEST_SIZE / OTFAD_NUM_CONTEXT);
+		op[i].out = out + i * (SELFTEST_SIZE / OTFAD_NUM_CONTEXT);
+		op[i].size = SELFTEST_SIZE / OTFAD_NUM_CONTEXT - 16 * i - i;
+		op[i].sys_addr = 0xC0002000 + (uint32_t)i * 0x10000;
+	}
+	err = otfad_ctr_crypt_multi(op, OTFAD_NUM_CONTEXT);
+	if (err) {
+		goto out;
+	}
+	for (i = 0; i < OTFAD_NUM_CONTEXT; i++) {
+		err = selftest_ctr(ctx[i], &otfad_backend_openssl, op[i].in, exp, op[i].size,
+				   op[i].sys_addr);
+		if (err) {
+			goto out;
+		}
+		if (memcmp(op[i].out, exp, op[i].size)) {
+			err = -OTFAD_ERR_SELFTEST;
+			goto out;
+		}
+	}
+
+	/* Key wrap, with the implementation selected for this host */
+	err = otfad_key_wrap(kw_pt, sizeof(kw_pt), kw_kek, wrapped);
+	if (err == 0 && memcmp(wrapped, kw_ct, sizeof(kw_ct))) {
+		err = -OTFAD_ERR_SELFTEST;
+	}
+
+out:
+	for (i = 0; i < OTFAD_NUM_CONTEXT; i++) {
+		otfad_ctr_free(ctx[i]);
+	}
+	free(in);
+	free(exp);
+	free(out);
+
+	return err;
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright 2019 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/* OpenSSL includes*/
+#include <openssl/crypto.h>
+
+#include "otfad.h"
+#include "otfad_backend.h"
+#include "otfad_swap.h"
+#include "otfad_trace.h"
+
+#define IV_SIZE                 8
+#define SEMIBLOCK_SIZE          8
+#define CRC32_FILLER            0x00000000
+
+/* Region descriptor defines */
+#define CTX_RGD_W_RO_SHIFT      2
+#define CTX_RGD_W_ADE_SHIFT     1
+#define CTX_RGD_W_VLD_SHIFT     0
+#define RO                      0x0 << CTX_RGD_W_RO_SHIFT
+#define ADE                     0x1 << CTX_RGD_W_ADE_SHIFT
+#define SRT_ADDR_MASK           0xFFFFFC00
+#define END_ADDR_MASK           0xFFFFFFF8
+#define END_ADDR_RSVD           0x3F8
+
+/* IV is constant as per RFC3394 */
+static const unsigned char iv[IV_SIZE] = {
+	0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6
+};
+
+/*
+ * Description : AES-128 key wrap as per RFC3394
+ *
+ * @Inputs  : pt      - Plaintext
+ *            pt_size - Plaintext size, a multiple of 8 bytes of at least 16
+ *            kek     - Key Encryption Key
+ *            ct      - Ciphertext output of pt_size + 8 bytes
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_key_wrap(const uint8_t *pt, size_t pt_size, const uint8_t *kek, uint8_t *ct)
+{
+	const struct otfad_aes_backend *be;
+	void *ks;
+	unsigned char temp_in_pt[16]; // 128‐bit temporary plaintext input vector
+	unsigned char temp_out_ct[16]; // 128‐bit temp register
+	unsigned char *int_chk = ct; // 64‐bit integrity check register
+	size_t n = pt_size / SEMIBLOCK_SIZE;
+	size_t i, j; // loop counters
+	uint64_t t;
+	int k;
+	int ret;
+
+	if (pt == NULL || kek == NULL || ct == NULL ||
+	    n < 2 || pt_size % SEMIBLOCK_SIZE) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+#if DEBUG
+	printf("Key Encryption Key (KEK): ");
+	for (i = 0; i < 16; i++)
+		printf("%02X", kek[i]);
+
+	printf("\nIV: ");
+	for (i = 0; i < 8; i++)
+		printf("%02X", iv[i]);
+
+	printf("\nPlaintext: ");
+	for (i = 0; i < pt_size; i++)
+		printf("%02X", pt[i]);
+#endif
+
+	otfad_trace_init();
+
+	/* AES backend of the process: the bitsliced AES rather than OpenSSL
+	 * table lookups indexed by KEK dependent data on hosts without AES-NI */
+	ret = otfad_backend_get(&be);
+	if (ret) {
+		return ret;
+	}
+	ret = be->key_new(kek, 0, &ks);
+	if (ret) {
+		return ret;
+	}
+
+	/*
+	 * step 1: initialize the byte‐sized data variables
+	 * set A = IV
+	 * for i = 1 to n
+	 * R[i] = P[i]
+	 * A and R[] are kept in the ciphertext buffer: C[0] = A, C[i] = R[i]
+	 */
+	memmove(ct + SEMIBLOCK_SIZE, pt, pt_size);
+	memcpy(int_chk, iv, IV_SIZE);
+
+	/*
+	 * step 2: calculate intermediate values
+	 * for j = 0 to 5
+	 * for i = 1 to n
+	 * B = AES(K, A | R[i])
+	 * A = MSB(64, B) ^ (n*j)+i
+	 * R[i] = LSB(64, B)
+	 */
+	for (j = 0; j <= 5; j++) {
+		for (i = 1; i <= n; i++) {
+			memcpy(temp_in_pt, int_chk, SEMIBLOCK_SIZE);
+			memcpy(temp_in_pt + SEMIBLOCK_SIZE, ct + SEMIBLOCK_SIZE * i, SEMIBLOCK_SIZE);
+
+			/* Encrypt plaintext */
+			ret = be->ecb(ks, temp_in_pt, temp_out_ct, 1);
+			if (ret) goto out;
+
+			memcpy(int_chk, temp_out_ct, SEMIBLOCK_SIZE);
+			t = (n * j) + i;
+			for (k = SEMIBLOCK_SIZE - 1; k >= 0 && t; k--, t >>= 8) {
+				int_chk[k] ^= (uint8_t)t;
+			}
+			if (otfad_trace_on(OTFAD_TRACE_BLOCK)) {
+				otfad_trace_event(OTFAD_TRACE_EV_WRAP, otfad_trace_time(), (uint32_t)(n * j + i),
+						  sizeof(temp_out_ct), int_chk, SEMIBLOCK_SIZE,
+						  otfad_trace_hash(temp_out_ct, 0));
+			}
+			memcpy(ct + SEMIBLOCK_SIZE * i, temp_out_ct + SEMIBLOCK_SIZE, SEMIBLOCK_SIZE);
+		} // end for (i)
+	} // end for (j)
+
+#if DEBUG
+	printf("\nCiphertext: ");
+	for (i = 0; i < pt_size + SEMIBLOCK_SIZE; i++)
+		printf("%02X", ct[i]);
+#endif
+
+	ret = 0;
+out:
+	/* Clean up */
+	be->key_free(ks);
+	OPENSSL_cleanse(temp_in_pt, sizeof(temp_in_pt));
+	OPENSSL_cleanse(temp_out_ct, sizeof(temp_out_ct));
+
+	return ret;
+}
+
+/*
+ * Description : Builds the key blob plaintext of an OTFAD context
+ *
+ *               key + ctr +
+ *               rgd_w0 <-- start_addr
+ *               rgd_w1 <-- end_addr + AES decryption enabled + valid context
+ *               crc_w0 <-- CRC Filler
+ *               crc_w1 <-- Calculated CRC
+ *
+ * @Inputs  : key        - Image Encryption Key (OTFAD_KEY_SIZE bytes)
+ *            ctr        - Counter (OTFAD_CTR_SIZE bytes)
+ *            start_addr - Start address of the region
+ *            end_addr   - End address of the region
+ *            valid      - Valid context bit
+ *            pt         - Plaintext output (OTFAD_KEYBLOB_PT_SIZE bytes)
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_keyblob_plaintext(const uint8_t *key, const uint8_t *ctr, uint32_t start_addr,
+			    uint32_t end_addr, int valid, uint8_t *pt)
+{
+	uint32_t rgd_w0;
+	uint32_t rgd_w1;
+	uint32_t crc_w0 = CRC32_FILLER;
+	uint32_t crc_w1;
+
+	if (key == NULL || ctr == NULL || pt == NULL) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+	/* Least Significant 9 bits are reserved as 0 */
+	rgd_w0 = start_addr & SRT_ADDR_MASK;
+	rgd_w1 = (end_addr & END_ADDR_MASK) | END_ADDR_RSVD | RO | ADE |
+		 ((valid ? 1 : 0) << CTX_RGD_W_VLD_SHIFT);
+
+	memcpy(pt, key, OTFAD_KEY_SIZE);
+	memcpy(pt + OTFAD_KEY_SIZE, ctr, OTFAD_CTR_SIZE);
+	memcpy(pt + OTFAD_KEY_SIZE + OTFAD_CTR_SIZE, &rgd_w0, 4);
+	memcpy(pt + OTFAD_KEY_SIZE + OTFAD_CTR_SIZE + 4, &rgd_w1, 4);
+	memcpy(pt + OTFAD_KEY_SIZE + OTFAD_CTR_SIZE + 8, &crc_w0, 4);
+
+	crc_w1 = otfad_crc32(pt, OTFAD_KEY_SIZE + OTFAD_CTR_SIZE + 8);
+
+	memcpy(pt + OTFAD_KEY_SIZE + OTFAD_CTR_SIZE + 12, &crc_w1, 4);
+
+	return 0;
+}
+
+/*
+ * Description : Wraps a key blob plaintext into the key blob read by the
+ *               OTFAD engine: RFC3394 key wrap, MX7ULP post swap and zero
+ *               padding up to OTFAD_KEYBLOB_SIZE
+ *
+ * @Inputs  : pt   - Key blob plaintext (OTFAD_KEYBLOB_PT_SIZE bytes)
+ *            kek  - OTFAD key (Key Encryption Key), possibly scrambled
+ *            blob - Key blob output (OTFAD_KEYBLOB_SIZE bytes)
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_keyblob_wrap(const uint8_t *pt, const uint8_t *kek, uint8_t *blob)
+{
+	int ret;
+
+	ret = otfad_key_wrap(pt, OTFAD_KEYBLOB_PT_SIZE, kek, blob);
+	if (ret) {
+		return ret;
+	}
+
+	/*
+	 *  For MX7ULP:
+	 *  1. Post swap needed, given otfad_io will do the bytes swap within every
+	 *     64bits wrapped data before send them to aes engine.
+	 *  2. otp_key[127:0] should be byte reversed compared with KEK string.
+	 *     For example, KEK=00112233445566778899AABBCCDDEEFF, the otp_key should be:
+	 *     otp_key[127:0] = 128'h33221100_77665544_BBAA9988_FFEEDDCC
+	 */
+	otfad_swap(blob, blob, OTFAD_KEYBLOB_CT_SIZE / 16);
+
+	/* Pad to OTFAD_KEYBLOB_SIZE */
+	memset(blob + OTFAD_KEYBLOB_CT_SIZE, 0, OTFAD_KEYBLOB_SIZE - OTFAD_KEYBLOB_CT_SIZE);
+
+	return 0;
+}
+
+/*
+ * Description : AES-128 key unwrap as per RFC3394, the reverse of
+ *               otfad_key_wrap
+ *
+ * @Inputs  : ct      - Ciphertext
+ *            ct_size - Ciphertext size, a multiple of 8 bytes of at least 24
+ *            kek     - Key Encryption Key
+ *            pt      - Plaintext output of ct_size - 8 bytes
+ *
+ * @Outputs : return 0 on success, -OTFAD_ERR_INTEGRITY if the unwrapped IV
+ *            doesn't match (wrong KEK or corrupted ciphertext), negated
+ *            otfad_err otherwise
+ */
+int otfad_key_unwrap(const uint8_t *ct, size_t ct_size, const uint8_t *kek, uint8_t *pt)
+{
+	const struct otfad_aes_backend *be;
+	void *ks;
+	unsigned char temp_in_ct[16];
+	unsigned char temp_out_pt[16];
+	unsigned char int_chk[IV_SIZE];
+	size_t n = ct_size / SEMIBLOCK_SIZE - 1;
+	size_t i, j;
+	uint64_t t;
+	int k;
+	int ret;
+
+	if (ct == NULL || kek == NULL || pt == NULL ||
+	    ct_size < 3 * SEMIBLOCK_SIZE || ct_size % SEMIBLOCK_SIZE) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+	otfad_trace_init();
+
+	/* Backends without decryption (bitsliced) leave it to OpenSSL */
+	ret = otfad_backend_get(&be);
+	if (ret) {
+		return ret;
+	}
+	if (!(be->caps & OTFAD_AES_CAP_DECRYPT)) {
+		be = &otfad_backend_openssl;
+	}
+	ret = be->key_new(kek, 1, &ks);
+	if (ret) {
+		return ret;
+	}
+
+	/*
+	 * step 1: initialize variables
+	 * set A = C[0]
+	 * for i = 1 to n
+	 * R[i] = C[i]
+	 * R[] is kept in the plaintext buffer: P[i - 1] = R[i]
+	 */
+	memcpy(int_chk, ct, IV_SIZE);
+	memmove(pt, ct + SEMIBLOCK_SIZE, ct_size - SEMIBLOCK_SIZE);
+
+	/*
+	 * step 2: compute intermediate values
+	 * for j = 5 to 0
+	 * for i = n to 1
+	 * B = AES-1(K, (A ^ t) | R[i]) where t = n*j+i
+	 * A = MSB(64, B)
+	 * R[i] = LSB(64, B)
+	 */
+	for (j = 6; j-- > 0; ) {
+		for (i = n; i >= 1; i--) {
+			memcpy(temp_in_ct, int_chk, SEMIBLOCK_SIZE);
+			t = (n * j) + i;
+			for (k = SEMIBLOCK_SIZE - 1; k >= 0 && t; k--, t >>= 8) {
+				temp_in_ct[k] ^= (uint8_t)t;
+			}
+			memcpy(temp_in_ct + SEMIBLOCK_SIZE, pt + SEMIBLOCK_SIZE * (i - 1), SEMIBLOCK_SIZE);
+
+			ret = be->ecb(ks, temp_in_ct, temp_out_pt, 1);
+			if (ret) goto out;
+
+			memcpy(int_chk, temp_out_pt, SEMIBLOCK_SIZE);
+			memcpy(pt + SEMIBLOCK_SIZE * (i - 1), temp_out_pt + SEMIBLOCK_SIZE, SEMIBLOCK_SIZE);
+			if (otfad_trace_on(OTFAD_TRACE_BLOCK)) {
+				otfad_trace_event(OTFAD_TRACE_EV_UNWRAP, otfad_trace_time(), (uint32_t)(n * j + i),
+						  sizeof(temp_out_pt), int_chk, SEMIBLOCK_SIZE,
+						  otfad_trace_hash(temp_out_pt, 0));
+			}
+		}
+	}
+
+	/* step 3: the result is valid only if A is the constant IV */
+	if (CRYPTO_memcmp(int_chk, iv, IV_SIZE)) {
+		OPENSSL_cleanse(pt, ct_size - SEMIBLOCK_SIZE);
+		ret = -OTFAD_ERR_INTEGRITY;
+		goto out;
+	}
+
+	ret = 0;
+out:
+	be->key_free(ks);
+	OPENSSL_cleanse(temp_in_ct, sizeof(temp_in_ct));
+	OPENSSL_cleanse(temp_out_pt, sizeof(temp_out_pt));
+
+	return ret;
+}
+
+/*
+ * Description : Unwraps a key blob read by the OTFAD engine back into its
+ *               plaintext, the reverse of otfad_keyblob_wrap
+ *
+ * @Inputs  : blob - Key blob (OTFAD_KEYBLOB_SIZE bytes)
+ *            kek  - OTFAD key (Key Encryption Key), possibly scrambled
+ *            pt   - Key blob plaintext output (OTFAD_KEYBLOB_PT_SIZE bytes)
+ *
+ * @Outputs : return 0 on success, -OTFAD_ERR_INTEGRITY for a wrong KEK or a
+ *            corrupted blob, negated otfad_err otherwise
+ */
+int otfad_keyblob_unwrap(const uint8_t *blob, const uint8_t *kek, uint8_t *pt)
+{
+	uint8_t ct[OTFAD_KEYBLOB_CT_SIZE];
+	int ret;
+
+	if (blob == NULL) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+	/* Undo the MX7ULP post swap, see otfad_keyblob_wrap */
+	otfad_swap(ct, blob, OTFAD_KEYBLOB_CT_SIZE / 16);
+
+	ret = otfad_key_unwrap(ct, OTFAD_KEYBLOB_CT_SIZE, kek, pt);
+	OPENSSL_cleanse(ct, sizeof(ct));
+
+	return ret;
+}
+
+/*
+ * Description : Decodes a key blob plaintext and checks its CRC, the
+ *               reverse of otfad_keyblob_plaintext. The region is decoded
+ *               as the OTFAD engine does: the descriptor only holds the
+ *               address bits down to 1 KB, so the region covers
+ *               [start_addr, end_addr] with end_addr ending in 0x3FF.
+ *
+ * @Inputs  : pt         - Key blob plaintext (OTFAD_KEYBLOB_PT_SIZE bytes)
+ *            key        - Image Encryption Key output (OTFAD_KEY_SIZE bytes)
+ *            ctr        - Counter output (OTFAD_CTR_SIZE bytes)
+ *            start_addr - First address of the region
+ *            end_addr   - Last address of the region (inclusive)
+ *            valid      - 1 if the context is valid with AES decryption
+ *                         enabled, 0 otherwise
+ *
+ * @Outputs : return 0 on success, -OTFAD_ERR_INTEGRITY on a CRC mismatch,
+ *            negated otfad_err otherwise
+ */
+int otfad_keyblob_parse(const uint8_t *pt, uint8_t *key, uint8_t *ctr, uint32_t *start_addr,
+			uint32_t *end_addr, int *valid)
+{
+	uint32_t rgd_w0;
+	uint32_t rgd_w1;
+	uint32_t crc_w1;
+
+	if (pt == NULL || key == NULL || ctr == NULL ||
+	    start_addr == NULL || end_addr == NULL || valid == NULL) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+	memcpy(&crc_w1, pt + OTFAD_KEY_SIZE + OTFAD_CTR_SIZE + 12, 4);
+	if (crc_w1 != otfad_crc32(pt, OTFAD_KEY_SIZE + OTFAD_CTR_SIZE + 8)) {
+		return -OTFAD_ERR_INTEGRITY;
+	}
+
+	memcpy(key, pt, OTFAD_KEY_SIZE);
+	memcpy(ctr, pt + OTFAD_KEY_SIZE, OTFAD_CTR_SIZE);
+	memcpy(&rgd_w0, pt + OTFAD_KEY_SIZE + OTFAD_CTR_SIZE, 4);
+	memcpy(&rgd_w1, pt + OTFAD_KEY_SIZE + OTFAD_CTR_SIZE + 4, 4);
+
+	*start_addr = rgd_w0 & SRT_ADDR_MASK;
+	*end_addr = rgd_w1 | ~SRT_ADDR_MASK;
+	*valid = (rgd_w1 & (1 << CTX_RGD_W_VLD_SHIFT)) && (rgd_w1 & (1 << CTX_RGD_W_ADE_SHIFT));
+
+	return 0;
+}
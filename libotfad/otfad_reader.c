@@ -0,0 +1,605 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/* OpenSSL includes*/
+#include <openssl/crypto.h>
+
+#include "otfad.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define READER_SHARD_SHIFT      4
+#define READER_SHARDS           (1 << READER_SHARD_SHIFT)
+/* Lines of one shard group, a 1 KB region granule */
+#define READER_GROUP_SHIFT      3
+#define READER_GROUP_LINES      (1 << READER_GROUP_SHIFT)
+#define READER_LINE_SHIFT       7
+/* Lines of a set, whose tags are compared at once */
+#define READER_WAYS             8
+#define READER_HASH_MULT        0x9E3779B1u
+#define READER_CACHE_LINE_SIZE  64
+/* Tag of an empty way, above any line of the 32-bit address space */
+#define TAG_NONE                0xFFFFFFFFu
+#define LINE_NONE               (-1)
+
+/* Tags of the lines of a set, line set * READER_WAYS + way of the shard */
+struct reader_set {
+	uint32_t tag[READER_WAYS];
+} __attribute__((aligned(32)));
+
+/* Shard of the keystream cache, with its own lock: an 8-way set-associative
+ * cache, least recently used way evicted */
+struct reader_shard {
+	pthread_mutex_t lock;
+	struct reader_set *set;
+	/* Time of the last use of each line */
+	uint64_t *stamp;
+	uint64_t clock;
+	uint32_t set_mask;
+	int32_t n_lines;
+	uint8_t *ks;
+	uint64_t hits;
+	uint64_t misses;
+} __attribute__((aligned(READER_CACHE_LINE_SIZE)));
+
+struct reader_region {
+	const struct otfad_ctr *ctx;
+	uint32_t start_addr;
+	uint32_t size;
+};
+
+struct otfad_reader {
+	struct reader_shard shard[READER_SHARDS];
+	const uint8_t *image;
+	size_t image_size;
+	uint32_t image_addr;
+	struct reader_region region[OTFAD_NUM_CONTEXT];
+	int n_regions;
+};
+
+/* One line of a batch read */
+struct reader_item {
+	uint32_t shard;
+	uint32_t tag;
+	const struct otfad_read *req;
+};
+
+static const uint8_t zero_lines[READER_GROUP_LINES * OTFAD_READER_LINE_SIZE];
+
+/*
+ * Description : Shard of a line. The lines of a 1 KB granule share their
+ *               shard, so sequential misses are generated in one call.
+ */
+static uint32_t line_shard(uint32_t tag)
+{
+	return ((tag >> READER_GROUP_SHIFT) * READER_HASH_MULT) >> (32 - READER_SHARD_SHIFT);
+}
+
+static uint32_t line_set(const struct reader_shard *sh, uint32_t tag)
+{
+	return (tag * READER_HASH_MULT) & sh->set_mask;
+}
+
+/*
+ * Description : Returns the region holding an address, the first one
+ *               added on overlap as the OTFAD engine uses the lowest
+ *               numbered context
+ */
+static const struct reader_region *find_region(const struct otfad_reader *rd, uint32_t addr)
+{
+	int i;
+
+	for (i = 0; i < rd->n_regions; i++) {
+		if (addr - rd->region[i].start_addr < rd->region[i].size) {
+			return &rd->region[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Compares a tag with the 8 tags of a set at once (two SSE2
+ *               or NEON compares, one mask)
+ *
+ * @Outputs : return the way holding tag, LINE_NONE if none
+ */
+static int set_probe(const struct reader_set *set, uint32_t tag)
+{
+#if defined(__SSE2__)
+	const __m128i t = _mm_set1_epi32((int)tag);
+	__m128i lo = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)set->tag), t);
+	__m128i hi = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)(set->tag + 4)), t);
+	int mask = _mm_movemask_ps(_mm_castsi128_ps(lo)) | (_mm_movemask_ps(_mm_castsi128_ps(hi)) << 4);
+
+	return mask ? __builtin_ctz(mask) : LINE_NONE;
+#elif defined(__ARM_NEON)
+	const uint32x4_t t = vdupq_n_u32(tag);
+	uint16x8_t eq = vcombine_u16(vmovn_u32(vceqq_u32(vld1q_u32(set->tag), t)),
+				     vmovn_u32(vceqq_u32(vld1q_u32(set->tag + 4), t)));
+	uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(eq)), 0);
+
+	return mask ? __builtin_ctzll(mask) / 8 : LINE_NONE;
+#else
+	int w;
+
+	for (w = 0; w < READER_WAYS; w++) {
+		if (set->tag[w] == tag) {
+			return w;
+		}
+	}
+	return LINE_NONE;
+#endif
+}
+
+/*
+ * Description : Looks a line up and makes it the most recently used one
+ *
+ * @Outputs : return the line index, LINE_NONE if not cached
+ */
+static int32_t shard_lookup(struct reader_shard *sh, uint32_t tag)
+{
+	uint32_t s = line_set(sh, tag);
+	int32_t i;
+	int w;
+
+	w = set_probe(&sh->set[s], tag);
+	if (w == LINE_NONE) {
+		return LINE_NONE;
+	}
+	i = s * READER_WAYS + w;
+	sh->stamp[i] = ++sh->clock;
+
+	return i;
+}
+
+/*
+ * Description : Takes an empty way of the set of tag, or evicts its least
+ *               recently used one, and makes it the most recently used
+ *               line of tag
+ *
+ * @Outputs : return the line index
+ */
+static int32_t shard_insert(struct reader_shard *sh, uint32_t tag)
+{
+	uint32_t s = line_set(sh, tag);
+	int32_t base = s * READER_WAYS;
+	int w, v;
+
+	w = set_probe(&sh->set[s], TAG_NONE);
+	if (w == LINE_NONE) {
+		for (w = 0, v = 1; v < READER_WAYS; v++) {
+			if (sh->stamp[base + v] < sh->stamp[base + w]) {
+				w = v;
+			}
+		}
+	}
+
+	sh->set[s].tag[w] = tag;
+	sh->stamp[base + w] = ++sh->clock;
+
+	return base + w;
+}
+
+/*
+ * Description : Returns the keystream of a line, generating the missing
+ *               lines of the granule from tag up to last_tag in one call.
+ *               Called with the shard locked.
+ *
+ * @Inputs  : rd       - Reader
+ *            sh       - Locked shard of the line
+ *            rgn      - Region of the line
+ *            tag      - Line
+ *            last_tag - Last line of the same shard and region to prefetch
+ *            ks       - Keystream output
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+static int shard_keystream(const struct otfad_reader *rd, struct reader_shard *sh,
+			   const struct reader_region *rgn, uint32_t tag, uint32_t last_tag,
+			   const uint8_t **ks)
+{
+	uint8_t buf[READER_GROUP_LINES * OTFAD_READER_LINE_SIZE];
+	uint32_t n, k;
+	int32_t i;
+	int err;
+
+	i = shard_lookup(sh, tag);
+	if (i != LINE_NONE) {
+		sh->hits++;
+		*ks = sh->ks + (size_t)i * OTFAD_READER_LINE_SIZE;
+		return 0;
+	}
+
+	/* Missing run of lines in the granule of tag */
+	for (n = 1; tag + n <= last_tag && ((tag + n) % READER_GROUP_LINES) != 0; n++) {
+		if (find_region(rd, (tag + n) << READER_LINE_SHIFT) != rgn ||
+		    shard_lookup(sh, tag + n) != LINE_NONE) {
+			break;
+		}
+	}
+
+	err = otfad_ctr_crypt(rgn->ctx, zero_lines, buf, n * OTFAD_READER_LINE_SIZE,
+			      tag << READER_LINE_SHIFT);
+	if (err) {
+		return err;
+	}
+	sh->misses += n;
+
+	/* Inserted last first, so that tag ends up the most recently used */
+	for (k = n; k-- > 0; ) {
+		i = shard_insert(sh, tag + k);
+		memcpy(sh->ks + (size_t)i * OTFAD_READER_LINE_SIZE,
+		       buf + k * OTFAD_READER_LINE_SIZE, OTFAD_READER_LINE_SIZE);
+	}
+	OPENSSL_cleanse(buf, n * OTFAD_READER_LINE_SIZE);
+	*ks = sh->ks + (size_t)i * OTFAD_READER_LINE_SIZE;
+
+	return 0;
+}
+
+/*
+ * Description : Reads the part of a line covered by a read request
+ *
+ * @Inputs  : rd       - Reader
+ *            sh       - Locked shard of the line
+ *            tag      - Line
+ *            last_tag - Last line of the request
+ *            req      - Read request
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+static int read_line(struct otfad_reader *rd, struct reader_shard *sh, uint32_t tag,
+		     uint32_t last_tag, const struct otfad_read *req)
+{
+	const struct reader_region *rgn;
+	const uint8_t *ks;
+	uint32_t line_addr = tag << READER_LINE_SHIFT;
+	uint32_t start = (req->addr > line_addr) ? req->addr : line_addr;
+	uint32_t end = line_addr + OTFAD_READER_LINE_SIZE;
+	const uint8_t *in;
+	uint8_t *out;
+	int err;
+
+	if (end - req->addr > req->size) {
+		end = req->addr + req->size;
+	}
+	in = rd->image + (start - rd->image_addr);
+	out = req->buf + (start - req->addr);
+
+	/* Plaintext outside of the regions */
+	rgn = find_region(rd, line_addr);
+	if (rgn == NULL) {
+		memcpy(out, in, end - start);
+		return 0;
+	}
+
+	err = shard_keystream(rd, sh, rgn, tag, last_tag, &ks);
+	if (err) {
+		return err;
+	}
+	otfad_xor(in, ks + (start - line_addr), out, end - start);
+
+	return 0;
+}
+
+/*
+ * Description : Checks that a read request is within the image
+ */
+static int check_read(const struct otfad_reader *rd, const struct otfad_read *req)
+{
+	if (req->buf == NULL || req->addr < rd->image_addr ||
+	    req->addr - rd->image_addr > rd->image_size ||
+	    req->size > rd->image_size - (req->addr - rd->image_addr)) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Creates an OTFAD read emulator of an encrypted image. It
+ *               returns the plaintext of any address range, the way the
+ *               OTFAD engine serves fetches, keeping the keystream of the
+ *               recently read lines in a sharded set-associative cache.
+ *
+ * @Inputs  : image      - Encrypted image, e.g. mapped; not copied, kept
+ *                         until otfad_reader_free
+ *            image_size - Image size
+ *            image_addr - System address of the first byte of image
+ *            cache_size - Keystream cache size in bytes (0: default
+ *                         OTFAD_READER_CACHE_SIZE)
+ *            rd         - Reader output, to be released with
+ *                         otfad_reader_free
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_reader_new(const uint8_t *image, size_t image_size, uint32_t image_addr,
+		     size_t cache_size, struct otfad_reader **rd)
+{
+	struct otfad_reader *r;
+	struct reader_shard *sh;
+	size_t n_lines;
+	uint32_t n_sets;
+	int i;
+
+	if (image == NULL || rd == NULL ||
+	    image_size > (size_t)UINT32_MAX + 1 - image_addr) {
+		return -OTFAD_ERR_INVAL;
+	}
+	if (cache_size == 0) {
+		cache_size = OTFAD_READER_CACHE_SIZE;
+	}
+
+	/* At least one granule per shard, see shard_keystream, and a power of 2
+	 * of sets */
+	n_lines = cache_size / OTFAD_READER_LINE_SIZE / READER_SHARDS;
+	if (n_lines > INT32_MAX / 2) {
+		return -OTFAD_ERR_INVAL;
+	}
+	for (n_sets = 1; (size_t)n_sets * 2 * READER_WAYS <= n_lines; n_sets <<= 1) {
+		;
+	}
+	n_lines = (size_t)n_sets * READER_WAYS;
+
+	if (posix_memalign((void **)&r, READER_CACHE_LINE_SIZE, sizeof(*r))) {
+		return -OTFAD_ERR_NOMEM;
+	}
+	memset(r, 0, sizeof(*r));
+	r->image = image;
+	r->image_size = image_size;
+	r->image_addr = image_addr;
+
+	for (i = 0; i < READER_SHARDS; i++) {
+		sh = &r->shard[i];
+		pthread_mutex_init(&sh->lock, NULL);
+		sh->n_lines = n_lines;
+		sh->set_mask = n_sets - 1;
+		sh->stamp = calloc(n_lines, sizeof(*sh->stamp));
+		if (posix_memalign((void **)&sh->set, READER_CACHE_LINE_SIZE, n_sets * sizeof(*sh->set))) {
+			sh->set = NULL;
+		}
+		/* Keystream lines, cleared when freed */
+		if (otfad_buf_alloc((size_t)n_lines * OTFAD_READER_LINE_SIZE,
+				    OTFAD_BUF_HUGE | OTFAD_BUF_SECRET, (void **)&sh->ks)) {
+			sh->ks = NULL;
+		}
+		if (sh->set == NULL || sh->stamp == NULL || sh->ks == NULL) {
+			otfad_reader_free(r);
+			return -OTFAD_ERR_NOMEM;
+		}
+		memset(sh->set, 0xFF, n_sets * sizeof(*sh->set));
+	}
+
+	*rd = r;
+
+	return 0;
+}
+
+/*
+ * Description : Adds an encrypted region to the reader. Regions added first
+ *               take precedence on overlap, as lower numbered contexts.
+ *               Adding regions is not thread-safe and must be done before
+ *               reading.
+ *
+ * @Inputs  : rd         - Reader
+ *            ctx        - CTR context of the region, kept until
+ *                         otfad_reader_free
+ *            start_addr - Start address of the region
+ *            size       - Region size
+ *
+ *            start_addr and size are multiples of OTFAD_READER_LINE_SIZE,
+ *            as OTFAD regions are 1 KB granular.
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_reader_add_region(struct otfad_reader *rd, const struct otfad_ctr *ctx,
+			    uint32_t start_addr, uint32_t size)
+{
+	if (rd == NULL || ctx == NULL || rd->n_regions == OTFAD_NUM_CONTEXT ||
+	    start_addr % OTFAD_READER_LINE_SIZE || size % OTFAD_READER_LINE_SIZE ||
+	    size == 0 || start_addr + (uint64_t)size - 1 > UINT32_MAX) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+	rd->region[rd->n_regions].ctx = ctx;
+	rd->region[rd->n_regions].start_addr = start_addr;
+	rd->region[rd->n_regions].size = size;
+	rd->n_regions++;
+
+	return 0;
+}
+
+/*
+ * Description : Reads the plaintext of an address range of the image.
+ *               Thread-safe.
+ *
+ * @Inputs  : rd   - Reader
+ *            addr - System address
+ *            buf  - Plaintext output
+ *            size - Number of bytes, within the image
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_reader_read(struct otfad_reader *rd, uint32_t addr, uint8_t *buf, size_t size)
+{
+	struct otfad_read req;
+	struct reader_shard *sh;
+	uint32_t tag, last_tag;
+	int err;
+
+	if (rd == NULL || size > UINT32_MAX) {
+		return -OTFAD_ERR_INVAL;
+	}
+	req.addr = addr;
+	req.size = size;
+	req.buf = buf;
+	err = check_read(rd, &req);
+	if (err || size == 0) {
+		return err;
+	}
+
+	last_tag = (addr + (uint32_t)(size - 1)) >> READER_LINE_SHIFT;
+	for (tag = addr >> READER_LINE_SHIFT; !err && tag <= last_tag; tag++) {
+		sh = &rd->shard[line_shard(tag)];
+		pthread_mutex_lock(&sh->lock);
+		err = read_line(rd, sh, tag, last_tag, &req);
+		pthread_mutex_unlock(&sh->lock);
+	}
+
+	return err;
+}
+
+/*
+ * Description : qsort comparator ordering batch lines by shard, then line
+ */
+static int cmp_item(const void *a, const void *b)
+{
+	const struct reader_item *ia = a;
+	const struct reader_item *ib = b;
+
+	if (ia->shard != ib->shard) {
+		return (ia->shard > ib->shard) - (ia->shard < ib->shard);
+	}
+	return (ia->tag > ib->tag) - (ia->tag < ib->tag);
+}
+
+/*
+ * Description : Reads the plaintext of scattered address ranges. The lines
+ *               of all requests are sorted by shard, so each shard is
+ *               locked once for all its lines, each looked up with one
+ *               SIMD tag compare, and the missing lines of a granule are
+ *               generated in one call. Thread-safe.
+ *
+ * @Inputs  : rd    - Reader
+ *            req   - Read requests, within the image
+ *            n_req - Number of requests
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ */
+int otfad_reader_read_batch(struct otfad_reader *rd, const struct otfad_read *req, size_t n_req)
+{
+	struct reader_item *item;
+	struct reader_shard *sh;
+	size_t n_items = 0;
+	size_t i, j, k, g;
+	uint32_t tag, last_tag;
+	int err = 0;
+
+	if (rd == NULL || (req == NULL && n_req)) {
+		return -OTFAD_ERR_INVAL;
+	}
+	for (i = 0; i < n_req; i++) {
+		err = check_read(rd, &req[i]);
+		if (err) {
+			return err;
+		}
+		if (req[i].size) {
+			n_items += ((req[i].addr + (uint64_t)req[i].size - 1) >> READER_LINE_SHIFT) -
+				   (req[i].addr >> READER_LINE_SHIFT) + 1;
+		}
+	}
+	if (n_items == 0) {
+		return 0;
+	}
+
+	item = malloc(n_items * sizeof(*item));
+	if (item == NULL) {
+		return -OTFAD_ERR_NOMEM;
+	}
+	for (i = 0, k = 0; i < n_req; i++) {
+		if (req[i].size == 0) {
+			continue;
+		}
+		last_tag = (req[i].addr + (req[i].size - 1)) >> READER_LINE_SHIFT;
+		for (tag = req[i].addr >> READER_LINE_SHIFT; tag <= last_tag; tag++) {
+			item[k].shard = line_shard(tag);
+			item[k].tag = tag;
+			item[k].req = &req[i];
+			k++;
+		}
+	}
+	qsort(item, n_items, sizeof(*item), cmp_item);
+
+	for (i = 0; !err && i < n_items; i = j) {
+		sh = &rd->shard[item[i].shard];
+		for (j = i + 1; j < n_items && item[j].shard == item[i].shard; j++) {
+			;
+		}
+
+		pthread_mutex_lock(&sh->lock);
+		for (k = i, g = i; !err && k < j; k++) {
+			/* Last line of the granule read by the batch, to prefetch up to */
+			if (g < k) {
+				g = k;
+			}
+			while (g + 1 < j && (item[g + 1].tag >> READER_GROUP_SHIFT) ==
+					    (item[k].tag >> READER_GROUP_SHIFT)) {
+				g++;
+			}
+			err = read_line(rd, sh, item[k].tag, item[g].tag, item[k].req);
+		}
+		pthread_mutex_unlock(&sh->lock);
+	}
+	free(item);
+
+	return err;
+}
+
+/*
+ * Description : Returns the keystream cache statistics
+ *
+ * @Inputs  : rd     - Reader
+ *            hits   - Lines read from the cache
+ *            misses - Lines generated
+ */
+void otfad_reader_stats(struct otfad_reader *rd, uint64_t *hits, uint64_t *misses)
+{
+	int i;
+
+	*hits = 0;
+	*misses = 0;
+	for (i = 0; rd != NULL && i < READER_SHARDS; i++) {
+		pthread_mutex_lock(&rd->shard[i].lock);
+		*hits += rd->shard[i].hits;
+		*misses += rd->shard[i].misses;
+		pthread_mutex_unlock(&rd->shard[i].lock);
+	}
+}
+
+/*
+ * Description : Releases a reader and clears its keystream cache
+ *
+ * @Inputs  : rd - Reader
+ */
+void otfad_reader_free(struct otfad_reader *rd)
+{
+	struct reader_shard *sh;
+	int i;
+
+	if (rd == NULL) {
+		return;
+	}
+
+	for (i = 0; i < READER_SHARDS; i++) {
+		sh = &rd->shard[i];
+		otfad_buf_free(sh->ks);
+		free(sh->stamp);
+		free(sh->set);
+		if (sh->n_lines) {
+			pthread_mutex_destroy(&sh->lock);
+		}
+	}
+	free(rd);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2019 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+
+#include "otfad.h"
+
+#define BIT_REVERSE8(x) do {   \
+				x = ((x & 0x55) << 1) | ((x & 0xAA) >> 1);  \
+				x = ((x & 0x33) << 2) | ((x & 0xCC) >> 2);  \
+				x = ((x & 0x0F) << 4) | ((x & 0xF0) >> 4);  \
+			 } while(0)
+
+/*
+ * Description : This function scrambles the input OTFAD key
+ *
+ * @Inputs  : otfad_key - OTFAD Key encryption key
+ *            key_scramble - Input key scramble, as fused
+ *            key_scramble_align - Input key scramble align
+ *            ctx_sel - OTFAD context (0 to OTFAD_NUM_CONTEXT - 1)
+ *            scrambled_key - Scrambled OTFAD key encryption key output
+ *
+ * @Outputs : return 0 on success, negated otfad_err otherwise
+ *
+ */
+int otfad_key_scramble(const uint8_t *otfad_key, const uint8_t *key_scramble,
+		       uint8_t key_scramble_align, int ctx_sel, uint8_t *scrambled_key)
+{
+	uint8_t scramble;
+	int i = 0, j = 0, k = 0;
+
+	if (otfad_key == NULL || key_scramble == NULL || scrambled_key == NULL ||
+	    ctx_sel < 0 || ctx_sel >= OTFAD_NUM_CONTEXT) {
+		return -OTFAD_ERR_INVAL;
+	}
+
+	memmove(scrambled_key, otfad_key, OTFAD_KEY_SIZE);
+
+	/*
+	 * retrieve the 2‐bit align select from the 8‐bit key_scramble_align
+	 * context_0_select = key_scramble_align[1:0]
+	 * context_1_select = key_scramble_align[3:2]
+	 * context_2_select = key_scramble_align[5:4]
+	 * context_3_select = key_scramble_align[7:6]
+	 */
+	j = 2 * ctx_sel;
+	k = ((key_scramble_align & (3 << j)) >> j);
+	/* XOR 4‐byte key_scramble[] into appropriate 4‐bytes of scrambled_key[] output */
+	for (i = 0; i < OTFAD_KEY_SCRAMBLE_SIZE; i++) {
+		/*
+		 * According to OTFAD engine's integration with 7ULP
+		 * the Scramble Key needs to be bit reversed at byte level.
+		 */
+		scramble = key_scramble[i];
+		BIT_REVERSE8(scramble);
+		scrambled_key[4*k + i] ^= scramble;
+	}
+
+	return 0;
+}
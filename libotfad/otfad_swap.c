@@ -0,0 +1,194 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+
+#include "otfad_swap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SSSE3_TARGET    __attribute__((target("ssse3")))
+#define AVX2_TARGET     __attribute__((target("avx2")))
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static inline uint64_t load64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline void store64(uint8_t *p, uint64_t v)
+{
+	memcpy(p, &v, 8);
+}
+
+/*
+ * Description : Portable transform, one byte reversal per 64-bit half (REV
+ *               on Arm, BSWAP on x86)
+ */
+static void otfad_swap_scalar(uint8_t *dst, const uint8_t *src, size_t n_blocks)
+{
+	size_t i;
+
+	for (i = 0; i < n_blocks * 16; i += 8) {
+		store64(dst + i, __builtin_bswap64(load64(src + i)));
+	}
+}
+
+/*
+ * Description : Portable transform and XOR. The last block may be partial.
+ */
+static void otfad_swap_xor_scalar(uint8_t *dst, const uint8_t *src, const uint8_t *ks, size_t size)
+{
+	size_t i;
+	size_t j;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		store64(dst + i, load64(src + i) ^ __builtin_bswap64(load64(ks + i)));
+	}
+	for (; i < size; i++) {
+		j = i & ~(size_t)7;
+		dst[i] = src[i] ^ ks[j + 7 - (i - j)];
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static SSSE3_TARGET void otfad_swap_ssse3(uint8_t *dst, const uint8_t *src, size_t n_blocks)
+{
+	const __m128i mask = _mm_setr_epi8(OTFAD_SWAP_MASK);
+	size_t i;
+
+	for (i = 0; i < n_blocks * 16; i += 16) {
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i)), mask));
+	}
+}
+
+static AVX2_TARGET void otfad_swap_avx2(uint8_t *dst, const uint8_t *src, size_t n_blocks)
+{
+	const __m256i mask = _mm256_setr_epi8(OTFAD_SWAP_MASK, OTFAD_SWAP_MASK);
+	size_t i;
+
+	for (i = 0; i + 32 <= n_blocks * 16; i += 32) {
+		_mm256_storeu_si256((__m256i *)(dst + i),
+				    _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + i)), mask));
+	}
+	otfad_swap_scalar(dst + i, src + i, n_blocks - i / 16);
+}
+
+static SSSE3_TARGET void otfad_swap_xor_ssse3(uint8_t *dst, const uint8_t *src, const uint8_t *ks, size_t size)
+{
+	const __m128i mask = _mm_setr_epi8(OTFAD_SWAP_MASK);
+	__m128i k;
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		k = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(ks + i)), mask);
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 _mm_xor_si128(k, _mm_loadu_si128((const __m128i *)(src + i))));
+	}
+	otfad_swap_xor_scalar(dst + i, src + i, ks + i, size - i);
+}
+
+static AVX2_TARGET void otfad_swap_xor_avx2(uint8_t *dst, const uint8_t *src, const uint8_t *ks, size_t size)
+{
+	const __m256i mask = _mm256_setr_epi8(OTFAD_SWAP_MASK, OTFAD_SWAP_MASK);
+	__m256i k;
+	size_t i;
+
+	for (i = 0; i + 32 <= size; i += 32) {
+		k = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(ks + i)), mask);
+		_mm256_storeu_si256((__m256i *)(dst + i),
+				    _mm256_xor_si256(k, _mm256_loadu_si256((const __m256i *)(src + i))));
+	}
+	/* GCC drops the implicit VZEROUPPER on this tail call: clear the
+	 * upper state so the SSE code of the caller does not run dirty */
+	_mm256_zeroupper();
+	otfad_swap_xor_scalar(dst + i, src + i, ks + i, size - i);
+}
+
+#elif defined(__ARM_NEON)
+
+static void otfad_swap_neon(uint8_t *dst, const uint8_t *src, size_t n_blocks)
+{
+	size_t i;
+
+	for (i = 0; i < n_blocks * 16; i += 16) {
+		vst1q_u8(dst + i, vrev64q_u8(vld1q_u8(src + i)));
+	}
+}
+
+static void otfad_swap_xor_neon(uint8_t *dst, const uint8_t *src, const uint8_t *ks, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		vst1q_u8(dst + i, veorq_u8(vld1q_u8(src + i), vrev64q_u8(vld1q_u8(ks + i))));
+	}
+	otfad_swap_xor_scalar(dst + i, src + i, ks + i, size - i);
+}
+
+#endif
+
+/*
+ * Description : Applies the MX7ULP OTFAD byte order transform to whole
+ *               128-bit blocks (a single PSHUFB / VPSHUFB / VREV64 per
+ *               vector)
+ *
+ * @Inputs  : dst      - Output buffer (may be equal to src)
+ *            src      - Input buffer
+ *            n_blocks - Number of 16-byte blocks
+ */
+void otfad_swap(uint8_t *dst, const uint8_t *src, size_t n_blocks)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("avx2")) {
+		otfad_swap_avx2(dst, src, n_blocks);
+		return;
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		otfad_swap_ssse3(dst, src, n_blocks);
+		return;
+	}
+#elif defined(__ARM_NEON)
+	otfad_swap_neon(dst, src, n_blocks);
+	return;
+#endif
+	otfad_swap_scalar(dst, src, n_blocks);
+}
+
+/*
+ * Description : XORs src with the OTFAD byte order transform of the
+ *               keystream ks, as done by the OTFAD engine in CTR mode
+ *
+ * @Inputs  : dst  - Output buffer (may be equal to src)
+ *            src  - Input buffer
+ *            ks   - Keystream, as output by AES, size bytes rounded up to
+ *                   a whole number of blocks
+ *            size - Number of bytes, the last block may be partial
+ */
+void otfad_swap_xor(uint8_t *dst, const uint8_t *src, const uint8_t *ks, size_t size)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("avx2")) {
+		otfad_swap_xor_avx2(dst, src, ks, size);
+		return;
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		otfad_swap_xor_ssse3(dst, src, ks, size);
+		return;
+	}
+#elif defined(__ARM_NEON)
+	otfad_swap_xor_neon(dst, src, ks, size);
+	return;
+#endif
+	otfad_swap_xor_scalar(dst, src, ks, size);
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef OTFAD_SWAP_H
+#define OTFAD_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * MX7ULP OTFAD byte order: bswap32 each word of a 128-bit block, then swap
+ * the word pairs (w0, w1) and (w2, w3). This is the same as reversing the
+ * bytes of each 64-bit half of the block.
+ */
+#define OTFAD_SWAP_MASK         7, 6, 5, 4, 3, 2, 1, 0, \
+				15, 14, 13, 12, 11, 10, 9, 8
+
+void otfad_swap(uint8_t *dst, const uint8_t *src, size_t n_blocks);
+void otfad_swap_xor(uint8_t *dst, const uint8_t *src, const uint8_t *ks, size_t size);
+
+#endif /* OTFAD_SWAP_H */
@@ -0,0 +1,375 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "otfad.h"
+#include "otfad_trace.h"
+#include "otfad_swap.h"
+
+#define TRACE_MIN_EVENTS        0x400
+#define FNV_OFFSET_BASIS        0x811C9DC5
+#define FNV_PRIME               0x01000193
+
+/* Ring of the events of one thread, written by that thread only. The ring
+ * of an exited thread is taken over by the next new thread, e.g. of the
+ * otfad_ctr_crypt_mt pools. */
+struct trace_ring {
+	struct trace_ring *next;
+	struct trace_ring *next_free;
+	struct otfad_trace_event *ev;
+	uint64_t head;          /* Events written since the start */
+	uint32_t thread;
+};
+
+int otfad_trace_level = OTFAD_TRACE_OFF;
+
+/* Trace set up by otfad_trace_start, under trace_lock */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring *trace_rings;
+static struct trace_ring *trace_free_rings;
+static uint32_t trace_n_rings;
+static size_t trace_n_events;
+static char *trace_fname;
+/* Bumped by every start and stop, so that threads drop the rings of a
+ * former trace */
+static unsigned int trace_gen;
+
+static __thread struct trace_ring *tls_ring;
+static __thread unsigned int tls_gen;
+
+/* Gives the ring of a thread back when it exits */
+static pthread_key_t ring_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+
+static pthread_once_t env_once = PTHREAD_ONCE_INIT;
+
+static void trace_atexit(void)
+{
+	int err = otfad_trace_stop();
+
+	if (err) {
+		fprintf(stderr, "Error: Trace not written; %s\n", otfad_strerror(err));
+	}
+}
+
+/*
+ * Description : Puts the ring of an exiting thread on the free list, unless
+ *               the trace it belongs to is over: its ring is freed then, and
+ *               its address may already be the ring of another thread
+ */
+static void trace_ring_release(void *arg)
+{
+	struct trace_ring *r = arg;
+
+	pthread_mutex_lock(&trace_lock);
+	if (r == tls_ring && tls_gen == trace_gen) {
+		r->next_free = trace_free_rings;
+		trace_free_rings = r;
+	}
+	pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * Description : Starts the trace named by OTFAD_TRACE_ENV, written at exit
+ */
+static void trace_env(void)
+{
+	const char *env = getenv(OTFAD_TRACE_ENV);
+	int level = OTFAD_TRACE_CHUNK;
+	size_t n_events = 0;
+	char *fname;
+	char *opt;
+
+	if (env == NULL || *env == '\0') {
+		return;
+	}
+	fname = strdup(env);
+	if (fname == NULL) {
+		return;
+	}
+	opt = strchr(fname, ',');
+	while (opt != NULL) {
+		*opt++ = '\0';
+		if (!strncmp(opt, "block", 5)) {
+			level = OTFAD_TRACE_BLOCK;
+		} else if (!strncmp(opt, "chunk", 5)) {
+			level = OTFAD_TRACE_CHUNK;
+		} else {
+			n_events = strtoul(opt, NULL, 0);
+		}
+		opt = strchr(opt, ',');
+	}
+
+	if (!otfad_trace_start(fname, level, n_events)) {
+		atexit(trace_atexit);
+	}
+	free(fname);
+}
+
+/*
+ * Description : Reads OTFAD_TRACE_ENV once, on the first CTR context or key
+ *               wrap of the process
+ */
+void otfad_trace_init(void)
+{
+	pthread_once(&env_once, trace_env);
+}
+
+static void trace_key_create(void)
+{
+	pthread_key_create(&ring_key, trace_ring_release);
+}
+
+uint64_t otfad_trace_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Description : Hashes a keystream block, for events to tell keystreams
+ *               apart without holding them
+ *
+ * @Inputs  : block - 16-byte block
+ *            swap  - 1 for an encrypted counter, hashed in the OTFAD byte
+ *                    order of the keystream
+ *
+ * @Outputs : return the FNV-1a hash of the block
+ */
+uint32_t otfad_trace_hash(const uint8_t *block, int swap)
+{
+	static const uint8_t swap_idx[OTFAD_BLOCK_SIZE] = { OTFAD_SWAP_MASK };
+	uint32_t h = FNV_OFFSET_BASIS;
+	int i;
+
+	for (i = 0; i < OTFAD_BLOCK_SIZE; i++) {
+		h = (h ^ block[swap ? swap_idx[i] : i]) * FNV_PRIME;
+	}
+
+	return h;
+}
+
+/*
+ * Description : Returns the ring of the calling thread, created on its
+ *               first event
+ */
+static struct trace_ring *trace_ring_get(void)
+{
+	unsigned int gen = __atomic_load_n(&trace_gen, __ATOMIC_ACQUIRE);
+	struct trace_ring *r;
+
+	if (tls_ring != NULL && tls_gen == gen) {
+		return tls_ring;
+	}
+
+	pthread_mutex_lock(&trace_lock);
+	gen = trace_gen;
+	r = trace_free_rings;
+	if (trace_fname == NULL) {
+		/* Stopped meanwhile */
+		r = NULL;
+	} else if (r != NULL) {
+		trace_free_rings = r->next_free;
+	} else {
+		r = calloc(1, sizeof(*r));
+		if (r != NULL && otfad_buf_alloc(trace_n_events * sizeof(*r->ev), OTFAD_BUF_HUGE,
+						 (void **)&r->ev)) {
+			free(r);
+			r = NULL;
+		}
+		if (r != NULL) {
+			r->thread = trace_n_rings++;
+			r->next = trace_rings;
+			trace_rings = r;
+		}
+	}
+	/* Without memory, the thread records nothing for this trace. The ring
+	 * of a former trace, freed, is never given back at exit. */
+	tls_ring = r;
+	tls_gen = gen;
+	pthread_setspecific(ring_key, r);
+	pthread_mutex_unlock(&trace_lock);
+
+	return r;
+}
+
+/*
+ * Description : Records an event in the ring of the calling thread, over
+ *               its oldest event once full
+ *
+ * @Inputs  : type     - OTFAD_TRACE_EV_*
+ *            time_ns  - otfad_trace_time() at the start of the operation
+ *            addr     - System address, or key wrap step
+ *            size     - Bytes of the chunk or block
+ *            ctr      - Counter and counter XOR, or key wrap A
+ *            ctr_size - Bytes of ctr, at most 12
+ *            ks_hash  - otfad_trace_hash() of the keystream, or of B
+ */
+void otfad_trace_event(int type, uint64_t time_ns, uint32_t addr, uint32_t size,
+		       const uint8_t *ctr, size_t ctr_size, uint32_t ks_hash)
+{
+	struct trace_ring *r = trace_ring_get();
+	struct otfad_trace_event *e;
+
+	if (r == NULL) {
+		return;
+	}
+
+	e = &r->ev[r->head++ & (trace_n_events - 1)];
+	memset(e, 0, sizeof(*e));
+	e->time_ns = time_ns;
+	e->addr = addr;
+	e->size = size;
+	memcpy(e->ctr, ctr, ctr_size);
+	e->ks_hash = ks_hash;
+	e->type = type;
+}
+
+/*
+ * Description : Starts recording OTFAD operations. Each thread gets a ring
+ *               of n_events events on its first one; once full, the oldest
+ *               events are overwritten. A CHUNK trace records one event per
+ *               otfad_ctr_crypt call, with the address, counter and a hash
+ *               of the first keystream block; a BLOCK trace records every
+ *               counter block and key wrap step too, and runs the CTR
+ *               through the ECB blocks of the backend for that.
+ *
+ * @Inputs  : fname    - Trace file, written by otfad_trace_stop
+ *            level    - OTFAD_TRACE_CHUNK or OTFAD_TRACE_BLOCK
+ *            n_events - Events per thread, rounded up to a power of 2;
+ *                       0 for OTFAD_TRACE_EVENTS
+ *
+ * @Outputs : return 0 on success, -OTFAD_ERR_INVAL if a trace is running
+ */
+int otfad_trace_start(const char *fname, int level, size_t n_events)
+{
+	size_t n;
+	int ret = 0;
+
+	if (fname == NULL || level < OTFAD_TRACE_CHUNK || level > OTFAD_TRACE_BLOCK) {
+		return -OTFAD_ERR_INVAL;
+	}
+	if (n_events == 0) {
+		n_events = OTFAD_TRACE_EVENTS;
+	}
+	for (n = TRACE_MIN_EVENTS; n < n_events && n < SIZE_MAX / 2; n <<= 1) {
+		;
+	}
+
+	pthread_mutex_lock(&trace_lock);
+	if (trace_fname != NULL) {
+		ret = -OTFAD_ERR_INVAL;
+		goto out;
+	}
+	trace_fname = strdup(fname);
+	if (trace_fname == NULL) {
+		ret = -OTFAD_ERR_NOMEM;
+		goto out;
+	}
+	pthread_once(&key_once, trace_key_create);
+	trace_n_events = n;
+	trace_n_rings = 0;
+	__atomic_add_fetch(&trace_gen, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&otfad_trace_level, level, __ATOMIC_RELAXED);
+out:
+	pthread_mutex_unlock(&trace_lock);
+
+	return ret;
+}
+
+/*
+ * Description : Writes the ring of one thread, oldest event first
+ *
+ * @Outputs : return 0 on success, -1 on a write error
+ */
+static int trace_ring_write(FILE *fp, const struct trace_ring *r)
+{
+	struct otfad_trace_ring_hdr hdr;
+	uint64_t first;
+	uint64_t i;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.thread = r->thread;
+	hdr.n_events = (r->head > trace_n_events) ? trace_n_events : r->head;
+	hdr.n_lost = r->head - hdr.n_events;
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+		return -1;
+	}
+
+	first = r->head - hdr.n_events;
+	for (i = first; i < r->head; i++) {
+		if (fwrite(&r->ev[i & (trace_n_events - 1)], sizeof(*r->ev), 1, fp) != 1) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Stops the trace and writes the rings of all threads to the
+ *               trace file. The traced operations must be over.
+ *
+ * @Outputs : return 0 on success, -OTFAD_ERR_INVAL if no trace is running,
+ *            -OTFAD_ERR_IO if the file couldn't be written
+ */
+int otfad_trace_stop(void)
+{
+	struct otfad_trace_file_hdr hdr;
+	struct trace_ring *r;
+	FILE *fp;
+	int ret = 0;
+
+	pthread_mutex_lock(&trace_lock);
+	if (trace_fname == NULL) {
+		pthread_mutex_unlock(&trace_lock);
+		return -OTFAD_ERR_INVAL;
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, OTFAD_TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = OTFAD_TRACE_VERSION;
+	hdr.event_size = sizeof(struct otfad_trace_event);
+	hdr.n_rings = trace_n_rings;
+	hdr.level = __atomic_exchange_n(&otfad_trace_level, OTFAD_TRACE_OFF, __ATOMIC_RELAXED);
+
+	fp = fopen(trace_fname, "wb");
+	if (fp == NULL || fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+		ret = -OTFAD_ERR_IO;
+	}
+	/* Rings were pushed at the head: write the first thread first */
+	for (; ret == 0 && hdr.n_rings; hdr.n_rings--) {
+		for (r = trace_rings; r->thread != trace_n_rings - hdr.n_rings; r = r->next) {
+			;
+		}
+		if (trace_ring_write(fp, r)) {
+			ret = -OTFAD_ERR_IO;
+		}
+	}
+	if (fp != NULL && fclose(fp) && ret == 0) {
+		ret = -OTFAD_ERR_IO;
+	}
+
+	while ((r = trace_rings) != NULL) {
+		trace_rings = r->next;
+		otfad_buf_free(r->ev);
+		free(r);
+	}
+	trace_free_rings = NULL;
+	free(trace_fname);
+	trace_fname = NULL;
+	__atomic_add_fetch(&trace_gen, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&trace_lock);
+
+	return ret;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef OTFAD_TRACE_H
+#define OTFAD_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Environment variable enabling the trace: <file>[,chunk|block][,<events>] */
+#define OTFAD_TRACE_ENV         "OTFAD_TRACE"
+
+/*
+ * Trace file, in the byte order of the host: a file header, then for each
+ * thread a ring header followed by its events, oldest first
+ */
+#define OTFAD_TRACE_MAGIC       "OTFADTRC"
+#define OTFAD_TRACE_VERSION     1
+
+/* Event types */
+#define OTFAD_TRACE_EV_CHUNK    1       /* One otfad_ctr_crypt call */
+#define OTFAD_TRACE_EV_BLOCK    2       /* One counter block */
+#define OTFAD_TRACE_EV_WRAP     3       /* One key wrap step */
+#define OTFAD_TRACE_EV_UNWRAP   4       /* One key unwrap step */
+
+struct otfad_trace_file_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t event_size;
+	uint32_t n_rings;
+	uint32_t level;
+};
+
+struct otfad_trace_ring_hdr {
+	uint32_t thread;        /* Order in which the threads started tracing */
+	uint32_t reserved;
+	uint64_t n_events;      /* Events that follow */
+	uint64_t n_lost;        /* Older events overwritten in the ring */
+};
+
+struct otfad_trace_event {
+	uint64_t time_ns;       /* CLOCK_MONOTONIC */
+	uint32_t addr;          /* System address, or key wrap step t */
+	uint32_t size;          /* Bytes of the chunk or block */
+	uint8_t ctr[12];        /* Counter and counter XOR, or key wrap A */
+	uint32_t ks_hash;       /* FNV-1a of the first keystream block, or of B */
+	uint8_t type;
+	uint8_t reserved[7];
+};
+
+/* Level of the running trace, OTFAD_TRACE_OFF if none */
+extern int otfad_trace_level;
+
+static inline int otfad_trace_on(int level)
+{
+	return __atomic_load_n(&otfad_trace_level, __ATOMIC_RELAXED) >= level;
+}
+
+void otfad_trace_init(void);
+uint64_t otfad_trace_time(void);
+uint32_t otfad_trace_hash(const uint8_t *block, int swap);
+void otfad_trace_event(int type, uint64_t time_ns, uint32_t addr, uint32_t size,
+		       const uint8_t *ctr, size_t ctr_size, uint32_t ks_hash);
+
+#endif /* OTFAD_TRACE_H */
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+
+#include "otfad.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SSE2_TARGET     __attribute__((target("sse2")))
+#define AVX2_TARGET     __attribute__((target("avx2")))
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Description : Portable XOR, 64 bits at a time
+ */
+static void otfad_xor_scalar(const uint8_t *in, const uint8_t *ks, uint8_t *out, size_t size)
+{
+	uint64_t a, b;
+	size_t i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		memcpy(&a, in + i, 8);
+		memcpy(&b, ks + i, 8);
+		a ^= b;
+		memcpy(out + i, &a, 8);
+	}
+	for (; i < size; i++) {
+		out[i] = in[i] ^ ks[i];
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static SSE2_TARGET void otfad_xor_sse2(const uint8_t *in, const uint8_t *ks, uint8_t *out, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		_mm_storeu_si128((__m128i *)(out + i),
+				 _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + i)),
+					       _mm_loadu_si128((const __m128i *)(ks + i))));
+	}
+	otfad_xor_scalar(in + i, ks + i, out + i, size - i);
+}
+
+static AVX2_TARGET void otfad_xor_avx2(const uint8_t *in, const uint8_t *ks, uint8_t *out, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 128 <= size; i += 128) {
+		_mm256_storeu_si256((__m256i *)(out + i),
+				    _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(in + i)),
+						     _mm256_loadu_si256((const __m256i *)(ks + i))));
+		_mm256_storeu_si256((__m256i *)(out + i + 32),
+				    _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(in + i + 32)),
+						     _mm256_loadu_si256((const __m256i *)(ks + i + 32))));
+		_mm256_storeu_si256((__m256i *)(out + i + 64),
+				    _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(in + i + 64)),
+						     _mm256_loadu_si256((const __m256i *)(ks + i + 64))));
+		_mm256_storeu_si256((__m256i *)(out + i + 96),
+				    _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(in + i + 96)),
+						     _mm256_loadu_si256((const __m256i *)(ks + i + 96))));
+	}
+	/* The tail call skips the implicit VZEROUPPER: leave no dirty upper
+	 * state to slow down the SSE code of the caller */
+	_mm256_zeroupper();
+	otfad_xor_scalar(in + i, ks + i, out + i, size - i);
+}
+
+#elif defined(__ARM_NEON)
+
+static void otfad_xor_neon(const uint8_t *in, const uint8_t *ks, uint8_t *out, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		vst1q_u8(out + i, veorq_u8(vld1q_u8(in + i), vld1q_u8(ks + i)));
+	}
+	otfad_xor_scalar(in + i, ks + i, out + i, size - i);
+}
+
+#endif
+
+/*
+ * Description : XORs a buffer with a keystream already in OTFAD byte order,
+ *               e.g. the output of otfad_ctr_crypt() on zeros
+ *
+ * @Inputs  : in   - Input buffer
+ *            ks   - Keystream
+ *            out  - Output buffer (may be equal to in)
+ *            size - Number of bytes
+ */
+void otfad_xor(const uint8_t *in, const uint8_t *ks, uint8_t *out, size_t size)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("avx2")) {
+		otfad_xor_avx2(in, ks, out, size);
+		return;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		otfad_xor_sse2(in, ks, out, size);
+		return;
+	}
+#elif defined(__ARM_NEON)
+	otfad_xor_neon(in, ks, out, size);
+	return;
+#endif
+	otfad_xor_scalar(in, ks, out, size);
+}
@@ -0,0 +1,313 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "trace_decode.h"
+
+/*
+ * Description : Prints the usage information for running trace_decode
+ *
+ * @output : The usage info will be printed out on console window.
+ */
+void print_usage(void) {
+	int i = 0;
+	printf("OTFAD: Trace decoder tool\n"
+		"Usage: ./trace_decode ");
+	do {
+		printf("-%c <%s> ", long_opt[i].val, long_opt[i].name);
+		i++;
+	} while (long_opt[i + 1].name != NULL);
+	printf("\n");
+
+	i = 0;
+	printf("Options:\n");
+	do {
+		printf("\t-%c|--%s  -->  %s\n", long_opt[i].val, long_opt[i].name, opt_desc[i]);
+		i++;
+	} while (long_opt[i].name != NULL && opt_desc[i] != NULL);
+}
+
+/*
+ * Description : Handle each command line option
+ *
+ * @Inputs     : Command line arguments
+ */
+void handle_cl_opt(int argc, char **argv)
+{
+	int next_opt = 0;
+	int n_long_opt = 1; // Includes the command itself
+	int mandatory_opt = 0;
+	int i = 0;
+
+	do {
+		n_long_opt++;
+		if (long_opt[i].has_arg == required_argument) {
+			n_long_opt++;
+		}
+		i++;
+	} while (long_opt[i + 1].name != NULL);
+
+	/* Start from the first command-line option */
+	optind = 0;
+	/* Handle command line options*/
+	do {
+		next_opt = getopt_long(argc, argv, short_opt, long_opt, NULL);
+		switch (next_opt)
+		{
+		case 'i':
+			mandatory_opt += 1;
+			break;
+		/* Display usage */
+		case 'h':
+			print_usage();
+			exit(EXIT_SUCCESS);
+			break;
+		case '?':
+			/* Unknown character or option with no parameter */
+			print_usage();
+			exit(EXIT_FAILURE);
+			break;
+		/* At the end reach here and check if mandatory options are present */
+		default:
+			if (next_opt == -1 && mandatory_opt != 1) {
+				printf("Error: -i option is required\n");
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
+	} while (next_opt != -1);
+
+	/* Check for valid arguments */
+	if (argc < 2 || argc > n_long_opt) {
+		printf("Error: Incorrect number of options\n");
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Description : Reads the rings of all threads from the trace file
+ *
+ * @Inputs  : fp      - Trace file
+ *            hdr     - File header output
+ *            rings   - Rings output, to be freed with their events
+ *
+ * @Outputs : return 0 on success, -1 on failure
+ *
+ */
+static int read_trace(FILE *fp, struct otfad_trace_file_hdr *hdr, struct dec_ring **rings)
+{
+	struct dec_ring *r;
+	uint32_t i;
+
+	if (fread(hdr, sizeof(*hdr), 1, fp) != 1 ||
+	    memcmp(hdr->magic, OTFAD_TRACE_MAGIC, sizeof(hdr->magic))) {
+		printf("Error: Not an OTFAD trace file\n");
+		return -1;
+	}
+	if (hdr->version != OTFAD_TRACE_VERSION || hdr->event_size != sizeof(struct otfad_trace_event)) {
+		printf("Error: Trace version %u with %u-byte events isn't supported\n",
+		       hdr->version, hdr->event_size);
+		return -1;
+	}
+
+	r = calloc(hdr->n_rings ? hdr->n_rings : 1, sizeof(*r));
+	if (r == NULL) {
+		fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(errno));
+		return -1;
+	}
+	*rings = r;
+
+	for (i = 0; i < hdr->n_rings; i++) {
+		if (fread(&r[i].hdr, sizeof(r[i].hdr), 1, fp) != 1 ||
+		    r[i].hdr.n_events > SIZE_MAX / sizeof(*r[i].ev)) {
+			printf("Error: Truncated trace file\n");
+			return -1;
+		}
+		r[i].ev = malloc(r[i].hdr.n_events ? r[i].hdr.n_events * sizeof(*r[i].ev) : 1);
+		if (r[i].ev == NULL) {
+			fprintf(stderr, "Error: Error allocating memory; %s\n", strerror(errno));
+			return -1;
+		}
+		if (fread(r[i].ev, sizeof(*r[i].ev), r[i].hdr.n_events, fp) != r[i].hdr.n_events) {
+			printf("Error: Truncated trace file\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Description : Prints the OTFAD counter block of an address: counter,
+ *               counter XOR and big-endian system address
+ */
+static void print_counter(FILE *fp, const struct otfad_trace_event *e)
+{
+	int j;
+
+	for (j = 0; j < OTFAD_SYS_ADDR_OFFSET; j++) {
+		fprintf(fp, "%02X", e->ctr[j]);
+	}
+	fprintf(fp, "%08X", e->addr);
+}
+
+/*
+ * Description : Prints the events of one thread, in the format of the
+ *               former DEBUG output of libotfad, iterations counted from
+ *               the start of their otfad_ctr_crypt call
+ *
+ * @Inputs  : fp    - Output file
+ *            r     - Ring of the thread
+ *            t0    - Time of the first event of the trace
+ */
+static void print_ring(FILE *fp, const struct dec_ring *r, uint64_t t0)
+{
+	const struct otfad_trace_event *e;
+	uint32_t chunk_addr = 0;
+	int have_chunk = 0;
+	uint64_t it;
+	uint64_t k;
+	int j;
+
+	fprintf(fp, "Thread %u: %llu events", r->hdr.thread, (unsigned long long)r->hdr.n_events);
+	if (r->hdr.n_lost) {
+		fprintf(fp, ", %llu older events lost", (unsigned long long)r->hdr.n_lost);
+	}
+	fprintf(fp, "\n");
+
+	for (k = 0; k < r->hdr.n_events; k++) {
+		e = &r->ev[k];
+		switch (e->type) {
+		case OTFAD_TRACE_EV_CHUNK:
+			chunk_addr = e->addr;
+			have_chunk = 1;
+			fprintf(fp, "\n[%llu.%09llu] Total Iterations : %u\n",
+				(unsigned long long)((e->time_ns - t0) / NS_PER_SEC),
+				(unsigned long long)((e->time_ns - t0) % NS_PER_SEC), e->size / 16);
+			fprintf(fp, "System address = 0x%08X\n", e->addr);
+			fprintf(fp, "Input Counter:\t\t\t");
+			print_counter(fp, e);
+			fprintf(fp, "\nKeystream hash:\t\t\t%08X\n", e->ks_hash);
+			break;
+		case OTFAD_TRACE_EV_BLOCK:
+			/* Start of the call overwritten in the ring */
+			if (!have_chunk) {
+				chunk_addr = e->addr;
+				have_chunk = 1;
+				fprintf(fp, "\nIterations from 0x%08X, start of the call lost\n", chunk_addr);
+			}
+			it = (uint32_t)(e->addr - chunk_addr) / 16;
+			fprintf(fp, "\nIteration : %llu\n", (unsigned long long)it);
+			fprintf(fp, "System address in Iteration %llu = 0x%08X\n", (unsigned long long)it, e->addr);
+			fprintf(fp, "\nInput Counter:\t\t\t");
+			print_counter(fp, e);
+			fprintf(fp, "\nKeystream hash:\t\t\t%08X\n", e->ks_hash);
+			break;
+		case OTFAD_TRACE_EV_WRAP:
+		case OTFAD_TRACE_EV_UNWRAP:
+			fprintf(fp, "Key %s step %u: A = ",
+				(e->type == OTFAD_TRACE_EV_WRAP) ? "wrap" : "unwrap", e->addr);
+			for (j = 0; j < 8; j++) {
+				fprintf(fp, "%02X", e->ctr[j]);
+			}
+			fprintf(fp, ", B hash = %08X\n", e->ks_hash);
+			break;
+		default:
+			fprintf(fp, "Unknown event type %u\n", e->type);
+			break;
+		}
+	}
+	fprintf(fp, "\n");
+}
+
+int main (int argc, char **argv)
+{
+	FILE *fp_in = NULL;
+	FILE *fp_out = stdout;
+	char *input_fname = NULL;
+	char *output_fname = NULL;
+	struct otfad_trace_file_hdr hdr;
+	struct dec_ring *rings = NULL;
+	uint64_t t0 = UINT64_MAX;
+	int next_opt = 0;
+	int ret = EXIT_FAILURE;
+	uint32_t i;
+
+	memset(&hdr, 0, sizeof(hdr));
+
+	/* Handle command line options */
+	handle_cl_opt(argc, argv);
+
+	/* Start from the first command-line option */
+	optind = 0;
+	/* Perform actions according to command-line option */
+	do {
+		next_opt = getopt_long(argc, argv, short_opt, long_opt, NULL);
+		switch (next_opt)
+		{
+		/* Trace file */
+		case 'i':
+			input_fname = optarg;
+			break;
+		/* Output file */
+		case 'o':
+			output_fname = optarg;
+			break;
+		default:
+			break;
+		}
+	} while (next_opt != -1);
+
+	fp_in = fopen(input_fname, "rb");
+	if (fp_in == NULL) {
+		fprintf(stderr, "Error: Couldn't open file %s; %s\n", input_fname, strerror(errno));
+		goto out;
+	}
+	if (read_trace(fp_in, &hdr, &rings)) {
+		goto out;
+	}
+
+	if (output_fname != NULL) {
+		fp_out = fopen(output_fname, "w");
+		if (fp_out == NULL) {
+			fprintf(stderr, "Error: Couldn't open file %s; %s\n", output_fname, strerror(errno));
+			goto out;
+		}
+	}
+
+	/* Times are printed from the first event of any thread */
+	for (i = 0; i < hdr.n_rings; i++) {
+		if (rings[i].hdr.n_events && rings[i].ev[0].time_ns < t0) {
+			t0 = rings[i].ev[0].time_ns;
+		}
+	}
+
+	fprintf(fp_out, "Trace level: %s, %u threads\n",
+		(hdr.level >= OTFAD_TRACE_BLOCK) ? "block" : "chunk", hdr.n_rings);
+	for (i = 0; i < hdr.n_rings; i++) {
+		print_ring(fp_out, &rings[i], t0);
+	}
+
+	if (fflush(fp_out)) {
+		fprintf(stderr, "Error: Couldn't write the output; %s\n", strerror(errno));
+		goto out;
+	}
+	ret = EXIT_SUCCESS;
+out:
+	if (rings != NULL) {
+		for (i = 0; i < hdr.n_rings; i++) {
+			FREE(rings[i].ev);
+		}
+		FREE(rings);
+	}
+	FCLOSE(fp_in);
+	if (fp_out != stdout) {
+		FCLOSE(fp_out);
+	}
+
+	return ret;
+}
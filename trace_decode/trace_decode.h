@@ -0,0 +1,66 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef TRACE_DECODE_H
+#define TRACE_DECODE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+#include "otfad.h"
+#include "otfad_trace.h"
+
+#define NS_PER_SEC              1000000000ULL
+
+#define FREE(x)         do { \
+				if(x != NULL) { \
+					free(x); \
+					x = NULL; \
+				} \
+			} while(0)
+
+#define FCLOSE(x)         do { \
+				if(x != NULL) { \
+					fclose(x); \
+					x = NULL; \
+				} \
+			} while(0)
+
+/* Events of one thread, as read from the trace file */
+struct dec_ring {
+	struct otfad_trace_ring_hdr hdr;
+	struct otfad_trace_event *ev;
+};
+
+/************************
+	Command line arguments
+************************/
+/* Valid short command line option letters. */
+const char* const short_opt = "i:o:h";
+
+/* Valid long command line options. */
+const struct option long_opt[] =
+{
+	{"input", required_argument, 0, 'i'},
+	{"output", required_argument,  0, 'o'},
+	{"help", no_argument, 0, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+/* Option descriptions */
+const char* opt_desc[] =
+{
+	"Trace file written by libotfad (OTFAD_TRACE environment variable)",
+	"Output File (default: stdout)",
+	"This text",
+	NULL
+};
+
+#endif /* TRACE_DECODE_H */